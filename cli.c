@@ -0,0 +1,363 @@
+#define IMJ_IMPLEMENTATION
+#include "imj.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define OUT_BUFFER_SIZE (1 << 20)
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: imj <command> [options] [file]\n"
+        "\n"
+        "commands:\n"
+        "  fmt [--style=min|single|pretty] [--indent=N] [--cbor] [-o out] [file]\n"
+        "                     renders json or cbor input in the given style, pretty by default\n"
+        "  validate [file...] checks every file is a single json value\n"
+        "  stats [file]       validates and counts values, depth and sizes\n"
+        "\n"
+        "without a file, or with '-', the input is read from stdin\n");
+}
+
+typedef struct input_t input_t;
+struct input_t {
+    const char *name;
+    const char *data;
+    size_t n;
+
+    // one of these owns 'data'
+    void *map;
+    char *read;
+    imj_t decompressed;
+};
+
+static bool input_read_stream(input_t *input, FILE *file) {
+    size_t capacity = 0;
+    while (true) {
+        if (input->n == capacity) {
+            capacity = capacity == 0 ? OUT_BUFFER_SIZE : capacity*2;
+            char *grown = realloc(input->read, capacity);
+            // the old buffer is still owned by the input and freed with it
+            if (grown == NULL) return false;
+            input->read = grown;
+        }
+
+        size_t got = fread(input->read + input->n, 1, capacity - input->n, file);
+        input->n += got;
+        if (got == 0) break;
+    }
+
+    input->data = input->read;
+    return !ferror(file);
+}
+
+// maps the file so it's paged in as it's parsed instead of copied up front
+static bool input_map(input_t *input, const char *path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    bool success = GetFileSizeEx(file, &size);
+    input->n = success ? (size_t)size.QuadPart : 0;
+
+    if (success && input->n > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        input->map = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (mapping) CloseHandle(mapping);
+        success = input->map != NULL;
+    }
+
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool success = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    input->n = success ? (size_t)st.st_size : 0;
+
+    if (success && input->n > 0) {
+        input->map = mmap(NULL, input->n, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (input->map == MAP_FAILED) input->map = NULL;
+        success = input->map != NULL;
+        if (success) madvise(input->map, input->n, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+#endif
+
+    input->data = input->map ? input->map : "";
+    return success;
+}
+
+// the mapping or stream buffer, whichever was used
+static void input_release(input_t *input, size_t n) {
+#ifdef _WIN32
+    if (input->map) UnmapViewOfFile(input->map);
+#else
+    if (input->map) munmap(input->map, n);
+#endif
+    free(input->read);
+    input->map = NULL;
+    input->read = NULL;
+}
+
+static void input_close(input_t *input) {
+    input_release(input, input->n);
+    imj_free(&input->decompressed);
+}
+
+// compressed input is decompressed whole, it can't be parsed where it is
+static bool input_decompress(input_t *input, const char *path) {
+    FILE *file;
+    if (path) {
+        file = fopen(path, "rb");
+    } else {
+        // stdin can't be read twice, the block decoder reads what was already buffered back from a temporary file
+        file = tmpfile();
+        if (file && fwrite(input->data, 1, input->n, file) != input->n) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+    size_t size = 0;
+    char *buffer = NULL;
+    if (file && fseek(file, __IMJ_CODEC_HEADER_SIZE, SEEK_SET) == 0) {
+        buffer = __imj_decompress_file(file, (const uint8_t*)input->data, &input->decompressed, &size);
+    }
+    if (file) fclose(file);
+
+    input_release(input, input->n);
+    input->data = buffer;
+    input->n = size;
+    return buffer != NULL;
+}
+
+static bool input_open(input_t *input, const char *path) {
+    *input = (input_t){0};
+
+    bool success;
+    if (path == NULL || strcmp(path, "-") == 0) {
+        path = NULL;
+        input->name = "<stdin>";
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        success = input_read_stream(input, stdin);
+    } else {
+        input->name = path;
+        success = input_map(input, path);
+    }
+
+    if (!success) {
+        fprintf(stderr, "%s: cannot read input\n", input->name);
+        input_close(input);
+        return false;
+    }
+
+    if (input->n >= __IMJ_CODEC_HEADER_SIZE && memcmp(input->data, __IMJ_CODEC_MAGIC, 4) == 0 && !input_decompress(input, path)) {
+        fprintf(stderr, "%s: cannot decompress input\n", input->name);
+        input_close(input);
+        return false;
+    }
+
+    return true;
+}
+
+static void print_error(const char *name, imj_error_t error) {
+    fprintf(stderr, "%s:%zu:%zu: %s\n", name, error.line, error.column, error.message);
+}
+
+// validating and counting only know json, cbor input can still go through fmt
+static bool is_json(input_t *input) {
+    imj_t reader;
+    imjr_cstrn(input->data, input->n, &reader);
+    bool json = reader.encoding == IMJ_ENCODING_JSON;
+    imj_free(&reader);
+
+    if (!json) fprintf(stderr, "%s: only json can be validated, not cbor\n", input->name);
+    return json;
+}
+
+typedef struct output_t output_t;
+struct output_t {
+    FILE *file;
+    bool failed;
+};
+
+static void output_write(void *user, const char *data, size_t n) {
+    output_t *output = user;
+    if (!output->failed && fwrite(data, 1, n, output->file) != n) output->failed = true;
+}
+
+static int fmt(int argc, char **argv) {
+    imj_render_style_t style = IMJ_STYLE_PRETTY;
+    imj_encoding_t encoding = IMJ_ENCODING_JSON;
+    size_t indent = 2;
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+
+    for (int i = 0; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--style=min") == 0) style = IMJ_STYLE_MIN;
+        else if (strcmp(arg, "--style=single") == 0) style = IMJ_STYLE_SINGLE_LINE;
+        else if (strcmp(arg, "--style=pretty") == 0) style = IMJ_STYLE_PRETTY;
+        else if (strncmp(arg, "--indent=", 9) == 0) indent = (size_t)strtoul(arg + 9, NULL, 10);
+        else if (strcmp(arg, "--cbor") == 0) encoding = IMJ_ENCODING_CBOR;
+        else if (strcmp(arg, "-o") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (in_path == NULL && (arg[0] != '-' || arg[1] == '\0')) in_path = arg;
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    input_t input;
+    if (!input_open(&input, in_path)) return 1;
+
+    output_t output = { .file = stdout };
+    if (out_path) output.file = fopen(out_path, "wb");
+    if (output.file == NULL) {
+        fprintf(stderr, "%s: cannot open output\n", out_path);
+        input_close(&input);
+        return 1;
+    }
+
+#ifdef _WIN32
+    if (out_path == NULL) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    // the sink already hands over large blocks, another buffer would only copy them again
+    setvbuf(output.file, NULL, _IONBF, 0);
+
+    imj_t reader, writer;
+    imjr_cstrn(input.data, input.n, &reader);
+    reader.log_errors = false;
+    imjw_init_ex(&writer, encoding);
+    writer.render_style = style;
+    writer.indent_size = indent;
+
+    // cbor patches lengths in at the end so it's kept whole
+    if (encoding == IMJ_ENCODING_JSON) imjw_sink(&writer, output_write, &output, OUT_BUFFER_SIZE);
+
+    // an empty document would be written out as null
+    bool success = reader.value_pending && imj_transcode(&reader, &writer);
+    if (success && reader.encoding == IMJ_ENCODING_JSON) {
+        const char *end = input.data + input.n;
+        const char *p = reader.current;
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+        success = p == end;
+    }
+
+    if (success) {
+        if (encoding == IMJ_ENCODING_JSON) {
+            imjw_sink_flush(&writer);
+            output_write(&output, "\n", 1);
+        } else {
+            output_write(&output, writer.sb.items, writer.sb.count);
+        }
+    } else {
+        imj_error_t error = { .message = "invalid cbor", .line = 1, .column = 1 };
+        if (reader.encoding == IMJ_ENCODING_JSON) imj_validate(input.data, input.n, &error);
+        print_error(input.name, error);
+    }
+
+    if (out_path) output.failed |= fclose(output.file) != 0;
+    else output.failed |= fflush(output.file) != 0;
+
+    if (success && output.failed) fprintf(stderr, "%s: cannot write output\n", out_path ? out_path : "<stdout>");
+
+    imj_free(&reader);
+    imj_free(&writer);
+    input_close(&input);
+    return success && !output.failed ? 0 : 1;
+}
+
+static int validate(int argc, char **argv) {
+    int status = 0;
+    for (int i = 0; i < argc || (argc == 0 && i == 0); ++i) {
+        input_t input;
+        if (!input_open(&input, argc > 0 ? argv[i] : NULL)) {
+            status = 1;
+            continue;
+        }
+
+        imj_error_t error;
+        if (!is_json(&input)) {
+            status = 1;
+        } else if (!imj_validate(input.data, input.n, &error)) {
+            print_error(input.name, error);
+            status = 1;
+        }
+
+        input_close(&input);
+    }
+
+    return status;
+}
+
+static int stats(int argc, char **argv) {
+    if (argc > 1) {
+        usage();
+        return 2;
+    }
+
+    input_t input;
+    if (!input_open(&input, argc > 0 ? argv[0] : NULL)) return 1;
+
+    if (!is_json(&input)) {
+        input_close(&input);
+        return 1;
+    }
+
+    imj_stats_t stats;
+    imj_error_t error;
+    bool success = imj_stats(input.data, input.n, &stats, &error);
+
+    if (success) {
+        printf("bytes             %zu\n", input.n);
+        printf("whitespace bytes  %zu\n", stats.whitespace_bytes);
+        printf("max depth         %zu\n", stats.max_depth);
+        printf("objects           %zu\n", stats.objects);
+        printf("arrays            %zu\n", stats.arrays);
+        printf("keys              %zu\n", stats.keys);
+        printf("strings           %zu\n", stats.strings);
+        printf("numbers           %zu\n", stats.numbers);
+        printf("bools             %zu\n", stats.bools);
+        printf("nulls             %zu\n", stats.nulls);
+        printf("key bytes         %zu\n", stats.key_bytes);
+        printf("string bytes      %zu\n", stats.string_bytes);
+        printf("longest key/str   %zu\n", stats.longest_string);
+    } else {
+        print_error(input.name, error);
+    }
+
+    input_close(&input);
+    return success ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    const char *command = argv[1];
+    if (strcmp(command, "fmt") == 0) return fmt(argc - 2, argv + 2);
+    if (strcmp(command, "validate") == 0) return validate(argc - 2, argv + 2);
+    if (strcmp(command, "stats") == 0) return stats(argc - 2, argv + 2);
+
+    usage();
+    return 2;
+}
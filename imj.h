@@ -5,12 +5,32 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 enum imj_io_mode_t {
     IMJ_WRITE,
     IMJ_READ,
+    IMJ_PATCH,
 };
 typedef enum imj_io_mode_t imj_io_mode_t;
 
+enum imj_encoding_t {
+    IMJ_ENCODING_JSON = 0,
+    IMJ_ENCODING_CBOR,
+};
+typedef enum imj_encoding_t imj_encoding_t;
+
+// files written with a codec start with "IMJZ", readers pick the codec from there
+enum imj_codec_t {
+    IMJ_CODEC_NONE = 0,
+    IMJ_CODEC_LZ,
+    IMJ_CODEC_ZLIB, // needs IMJ_USE_ZLIB and -lz
+    IMJ_CODEC_ZSTD, // needs IMJ_USE_ZSTD and -lzstd
+};
+typedef enum imj_codec_t imj_codec_t;
+
 typedef struct imj_sv_t imj_sv_t;
 struct imj_sv_t {
     const char *data;
@@ -19,16 +39,49 @@ struct imj_sv_t {
 
 
 typedef struct imj_region_t imj_region_t;
-struct imj_region_t {
-    imj_region_t *prev;
-    size_t capacity;
-    size_t count;
-    char data[];
-};
 
 typedef struct imj_arena_t imj_arena_t;
 struct imj_arena_t {
     imj_region_t *region_back;
+
+    // a single caller-owned region that is never grown or freed
+    bool fixed;
+    size_t required;
+};
+
+typedef struct imj_shape_t imj_shape_t;
+struct imj_shape_t {
+    imj_shape_t *child;
+    imj_shape_t *sibling;
+    imj_sv_t key;
+};
+
+// learned key sequences, can be shared between many imj_t that read the same kind of document
+typedef struct imj_shapes_t imj_shapes_t;
+struct imj_shapes_t {
+    imj_arena_t arena;
+    imj_shape_t root;
+    size_t node_count;
+    size_t hits;
+    size_t misses;
+};
+
+typedef struct imj_str_slot_t imj_str_slot_t;
+struct imj_str_slot_t {
+    uint64_t hash;
+    const char *str;
+    size_t length;
+};
+
+// storage for strings read with imj_valcstr and bytes read with imj_valbytes_alloc, freed all at once with imj_strings_free
+typedef struct imj_strings_t imj_strings_t;
+struct imj_strings_t {
+    imj_arena_t arena;
+    bool intern; // identical strings share one pointer
+    imj_str_slot_t *slots;
+    size_t slot_capacity;
+    size_t count;
+    size_t bytes;
 };
 
 typedef struct imj_key_t imj_key_t;
@@ -58,30 +111,71 @@ enum imj_val_kind_t {
 };
 typedef enum imj_val_kind_t imj_val_kind_t;
 
+typedef struct imj_doc_t imj_doc_t;
+typedef struct imj_doc_node_t imj_doc_node_t;
+typedef struct imj_profile_t imj_profile_t;
+
 typedef struct imj_lvl_t imj_lvl_t;
 struct imj_lvl_t {
     imj_val_kind_t type;
     imj_lvl_t *prev;
     char *left_off_or_null;
     imj_keys_t keys;
+    imj_shape_t *shape;
+    char *value_end;
     size_t count;
+    size_t next_key;
+    const imj_doc_node_t *node;
+
+    // cbor
+    size_t remaining;
+    size_t head_at;
+
+    // patching
+    size_t first_edit;
 };
 
 typedef struct imj_val_t imj_val_t;
 struct imj_val_t {
     imj_val_kind_t kind;
-    long i;
-    size_t s;
+    int64_t i;
+    uint64_t s;
     double d;
     imj_sv_t sv;
     bool b;
+    // json numbers: the magnitude is s*10^i, 'integral' when that is exact and i is 0
+    // cbor numbers: 'integral' for integers and bignums that fit, exact in s or i
+    bool integral;
 };
 
 typedef struct imj_sb_t imj_sb_t;
+typedef void (*imj_sink_fn)(void *user, const char *data, size_t n);
+
 struct imj_sb_t {
     char *items;
     size_t count;
     size_t capacity;
+    bool fixed; // counts on past capacity without writing
+    imj_sink_fn sink; // set by imjw_sink, takes the full buffer instead of growing it
+    void *sink_user;
+};
+
+// replaces the source bytes between start and end with 'length' bytes of the rendered output at 'at'
+typedef struct imj_edit_t imj_edit_t;
+struct imj_edit_t {
+    const char *start;
+    const char *end;
+    imj_lvl_t *lvl_or_null;
+    size_t at;
+    size_t length;
+    size_t order;
+};
+
+typedef struct imj_edits_t imj_edits_t;
+struct imj_edits_t {
+    imj_edit_t *items;
+    size_t count;
+    size_t capacity;
 };
 
 enum imj_render_style_t {
@@ -95,8 +189,12 @@ typedef struct imj_t imj_t;
 struct imj_t {
     const char *filepath;
     imj_io_mode_t io_mode;
+    imj_encoding_t encoding;
+    imj_codec_t codec;
     imj_arena_t arena;
     imj_lvl_t *lvl_or_null;
+    imj_lvl_t spare_lvl;
+    imj_lvl_t *free_lvls;
     bool done;
 
     // reading
@@ -105,31 +203,191 @@ struct imj_t {
     bool value_pending;
     bool log_errors;
     bool had_error;
+    imj_shapes_t *shapes;
+    imj_shapes_t local_shapes;
+    size_t max_depth; // 0 means IMJ_MAX_DEPTH, values that are skipped can't nest deeper than IMJ_MAX_DEPTH either way
+    imj_doc_t *doc;
+    imj_strings_t *strings;
+    imj_profile_t *profile; // set to time io functions per path, see imj_profile_new
 
     // writing
     imj_sb_t sb;
     imj_render_style_t render_style;
     size_t indent_lvl;
     size_t indent_size;
+
+    // patching
+    imj_edits_t edits;
+    imj_edit_t rendering;
+    imj_lvl_t *render_base;
+    bool is_rendering;
+    bool render_value_pending;
 };
 
 typedef void*(*imj_alloc)(void *allocator, size_t size_bytes);
 
+typedef struct imj_error_t imj_error_t;
+struct imj_error_t {
+    const char *message;
+    size_t offset;
+    size_t line;
+    size_t column;
+};
+
 imj_sv_t imj_cstr2sv(const char *cstr);
 bool imj_sv_cstr_eq(imj_sv_t sv, const char *cstr);
 bool imj_rawsv_to_cstrn(imj_sv_t sv, char *buffer, size_t n);
+// like imj_rawsv_to_cstrn and 'length' is the unescaped size, never more than sv.length
+bool imj_rawsv_unescape(imj_sv_t sv, char *buffer, size_t n, size_t *length);
 
 bool imj_file(const char *filepath, imj_t *imj, imj_io_mode_t mode);
+bool imj_file_ex(const char *filepath, imj_t *imj, imj_io_mode_t mode, imj_encoding_t encoding);
 bool imjw_flush(imj_t *imj);
-
+// only writes when the output or its codec differs from what's on disk, 'hash' is what the last flush set it to or 0 to compare with the file
+// 'hash' may be NULL, on success it's set to the hash of what the file holds now, which covers the codec and equals imj_content_hash uncompressed
+bool imjw_flush_if_changed(imj_t *imj, uint64_t *hash);
+// xxh64 of the finished output, or of the source when reading, the same on every machine so it can key caches
+uint64_t imj_content_hash(imj_t *imj);
+
+// writes the finished document on a background thread, 'imj' hands over its memory and is left empty
+typedef struct imj_flush_t imj_flush_t;
+imj_flush_t *imjw_flush_async(imj_t *imj);
+bool imjw_flush_is_done(imj_flush_t *flush);
+// waits for the write and frees the handle, returns whether the file was replaced
+bool imjw_flush_wait(imj_flush_t *flush);
+
+// reads 'paths' on 'nthreads' threads, 0 for one per core, and hands each file to 'io' as a read cursor
+// 'io' runs on whichever thread loaded the file, files further down the list are read ahead while earlier ones parse
+// true when every file was read without errors
+typedef void (*imj_batch_fn)(imj_t *imj, size_t index, void *user);
+bool imj_load_batch(const char **paths, size_t n, imj_batch_fn io, void *user, size_t nthreads);
+
+// time, bytes and values of every object, array and key scope, summed per path like /player/items[]/damage
+// only recorded when the implementation is compiled with IMJ_PROFILER, set it as imj->profile on any number of cursors
+// a profile is not thread safe, give each thread its own
+imj_profile_t *imj_profile_new(void);
+// adds the cycles and branch misses of each scope, false when the cpu counters can't be opened
+bool imj_profile_counters(imj_profile_t *profile);
+void imj_profile_free(imj_profile_t *profile);
+// writes the paths sorted by time spent, to stdout when 'filepath' is null
+bool imj_profile_report(imj_profile_t *profile, const char *filepath);
+// writes every scope as a chrome trace event, up to IMJ_PROFILE_MAX_EVENTS of them
+bool imj_profile_trace(imj_profile_t *profile, const char *filepath);
+
+// reads the first 'n' bytes of 'cstr' in place, it needs no terminator and must outlive 'imj'
+// a nul byte inside the value is an error rather than the end of the source
 void imjr_cstrn(const char *cstr, size_t n, imj_t *imj);
+
+// a loaded document that never changes, any number of threads can read it through their own cursor
+imj_doc_t *imj_doc_file(const char *filepath);
+imj_doc_t *imj_doc_cstrn(const char *cstr, size_t n);
+// records where each object and array ends and what keys it has so cursors look up and skip without scanning
+// json text only, call it before the document is shared
+bool imj_doc_index(imj_doc_t *doc);
+void imj_doc_retain(imj_doc_t *doc);
+void imj_doc_release(imj_doc_t *doc);
+// starts a read cursor over 'doc', it holds a reference until imj_free
+void imjr_doc(imj_doc_t *doc, imj_t *imj);
+
+typedef struct imj_doc_cache_stats_t imj_doc_cache_stats_t;
+struct imj_doc_cache_stats_t {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t bytes;
+    size_t count;
+};
+
+// process-wide and thread-safe, a file is loaded and indexed again only once its size or modification time changes
+// least recently used documents are dropped once the cache holds more than its budget, IMJ_DOC_CACHE_BUDGET by default
+imj_doc_t *imj_doc_cached(const char *filepath);
+// a read cursor over the cached document
+bool imj_file_cached(const char *filepath, imj_t *imj);
+void imj_doc_cache_budget(size_t bytes);
+imj_doc_cache_stats_t imj_doc_cache_stats(void);
+void imj_doc_cache_clear(void);
+// runs io functions over an existing json document, only values that differ from the source are rendered
+void imjp_cstrn(const char *cstr, size_t n, imj_t *imj);
+
+#ifndef IMJ_JOURNAL_COMPACT_RATIO
+#define IMJ_JOURNAL_COMPACT_RATIO 1.0
+#endif
+
+// a json base file and a sidecar at 'filepath'.journal with one line of json patch per commit
+typedef struct imj_journal_t imj_journal_t;
+struct imj_journal_t {
+    char *filepath;
+    char *journal_filepath;
+    imj_sb_t snapshot; // the document as of the last commit, the base with the journal replayed
+    uint64_t base_hash;
+    size_t base_size;
+    size_t journal_size;
+    double compact_ratio; // the journal is folded into the base once it would pass this many times its size, 0 for IMJ_JOURNAL_COMPACT_RATIO
+};
+
+// reads the base and replays the journal over it, a missing base starts out empty
+// a commit cut off by a crash is dropped, false when the files can't be read or the journal doesn't apply
+bool imj_journal_open(imj_journal_t *journal, const char *filepath);
+// read: the document as of the last commit, false when nothing was committed yet
+bool imjr_journal(imj_journal_t *journal, imj_t *imj);
+// 'imj' is a finished json writer, only the paths that changed since the last commit are appended
+// the first commit and compaction write the whole document with imjw_flush, so 'imj->codec' applies
+bool imj_journal_commit(imj_journal_t *journal, imj_t *imj);
+void imj_journal_free(imj_journal_t *journal);
 void imjw_init(imj_t *imj);
+void imjw_init_ex(imj_t *imj, imj_encoding_t encoding);
+
+// never touch the heap, levels and key caches live in 'scratch' and the output in 'out'
+// running out of scratch is an error, running out of output only stops filling 'out'
+void imjr_cstrn_fixed(const char *cstr, size_t n, imj_t *imj, void *scratch, size_t scratch_size);
+void imjw_init_fixed(imj_t *imj, imj_encoding_t encoding, void *scratch, size_t scratch_size, char *out, size_t out_size);
+// true when a buffer was too small, the sizes are what the document needed so far
+bool imj_required(imj_t *imj, size_t *scratch_size, size_t *out_size);
+
+// streams the output of a json writer to 'sink' each time its 'buffer_size' bytes fill up, instead of keeping all of it
+// values bigger than the buffer grow it, or overflow fixed output, what's left at the end is handed over by imjw_sink_flush
+void imjw_sink(imj_t *imj, imj_sink_fn sink, void *user, size_t buffer_size);
+void imjw_sink_flush(imj_t *imj);
+
+// reads the next value of 'from' and writes it into 'to', each in their own encoding
+bool imj_transcode(imj_t *from, imj_t *to);
+
+// checks 'data' is a single json value without allocating, 'error' can be null
+bool imj_validate(const char *data, size_t n, imj_error_t *error);
+
+// what imj_stats counts, string sizes are of the text between the quotes before unescaping
+typedef struct imj_stats_t imj_stats_t;
+struct imj_stats_t {
+    size_t max_depth;
+    size_t objects;
+    size_t arrays;
+    size_t keys;
+    size_t strings; // values only, keys aren't counted
+    size_t numbers;
+    size_t bools;
+    size_t nulls;
+    size_t key_bytes;
+    size_t string_bytes;
+    size_t longest_string; // keys included
+    size_t whitespace_bytes;
+};
+
+// validates like imj_validate and counts what's in the document, 'stats' is filled as far as it got on errors
+bool imj_stats(const char *data, size_t n, imj_stats_t *stats, imj_error_t *error);
 
 void imj_free(imj_t *lson);
+void imj_shapes_free(imj_shapes_t *shapes);
+void imj_strings_free(imj_strings_t *strings);
 
 bool imj_key(imj_t *imj, const char *key);
+bool imj_keyn(imj_t *imj, const char *key, size_t n);
+// read: moves to the next key of the current object in source order, the value is read with the usual io functions
+// 'key' points into the source and is still escaped for json text, see imj_rawsv_to_cstrn
+bool imj_next_key(imj_t *imj, imj_sv_t *key);
 
 bool imj_begin_obj(imj_t *imj);
+// read: 'count' is set to the number of keys
+bool imj_begin_obj_ex(imj_t *imj, size_t *count);
 void imj_end_obj(imj_t *imj);
 bool imj_begin_arr_ex(imj_t *imj, size_t *count);
 bool imj_begin_arr(imj_t *imj);
@@ -140,20 +398,109 @@ bool imj_valnull(imj_t *imj);
 bool imj_valb(imj_t *imj, bool *value, bool default_);
 bool imj_vali(imj_t *imj, int *value, int default_);
 bool imj_vals(imj_t *imj, size_t *value, size_t default_);
+// read: values that are out of range for the type fail and read as the default
+bool imj_vali64(imj_t *imj, int64_t *value, int64_t default_);
+bool imj_valu64(imj_t *imj, uint64_t *value, uint64_t default_);
+bool imj_vali32(imj_t *imj, int32_t *value, int32_t default_);
+bool imj_valu32(imj_t *imj, uint32_t *value, uint32_t default_);
+bool imj_vali16(imj_t *imj, int16_t *value, int16_t default_);
+bool imj_valu16(imj_t *imj, uint16_t *value, uint16_t default_);
+bool imj_vali8(imj_t *imj, int8_t *value, int8_t default_);
+bool imj_valu8(imj_t *imj, uint8_t *value, uint8_t default_);
 bool imj_valf(imj_t *imj, float *value, float default_);
 bool imj_vald(imj_t *imj, double *value, double default_);
+// read: with a null 'alloc' the string goes into 'allocator' as an imj_strings_t, or imj->strings if that is null too
 bool imj_valcstr(imj_t *imj, const char **value, const char *default_, imj_alloc alloc, void *allocator);
 bool imj_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_);
+// byte data is base64 text in json and a byte string in cbor, reading takes either
+// read: fails when the data needs more than 'cap' bytes, *len is then the size it needs
+bool imj_valbytes(imj_t *imj, void *buf, size_t *len, size_t cap);
+// read: with a null 'alloc' the data goes into 'allocator' as an imj_strings_t, or imj->strings if that is null too
+bool imj_valbytes_alloc(imj_t *imj, void **buf, size_t *len, imj_alloc alloc, void *allocator);
+
+#ifndef IMJ_PATH_MAX_SEGMENTS
+#define IMJ_PATH_MAX_SEGMENTS 32
+#endif
+
+#ifndef IMJ_PATH_MAX_LENGTH
+#define IMJ_PATH_MAX_LENGTH 256
+#endif
+
+typedef struct imj_path_segment_t imj_path_segment_t;
+struct imj_path_segment_t {
+    size_t offset; // into imj_path_t.text
+    size_t length;
+    size_t index; // SIZE_MAX when the segment can't be an array index
+};
+
+// a compiled json pointer (rfc 6901), it owns its text so it can be copied and kept around
+typedef struct imj_path_t imj_path_t;
+struct imj_path_t {
+    imj_path_segment_t segments[IMJ_PATH_MAX_SEGMENTS];
+    size_t count;
+    char text[IMJ_PATH_MAX_LENGTH];
+};
+
+// false when 'pointer' is malformed or longer than the limits above
+bool imj_path_compile(imj_path_t *path, const char *pointer);
+
+// read: looks a value up from the root of the source in one forward scan, without levels or allocation
+// the cursor is left where it was, so queries can be mixed with the usual io functions
+bool imj_path_valb(imj_t *imj, const imj_path_t *path, bool *value, bool default_);
+bool imj_path_vali64(imj_t *imj, const imj_path_t *path, int64_t *value, int64_t default_);
+bool imj_path_valu64(imj_t *imj, const imj_path_t *path, uint64_t *value, uint64_t default_);
+bool imj_path_vald(imj_t *imj, const imj_path_t *path, double *value, double default_);
+bool imj_path_valrawsv(imj_t *imj, const imj_path_t *path, imj_sv_t *value, const char *default_);
+// the same, compiling 'pointer' on the spot
+bool imj_query_valb(imj_t *imj, const char *pointer, bool *value, bool default_);
+bool imj_query_vali64(imj_t *imj, const char *pointer, int64_t *value, int64_t default_);
+bool imj_query_valu64(imj_t *imj, const char *pointer, uint64_t *value, uint64_t default_);
+bool imj_query_vald(imj_t *imj, const char *pointer, double *value, double default_);
+bool imj_query_valrawsv(imj_t *imj, const char *pointer, imj_sv_t *value, const char *default_);
+
+enum imj_column_type_t {
+    IMJ_COLUMN_BOOL,
+    IMJ_COLUMN_I32,
+    IMJ_COLUMN_I64,
+    IMJ_COLUMN_U64,
+    IMJ_COLUMN_FLOAT,
+    IMJ_COLUMN_DOUBLE,
+    IMJ_COLUMN_RAWSV, // imj_sv_t into the source, escaped for json text
+};
+typedef enum imj_column_type_t imj_column_type_t;
+
+typedef struct imj_column_t imj_column_t;
+struct imj_column_t {
+    const char *key;
+    imj_column_type_t type;
+    void *out; // room for 'cap' values of 'type', rows without the key are left untouched
+    bool *present; // optional, whether each row had the key with a value of the right type
+};
+
+// read: sweeps an array of objects once, one row per element, and skips every key that isn't a column
+// 'count' is the number of elements even past 'cap', rows past 'cap' are skipped
+bool imj_arr_columns(imj_t *imj, imj_column_t *columns, size_t column_count, size_t cap, size_t *count);
+bool imj_arr_column(imj_t *imj, const char *key, imj_column_type_t type, void *out, size_t cap, size_t *count);
 
 // convenience
 bool imj_key_valnull(imj_t *imj, const char *key);
 bool imj_key_valb(imj_t *imj, const char *key, bool *value, bool default_);
 bool imj_key_vali(imj_t *imj, const char *key, int *value, int default_);
 bool imj_key_vals(imj_t *imj, const char *key, size_t *value, size_t default_);
+bool imj_key_vali64(imj_t *imj, const char *key, int64_t *value, int64_t default_);
+bool imj_key_valu64(imj_t *imj, const char *key, uint64_t *value, uint64_t default_);
+bool imj_key_vali32(imj_t *imj, const char *key, int32_t *value, int32_t default_);
+bool imj_key_valu32(imj_t *imj, const char *key, uint32_t *value, uint32_t default_);
+bool imj_key_vali16(imj_t *imj, const char *key, int16_t *value, int16_t default_);
+bool imj_key_valu16(imj_t *imj, const char *key, uint16_t *value, uint16_t default_);
+bool imj_key_vali8(imj_t *imj, const char *key, int8_t *value, int8_t default_);
+bool imj_key_valu8(imj_t *imj, const char *key, uint8_t *value, uint8_t default_);
 bool imj_key_valf(imj_t *imj, const char *key, float *value, float default_);
 bool imj_key_vald(imj_t *imj, const char *key, double *value, double default_);
 bool imj_key_valcstr(imj_t *imj, const char *key, const char **value, const char *default_, imj_alloc alloc, void *allocator);
 bool imj_key_valrawsv(imj_t *imj, const char *key, imj_sv_t *value, const char *default_);
+bool imj_key_valbytes(imj_t *imj, const char *key, void *buf, size_t *len, size_t cap);
+bool imj_key_valbytes_alloc(imj_t *imj, const char *key, void **buf, size_t *len, imj_alloc alloc, void *allocator);
 
 // write only - convenience functions
 void imjw_valb(imj_t *imj, bool value);
@@ -163,6 +510,10 @@ void imjw_valf(imj_t *imj, float value);
 void imjw_vald(imj_t *imj, double value);
 void imjw_valcstr(imj_t *imj, const char *value);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
 #ifdef IMJ_IMPLEMENTATION
@@ -178,17 +529,112 @@ void imjw_valcstr(imj_t *imj, const char *value);
 #include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <ctype.h>
+
+#if !defined(IMJ_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define __IMJ_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__IMJ_SSE2) && (defined(__SSSE3__) || defined(__AVX__))
+#define __IMJ_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+#define __IMJ_LITTLE_ENDIAN
+#endif
+
+#ifdef IMJ_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef IMJ_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#endif
+
+// syscall() is only declared outside strict iso builds, without it imj_profile_counters returns false
+#if defined(IMJ_PROFILER) && defined(__linux__) && (defined(_DEFAULT_SOURCE) || defined(_BSD_SOURCE) || defined(_GNU_SOURCE))
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define __IMJ_PERF_COUNTERS
+#endif
 
 #define LSON_REGION_MIN_SIZE 1024
 
+#ifndef IMJ_BLOCK_SIZE
+#define IMJ_BLOCK_SIZE (1 << 20)
+#endif
+
+// IMJ_VALIDATE_MAX_DEPTH is the name it had when only imj_validate used it
+#if !defined(IMJ_MAX_DEPTH) && defined(IMJ_VALIDATE_MAX_DEPTH)
+#define IMJ_MAX_DEPTH IMJ_VALIDATE_MAX_DEPTH
+#endif
+
+#ifndef IMJ_MAX_DEPTH
+#define IMJ_MAX_DEPTH 1024
+#endif
+
+#ifndef IMJ_DOC_CACHE_BUDGET
+#define IMJ_DOC_CACHE_BUDGET (64 << 20)
+#endif
+
+#ifndef IMJ_SHAPES_MAX_NODES
+#define IMJ_SHAPES_MAX_NODES 4096
+#endif
+
+#ifndef IMJ_PROFILE_MAX_EVENTS
+#define IMJ_PROFILE_MAX_EVENTS (1 << 16)
+#endif
+
+// builds that only read or only write make the mode a constant, every call goes straight to its reader or writer
+#if defined(IMJ_READ_ONLY) && defined(IMJ_WRITE_ONLY)
+#error "IMJ_READ_ONLY and IMJ_WRITE_ONLY cannot both be defined"
+#elif defined(IMJ_READ_ONLY)
+#define __imj_io_mode(imj) IMJ_READ
+#elif defined(IMJ_WRITE_ONLY)
+#define __imj_io_mode(imj) IMJ_WRITE
+#else
+#define __imj_io_mode(imj) ((imj)->io_mode)
+#endif
+
+struct imj_region_t {
+    imj_region_t *prev;
+    size_t capacity;
+    size_t count;
+    char data[];
+};
+
 static const imj_val_t __imj_val_error = {
     .kind = IMJ_NONE,
 };
 
 static void *__imj_arena_alloc(imj_arena_t *arena, size_t size) {
+    // rounding up, or adding the region header, would wrap around to a tiny allocation
+    if (size > SIZE_MAX/2) return NULL;
     size = ((size+sizeof(uintptr_t)-1)/sizeof(uintptr_t)) * sizeof(uintptr_t);
 
     imj_region_t *region = arena->region_back;
+
+    if (arena->fixed) {
+        size_t used = (region ? region->count : 0) + size;
+        if (used > arena->required) arena->required = used;
+        if (!region || used > region->capacity) return NULL;
+    }
+
     if (region && (region->count + size) > region->capacity) {
         region = NULL;
     } 
@@ -196,6 +642,7 @@ static void *__imj_arena_alloc(imj_arena_t *arena, size_t size) {
     if (region == NULL) {
         size_t s = size > LSON_REGION_MIN_SIZE ? size : LSON_REGION_MIN_SIZE;
         region = malloc(sizeof(imj_region_t) + s);
+        if (region == NULL) return NULL;
         region->prev = arena->region_back;
         region->capacity = s;
         region->count = 0;
@@ -208,9 +655,16 @@ static void *__imj_arena_alloc(imj_arena_t *arena, size_t size) {
     return memory;
 }
 
+// gives back the last allocation
+static void __imj_arena_pop(imj_arena_t *arena, size_t size) {
+    size = ((size+sizeof(uintptr_t)-1)/sizeof(uintptr_t)) * sizeof(uintptr_t);
+    if (arena->region_back && arena->region_back->count >= size) arena->region_back->count -= size;
+}
+
 static void *__imj_arena_realloc(imj_arena_t *a, void *oldptr, size_t oldsz, size_t newsz) {
     if (newsz <= oldsz) return oldptr;
     void *newptr = __imj_arena_alloc(a, newsz);
+    if (newptr == NULL) return NULL;
     char *newptr_char = (char*)newptr;
     char *oldptr_char = (char*)oldptr;
     for (size_t i = 0; i < oldsz; ++i) {
@@ -220,17 +674,22 @@ static void *__imj_arena_realloc(imj_arena_t *a, void *oldptr, size_t oldsz, siz
 }
 
 
+// the item is dropped when a fixed arena is full
 #define __imj_da_push(arr, item, arena) do { \
     if ((arr)->count >= (arr)->capacity) { \
         size_t new_cap = (arr)->capacity == 0 ? 8 : (arr)->capacity*2; \
         while (new_cap < (arr)->capacity) new_cap *= 2; \
-        (arr)->items = __imj_arena_realloc(arena, (arr)->items, sizeof(*(arr)->items)*(arr)->capacity, sizeof(*(arr)->items)*new_cap); \
+        void *new_items = __imj_arena_realloc(arena, (arr)->items, sizeof(*(arr)->items)*(arr)->capacity, sizeof(*(arr)->items)*new_cap); \
+        if (new_items == NULL) break; \
+        (arr)->items = new_items; \
         (arr)->capacity = new_cap; \
     } \
     (arr)->items[(arr)->count++] = (item); \
 } while (false);
 
 static void __imj_arena_free(imj_arena_t *arena) {
+    if (arena->fixed) return;
+
     while (arena->region_back) {
         imj_region_t *r = arena->region_back->prev;
         free(arena->region_back);
@@ -238,6 +697,10 @@ static void __imj_arena_free(imj_arena_t *arena) {
     }
 }
 
+static imj_shapes_t *__imj_shapes(imj_t *imj) {
+    return imj->shapes ? imj->shapes : &imj->local_shapes;
+}
+
 imj_sv_t imj_cstr2sv(const char *cstr) {
     return (imj_sv_t) {
         .data = cstr,
@@ -246,8 +709,33 @@ imj_sv_t imj_cstr2sv(const char *cstr) {
 }
 
 static void __imjr_skip_whitespace(imj_t *imj);
+static void __imjw_sb_add_str(imj_sb_t *sb, const char *s, size_t n, imj_arena_t *arena);
+static bool __imjw_sb_reserve(imj_sb_t *sb, size_t n, imj_arena_t *arena);
+
+static bool __imjp_begin_agg(imj_t *imj, imj_val_kind_t kind);
+static void __imjp_end_agg(imj_t *imj, imj_val_kind_t kind);
+static void __imjp_close(imj_t *imj, const char *unvisited_or_null);
+static bool __imjp_keyn(imj_t *imj, const char *key, size_t key_length);
+static void __imjp_valnull(imj_t *imj);
+static void __imjp_valb(imj_t *imj, bool *value, bool default_);
+static void __imjp_vali(imj_t *imj, int *value, int default_);
+static void __imjp_vals(imj_t *imj, size_t *value, size_t default_);
+static void __imjp_valint(imj_t *imj, int64_t value, int64_t min, int64_t max);
+static void __imjp_valuint(imj_t *imj, uint64_t value, uint64_t max);
+static void __imjp_valf(imj_t *imj, float *value, float default_);
+static void __imjp_vald(imj_t *imj, double *value, double default_);
+static void __imjp_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_);
+static void __imjp_valcstr(imj_t *imj, const char **value, const char *default_);
+static void __imjp_valbytes(imj_t *imj, const void *data, size_t n);
+static void __imjp_update(imj_t *imj);
+
+#define __IMJ_CBOR_SELF_DESCRIBE "\xd9\xd9\xf7"
+
+static void __imjr_init(const char *filepath, const char *str, size_t n, imj_encoding_t encoding, imj_t *ret) {
+#ifdef IMJ_WRITE_ONLY
+    __imj_assert(false, "cannot read in a IMJ_WRITE_ONLY build");
+#endif
 
-static void __imjr_init(const char *filepath, const char *str, size_t n, imj_t *ret) {
     ret->filepath = filepath;
     ret->src.data = str;
     ret->src.length = n;
@@ -255,790 +743,3550 @@ static void __imjr_init(const char *filepath, const char *str, size_t n, imj_t *
     ret->log_errors = true;
     ret->io_mode = IMJ_READ;
 
+    if (n >= 3 && memcmp(str, __IMJ_CBOR_SELF_DESCRIBE, 3) == 0) {
+        encoding = IMJ_ENCODING_CBOR;
+        ret->current += 3;
+    }
+
+    ret->encoding = encoding;
+
+    if (encoding == IMJ_ENCODING_CBOR) {
+        ret->value_pending = ret->current < ret->src.data + ret->src.length;
+        return;
+    }
+
     __imjr_skip_whitespace(ret);
-    if (*ret->current != '\0') {
+    if (ret->current < ret->src.data + ret->src.length) {
         ret->value_pending = true;
     }
 }
 
-static void __imjw_init(const char *filepath, imj_t *ret) {
+static void __imjw_init(const char *filepath, imj_encoding_t encoding, imj_t *ret) {
+#ifdef IMJ_READ_ONLY
+    __imj_assert(false, "cannot write in a IMJ_READ_ONLY build");
+#endif
+
     ret->filepath = filepath;
     ret->io_mode = IMJ_WRITE;
+    ret->encoding = encoding;
     ret->indent_size = 2;
-}
-
-bool imj_file(const char *filepath, imj_t *imj, imj_io_mode_t mode) {
-    *imj = (imj_t){0};
-
-    switch (mode) {
-    case IMJ_READ: {
-        FILE *file = fopen(filepath, "r");
-        
-        if (!file) return false;
-        
-        fseek(file, 0, SEEK_END);
-        long size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        
-        char *buffer = __imj_arena_alloc(&imj->arena, size + 1);
-        if (!buffer) {
-            fclose(file);
-            return false;
-        }
-        
-        fread(buffer, 1, size, file);
-        buffer[size] = '\0';
-        fclose(file);
-
-        __imjr_init(filepath, buffer, size, imj);
-        break;
-    }
 
-    case IMJ_WRITE: {
-        __imjw_init(filepath, imj);
-        break;
-    }
+    if (encoding == IMJ_ENCODING_CBOR) {
+        __imjw_sb_add_str(&ret->sb, __IMJ_CBOR_SELF_DESCRIBE, 3, &ret->arena);
     }
+}
 
+#define __IMJ_CODEC_MAGIC "IMJZ"
+#define __IMJ_CODEC_HEADER_SIZE 16
+#define __IMJ_LZ_HASH_BITS 16
+#define __IMJ_LZ_MIN_MATCH 4
 
-    return true;
+static void __imj_put_le(uint8_t *p, uint64_t value, size_t n) {
+    for (size_t i = 0; i < n; ++i) p[i] = (uint8_t)(value >> (i*8));
 }
 
-void imjr_cstrn(const char *cstr, size_t n, imj_t *imj) {
-    *imj = (imj_t){0};
-    __imjr_init("", cstr, n, imj);
+static uint64_t __imj_get_le(const uint8_t *p, size_t n) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; ++i) value |= (uint64_t)p[i] << (i*8);
+    return value;
 }
 
-void imjw_init(imj_t *imj) {
-    *imj = (imj_t){0};
-    __imjw_init("", imj);
+static uint32_t __imj_lz_read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
 }
 
-bool imjw_flush(imj_t *imj) {
-    __imj_assert(imj->filepath[0] != '\0', "cannot flush without a filepath");
-
-    switch (imj->io_mode) {
-    case IMJ_READ: __imj_assert(false, "cannot flush in read mode"); return false;
-    case IMJ_WRITE: {
-        __imj_assert(imj->done, "must be finished to flush");
-
-        FILE *file = fopen(imj->filepath, "w");
-        
-        if (!file) {
-            printf("cannot open file %s\n", imj->filepath);
-            return false;
-        }
-
-        fwrite(imj->sb.items, 1, imj->sb.count, file);
-        fclose(file);
-        return true;
-    }
+static uint8_t *__imj_lz_put_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
     }
+    *op++ = (uint8_t)length;
+    return op;
 }
 
-void imj_free(imj_t *lson) {
-    __imj_arena_free(&lson->arena);
-}
+static uint8_t *__imj_lz_put_sequence(uint8_t *op, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_length) {
+    size_t match_code = match_length >= __IMJ_LZ_MIN_MATCH ? match_length - __IMJ_LZ_MIN_MATCH : 0;
 
-enum imj_log_lvl_t {
-    IMJ_LOG_INFO = 0,
-    IMJ_LOG_ERROR,
-};
-typedef enum imj_log_lvl_t imj_log_lvl_t;
+    uint8_t *token = op++;
+    *token = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (literal_count >= 15) op = __imj_lz_put_length(op, literal_count - 15);
 
-static void __imj_log(imj_log_lvl_t lvl, const char *format, ...) {
-    switch (lvl) {
-    case IMJ_LOG_ERROR: printf("ERROR: "); break;
-    case IMJ_LOG_INFO: printf("INFO: "); break;
-    }
+    memcpy(op, literals, literal_count);
+    op += literal_count;
 
-    va_list args;
-    va_start(args, format);
-    vprintf(format, args);
-    va_end(args);
-    printf("\n");
+    if (match_length == 0) return op;
+
+    __imj_put_le(op, offset, 2);
+    op += 2;
+    if (match_code >= 15) op = __imj_lz_put_length(op, match_code - 15);
+    return op;
 }
-bool imj_sv_cstr_eq(imj_sv_t sv, const char *cstr) {
-    if (cstr == NULL) return false;
 
-    size_t i = 0;
-    char c = cstr[0];
-    while (i < sv.length && c != '\0') {
-        if (sv.data[i] != c) return false;
-        ++i;
-        c = cstr[i];
+static size_t __imj_lz_bound(size_t n) {
+    return n + n/255 + 16;
+}
 
-    }
+// lz4 style sequences of literals and back references into the last 64k, 'table' has 1 << __IMJ_LZ_HASH_BITS entries
+static size_t __imj_lz_compress(const uint8_t *src, size_t n, uint8_t *dst, uint32_t *table) {
+    memset(table, 0, sizeof(uint32_t) << __IMJ_LZ_HASH_BITS);
 
-    return i == sv.length && c == '\0';
-}
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
 
-bool imj_rawsv_to_cstrn(imj_sv_t sv, char *buffer, size_t n) {
-    size_t count = 0;
+    while (n >= __IMJ_LZ_MIN_MATCH && ip <= n - __IMJ_LZ_MIN_MATCH) {
+        uint32_t sequence = __imj_lz_read32(src + ip);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - __IMJ_LZ_HASH_BITS);
+        size_t ref = table[hash];
+        table[hash] = (uint32_t)ip + 1;
 
-    for (size_t i = 0; i < sv.length; ++i) {
-        switch (sv.data[i]) {
-        case '\\':  {
-            ++i;
-            switch (sv.data[i]) {
-            case '"': buffer[count] = '"'; break;
-            case '\\': buffer[count] = '\\'; break;
-            case '/': buffer[count] = '/'; break;
-            case 'b': buffer[count] = '\b'; break;
-            case 'f': buffer[count] = '\f'; break;
-            case 'n': buffer[count] = '\n'; break;
-            case 'r': buffer[count] = '\r'; break;
-            case 't': buffer[count] = '\t'; break;
-            case 'u': {
-                __imj_log(IMJ_LOG_ERROR, "unicode codepoints are not supported yet");
-                return false;
-            }
-            default: return false;
-            }
-            break;
-        }
-        default: {
-            buffer[count] = sv.data[i];
-            break;
-        }
+        if (ref == 0 || ip + 1 - ref > 0xffff || __imj_lz_read32(src + ref - 1) != sequence) {
+            // skip faster through data that doesn't compress
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
         }
 
-        ++count;
-        if (count >= n) break;
+        --ref;
+        size_t length = __IMJ_LZ_MIN_MATCH;
+        while (ip + length < n && src[ref + length] == src[ip + length]) ++length;
+
+        op = __imj_lz_put_sequence(op, src + anchor, ip - anchor, ip - ref, length);
+        ip += length;
+        anchor = ip;
     }
 
+    op = __imj_lz_put_sequence(op, src + anchor, n - anchor, 0, 0);
+    return op - dst;
+}
+
+static bool __imj_lz_get_length(const uint8_t *src, size_t n, size_t *ip, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= n) return false;
+        byte = src[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
     return true;
 }
 
-static char __imjr_next(imj_t *imj) {
-    if (*imj->current == '\0') return '\0';
+static bool __imj_lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t raw_size) {
+    size_t ip = 0;
+    size_t op = 0;
 
-    char c = *imj->current;
-    ++imj->current;
-    return c;
-}
+    while (ip < n) {
+        uint8_t token = src[ip++];
 
-static bool __imjr_consume(imj_t *imj, char c) {
-    char check = __imjr_next(imj);
-    if (check == c) {
-        return true;
-    }
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !__imj_lz_get_length(src, n, &ip, &literal_count)) return false;
+        if (literal_count > n - ip || literal_count > raw_size - op) return false;
 
-    return false;
-}
+        memcpy(dst + op, src + ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
 
-static void __imjr_parse_error(imj_t *imj, const char *message) {
-    if (imj->had_error) return;
-    imj->had_error = true;
+        if (ip == n) break;
+        if (n - ip < 2) return false;
 
-    if (!imj->log_errors) return;
-    
-    size_t line_count = 0;
-    size_t col = 0;
-    for (char *c = (char*)imj->src.data; c < imj->current; ++c) {
-        if (*c == '\n') {
-            ++line_count;
-            col = 0;
-        } else {
-            ++col;
-        }
+        size_t offset = (size_t)__imj_get_le(src + ip, 2);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t length = token & 15;
+        if (length == 15 && !__imj_lz_get_length(src, n, &ip, &length)) return false;
+        length += __IMJ_LZ_MIN_MATCH;
+        if (length > raw_size - op) return false;
+
+        // byte by byte since the reference can overlap what it produces
+        for (size_t i = 0; i < length; ++i, ++op) dst[op] = dst[op - offset];
     }
 
-    __imj_log(IMJ_LOG_ERROR, "%s:%zu:%zu: %s", imj->filepath, line_count+1, col, message);
+    return op == raw_size;
 }
 
-static bool __imjr_is_whitespace(char c) {
-    switch (c) {
-    case ' ': case '\n':
-    case '\r': case '\t': return true;
+static bool __imj_codec_available(imj_codec_t codec) {
+    switch (codec) {
+    case IMJ_CODEC_NONE:
+    case IMJ_CODEC_LZ: return true;
+#ifdef IMJ_USE_ZLIB
+    case IMJ_CODEC_ZLIB: return true;
+#endif
+#ifdef IMJ_USE_ZSTD
+    case IMJ_CODEC_ZSTD: return true;
+#endif
     default: return false;
     }
 }
 
-static void __imjr_skip_whitespace(imj_t *imj) {
-    while (__imjr_is_whitespace(*imj->current)) ++imj->current;
+static size_t __imj_codec_bound(imj_codec_t codec, size_t n) {
+    switch (codec) {
+#ifdef IMJ_USE_ZLIB
+    case IMJ_CODEC_ZLIB: return compressBound((uLong)n);
+#endif
+#ifdef IMJ_USE_ZSTD
+    case IMJ_CODEC_ZSTD: return ZSTD_compressBound(n);
+#endif
+    default: return __imj_lz_bound(n);
+    }
 }
 
-static bool __imjr_match(imj_t *imj, char c) {
-    if (*imj->current == c) {
-        __imjr_next(imj);
-        return true;
+// returns 0 when the block doesn't compress
+static size_t __imj_codec_compress_block(imj_codec_t codec, const uint8_t *src, size_t n, uint8_t *dst, size_t capacity, uint32_t *table) {
+    size_t size = 0;
+    switch (codec) {
+#ifdef IMJ_USE_ZLIB
+    case IMJ_CODEC_ZLIB: {
+        uLongf length = (uLongf)capacity;
+        if (compress2(dst, &length, src, (uLong)n, Z_BEST_SPEED) == Z_OK) size = length;
+        break;
+    }
+#endif
+#ifdef IMJ_USE_ZSTD
+    case IMJ_CODEC_ZSTD: {
+        size_t length = ZSTD_compress(dst, capacity, src, n, 1);
+        if (!ZSTD_isError(length)) size = length;
+        break;
+    }
+#endif
+    default: size = __imj_lz_compress(src, n, dst, table); break;
     }
 
-    return false;
+    (void)capacity;
+    return size < n ? size : 0;
 }
-static void __imj_pop_lvl(imj_t *imj) {
-    imj->lvl_or_null = imj->lvl_or_null->prev;
+
+static bool __imj_codec_decompress_block(imj_codec_t codec, const uint8_t *src, size_t n, uint8_t *dst, size_t raw_size) {
+    switch (codec) {
+#ifdef IMJ_USE_ZLIB
+    case IMJ_CODEC_ZLIB: {
+        uLongf length = (uLongf)raw_size;
+        return uncompress(dst, &length, src, (uLong)n) == Z_OK && length == raw_size;
+    }
+#endif
+#ifdef IMJ_USE_ZSTD
+    case IMJ_CODEC_ZSTD: return ZSTD_decompress(dst, raw_size, src, n) == raw_size;
+#endif
+    default: return __imj_lz_decompress(src, n, dst, raw_size);
+    }
 }
 
-static bool __imjr_read_str(imj_t *imj, imj_sv_t *ret) {
-    char *start = imj->current;
-    char *previous = imj->current++;
-    while (true) {
-        if (*previous == '\"') break;
-        if (*previous == '\0') {
-            __imjr_parse_error(imj, "found end of file before end of string.");
-            return false;
+// header, then blocks of [raw size u32][stored size u32][data], a block stored as is has both sizes equal
+static uint8_t *__imj_compress(imj_codec_t codec, const char *data, size_t n, size_t *out_size) {
+    size_t block_count = (n + IMJ_BLOCK_SIZE - 1)/IMJ_BLOCK_SIZE;
+    size_t capacity = __IMJ_CODEC_HEADER_SIZE + block_count*(8 + __imj_codec_bound(codec, IMJ_BLOCK_SIZE));
+    uint8_t *out = malloc(capacity);
+    uint32_t *table = codec == IMJ_CODEC_LZ ? malloc(sizeof(uint32_t) << __IMJ_LZ_HASH_BITS) : NULL;
+
+    memcpy(out, __IMJ_CODEC_MAGIC, 4);
+    __imj_put_le(out + 4, codec, 4);
+    __imj_put_le(out + 8, n, 8);
+    size_t size = __IMJ_CODEC_HEADER_SIZE;
+
+    for (size_t at = 0; at < n; at += IMJ_BLOCK_SIZE) {
+        size_t raw_size = n - at < IMJ_BLOCK_SIZE ? n - at : IMJ_BLOCK_SIZE;
+        const uint8_t *raw = (const uint8_t*)data + at;
+        uint8_t *block = out + size + 8;
+
+        size_t stored = __imj_codec_compress_block(codec, raw, raw_size, block, capacity - size - 8, table);
+        if (stored == 0) {
+            memcpy(block, raw, raw_size);
+            stored = raw_size;
         }
 
-        if (*previous == '\\') {
-            switch (*imj->current) {
-            case '"': case '\\': case '/':
-            case 'b': case 'f': case 'n':
-            case 'r': case 't': {
-                previous = imj->current++;
-                break;
-            }
+        __imj_put_le(out + size, raw_size, 4);
+        __imj_put_le(out + size + 4, stored, 4);
+        size += 8 + stored;
+    }
 
-            case 'u': {
-                ++imj->current;
+    free(table);
+    *out_size = size;
+    return out;
+}
 
-                for (size_t i = 0; i < 4; ++i) {
-                    switch (*imj->current) {
-                    // digits
-                    case __imj_cases_non_zero: case '0':
+// decompresses block by block from the file into 'imj' arena, the compressed file is never fully in memory
+static char *__imj_decompress_file(FILE *file, const uint8_t header[__IMJ_CODEC_HEADER_SIZE], imj_t *imj, size_t *size) {
+    imj_codec_t codec = (imj_codec_t)__imj_get_le(header + 4, 4);
+    uint64_t total = __imj_get_le(header + 8, 8);
+    if (!__imj_codec_available(codec) || codec == IMJ_CODEC_NONE) return NULL;
 
-                    // characters
-                    case 'a': case 'A': case 'b': case 'B':
-                    case 'c': case 'C': case 'd': case 'D':
-                    case 'e': case 'E': case 'f': case 'F': break;
+    // the header's size is only trusted as far as the blocks left in the file can hold it
+    // each block takes at least its 8 byte sizes and a byte of data, and expands to at most IMJ_BLOCK_SIZE
+    long from = ftell(file);
+    if (from < 0 || fseek(file, 0, SEEK_END) != 0) return NULL;
+    long to = ftell(file);
+    if (to < from || fseek(file, from, SEEK_SET) != 0) return NULL;
 
-                    default: {
-                        __imjr_parse_error(imj, "invalid hex digit.");
-                        return false;
-                    }
-                    }
+    uint64_t blocks = (uint64_t)(to - from)/9;
+    if (blocks > UINT64_MAX/IMJ_BLOCK_SIZE || total > blocks*IMJ_BLOCK_SIZE || total >= SIZE_MAX/2) return NULL;
 
-                    ++imj->current;
-                }
+    char *buffer = __imj_arena_alloc(&imj->arena, (size_t)total + 1);
+    size_t block_capacity = __imj_codec_bound(codec, IMJ_BLOCK_SIZE);
+    uint8_t *block = buffer ? malloc(block_capacity) : NULL;
+    if (block == NULL) return NULL;
 
-                --imj->current;
-                break;
-            }
+    size_t at = 0;
+    bool success = true;
+    while (success && at < total) {
+        uint8_t sizes[8];
+        if (fread(sizes, 1, 8, file) != 8) {
+            success = false;
+            break;
+        }
 
-            default: {
-                __imjr_parse_error(imj, "invalid escape sequence.");
-                return false;
-            }
-            }
+        size_t raw_size = (size_t)__imj_get_le(sizes, 4);
+        size_t stored = (size_t)__imj_get_le(sizes + 4, 4);
+        if (raw_size == 0 || raw_size > IMJ_BLOCK_SIZE || raw_size > total - at || stored > block_capacity || fread(block, 1, stored, file) != stored) {
+            success = false;
+            break;
+        }
 
+        if (stored == raw_size) {
+            memcpy(buffer + at, block, raw_size);
+        } else {
+            success = __imj_codec_decompress_block(codec, block, stored, (uint8_t*)buffer + at, raw_size);
         }
 
-        previous = imj->current++;
+        at += raw_size;
     }
 
-    *ret = (imj_sv_t){
-        .data = start,
-        .length = previous-start,
-    };
+    free(block);
+    if (!success) return NULL;
 
-    return true;
+    buffer[total] = '\0';
+    imj->codec = codec;
+    *size = (size_t)total;
+    return buffer;
 }
 
-static void __imjr_skip_value(imj_t *imj);
+bool imj_file(const char *filepath, imj_t *imj, imj_io_mode_t mode) {
+    return imj_file_ex(filepath, imj, mode, IMJ_ENCODING_JSON);
+}
 
-static void __imjr_skip_str(imj_t *imj) {
-    char *previous = imj->current++;
-    while (*previous != '\"') {
-        if (*previous == '\0') {
-            __imjr_parse_error(imj, "source ended before string closed");
-            return;
-        }
+bool imj_file_ex(const char *filepath, imj_t *imj, imj_io_mode_t mode, imj_encoding_t encoding) {
+    *imj = (imj_t){0};
 
-        if (*previous == '\\' && *imj->current == '\"') {
-            ++imj->current;
-        }
+    switch (mode) {
+    case IMJ_PATCH:
+    case IMJ_READ: {
+        FILE *file = fopen(filepath, "rb");
+        
+        if (!file) return false;
 
-        previous = imj->current++;
-    }
-}
+        char *buffer = NULL;
+        size_t size = 0;
 
-static void __imjr_skip_obj(imj_t *imj) {
-    while (true) {
-        __imjr_skip_whitespace(imj);
-        if (__imjr_match(imj, '}')) return;
-        if (*imj->current == '\0') {
-            __imjr_parse_error(imj, "expected '}' before end of file");
-            return;
-        }
+        uint8_t header[__IMJ_CODEC_HEADER_SIZE];
+        if (fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, __IMJ_CODEC_MAGIC, 4) == 0) {
+            buffer = __imj_decompress_file(file, header, imj, &size);
+            fclose(file);
 
-        if (*imj->current == '\"') {
-            ++imj->current;
-            __imjr_skip_str(imj);
+            if (!buffer) {
+                imj_free(imj);
+                return false;
+            }
         } else {
-            __imjr_parse_error(imj, "expected key");
-            return;
-        }
-        
-        __imjr_skip_whitespace(imj);
-        if (!__imjr_consume(imj, ':')) {
-            __imjr_parse_error(imj, "expected ':' after key");
-            return;
+            fseek(file, 0, SEEK_END);
+            size = ftell(file);
+            fseek(file, 0, SEEK_SET);
+
+            buffer = __imj_arena_alloc(&imj->arena, size + 1);
+            if (!buffer) {
+                fclose(file);
+                return false;
+            }
+
+            fread(buffer, 1, size, file);
+            buffer[size] = '\0';
+            fclose(file);
         }
 
-        __imjr_skip_whitespace(imj);
-        __imjr_skip_value(imj);
-        __imjr_skip_whitespace(imj);
+        imj_codec_t codec = imj->codec;
+        __imjr_init(filepath, buffer, size, encoding, imj);
 
-        if (__imjr_match(imj, ',')) {
-            __imjr_skip_whitespace(imj);
-            if (*imj->current == '}') {
-                __imjr_parse_error(imj, "cannot have ',' before ending an object");
-                return;
+        // patching writes it back the way it was read
+        imj->codec = codec;
+
+        if (mode == IMJ_PATCH) {
+            if (imj->encoding != IMJ_ENCODING_JSON) {
+                imj_free(imj);
+                return false;
             }
+
+            imj->io_mode = IMJ_PATCH;
+            __imj_assert(__imj_io_mode(imj) == IMJ_PATCH, "cannot patch in a IMJ_READ_ONLY build");
         }
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_init(filepath, encoding, imj);
+        break;
+    }
     }
+
+
+    return true;
 }
 
-static void __imjr_skip_arr(imj_t *imj) {
-    while (true) {
-        __imjr_skip_whitespace(imj);
-        if (__imjr_match(imj, ']')) return;
+void imjr_cstrn(const char *cstr, size_t n, imj_t *imj) {
+    *imj = (imj_t){0};
+    __imjr_init("", cstr, n, IMJ_ENCODING_JSON, imj);
+}
 
-        if (*imj->current == '\0') {
-            __imjr_parse_error(imj, "expected ']' before end of file");
-            return;
-        }
+void imjp_cstrn(const char *cstr, size_t n, imj_t *imj) {
+    *imj = (imj_t){0};
+    __imjr_init("", cstr, n, IMJ_ENCODING_JSON, imj);
+    __imj_assert(imj->encoding == IMJ_ENCODING_JSON, "only json text can be patched");
+    imj->io_mode = IMJ_PATCH;
+    __imj_assert(__imj_io_mode(imj) == IMJ_PATCH, "cannot patch in a IMJ_READ_ONLY build");
+}
 
-        __imjr_skip_value(imj);
+static void __imj_arena_init_fixed(imj_arena_t *arena, void *scratch, size_t scratch_size) {
+    *arena = (imj_arena_t){ .fixed = true };
 
-        __imjr_skip_whitespace(imj);
+    uintptr_t start = ((uintptr_t)scratch + sizeof(uintptr_t) - 1) & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+    size_t header = start - (uintptr_t)scratch + sizeof(imj_region_t);
+    if (scratch == NULL || scratch_size < header) return;
 
-        if (__imjr_match(imj, ',')) {
-            __imjr_skip_whitespace(imj);
-            if (*imj->current == ']') {
-                __imjr_parse_error(imj, "cannot have ',' before ending an array");
-                return;
-            }
-        }
-    }
+    arena->region_back = (imj_region_t*)start;
+    *arena->region_back = (imj_region_t){
+        .capacity = scratch_size - header,
+    };
 }
 
-static void __imjr_skip_until_whitespace_or_comma(imj_t *imj) {
-    while (true) {
-        switch (*imj->current) {
-        case '\0': case ',': case ']': case '}': return;
-        default: break;
-        }
+void imjr_cstrn_fixed(const char *cstr, size_t n, imj_t *imj, void *scratch, size_t scratch_size) {
+    imjr_cstrn(cstr, n, imj);
+    __imj_arena_init_fixed(&imj->arena, scratch, scratch_size);
+}
 
-        if (__imjr_is_whitespace(*imj->current)) return;
-        ++imj->current;
-    }
+void imjw_init_fixed(imj_t *imj, imj_encoding_t encoding, void *scratch, size_t scratch_size, char *out, size_t out_size) {
+    *imj = (imj_t){0};
+    __imj_arena_init_fixed(&imj->arena, scratch, scratch_size);
+    imj->sb = (imj_sb_t){ .items = out, .capacity = out_size, .fixed = true };
+    __imjw_init("", encoding, imj);
 }
 
-static void __imjr_skip_value(imj_t *imj) {
-    switch (*imj->current) {
-    case '"': {
-        ++imj->current;
-        __imjr_skip_str(imj);
-        break;
-    }
+bool imj_required(imj_t *imj, size_t *scratch_size, size_t *out_size) {
+    size_t capacity = imj->arena.region_back ? imj->arena.region_back->capacity : 0;
+    bool scratch_overflowed = imj->arena.fixed && imj->arena.required > capacity;
+    bool out_overflowed = imj->sb.fixed && imj->sb.count > imj->sb.capacity;
 
-    case '{': {
-        ++imj->current;
-        __imjr_skip_obj(imj);
-        break;
-    }
+    // room for the region header and aligning the start of the scratch
+    if (scratch_size) *scratch_size = imj->arena.required + sizeof(imj_region_t) + sizeof(uintptr_t) - 1;
+    if (out_size) *out_size = imj->sb.count;
 
-    case '[': {
-        ++imj->current;
-        __imjr_skip_arr(imj);
-        break;
-    }
+    return scratch_overflowed || out_overflowed;
+}
 
-    default: __imjr_skip_until_whitespace_or_comma(imj); break;
-    }
+void imjw_sink(imj_t *imj, imj_sink_fn sink, void *user, size_t buffer_size) {
+    // cbor patches lengths in behind it and patching renders into the buffer out of order
+    __imj_assert(imj->io_mode == IMJ_WRITE && imj->encoding == IMJ_ENCODING_JSON, "only json writers can stream to a sink");
+    __imj_assert(imj->sb.count == 0, "the sink must be set before writing");
+
+    if (!imj->sb.fixed) __imjw_sb_reserve(&imj->sb, buffer_size, &imj->arena);
+    imj->sb.sink = sink;
+    imj->sb.sink_user = user;
 }
 
-static void __imj_dive_into_arr(imj_t *imj, bool use_left_off) {
-    imj_lvl_t *arr = __imj_arena_alloc(&imj->arena, sizeof(imj_lvl_t));
-    *arr = (imj_lvl_t){0};
-    arr->type = IMJ_ARRAY;
-    arr->prev = imj->lvl_or_null;
-    arr->left_off_or_null = use_left_off ? imj->current : NULL;
-    imj->lvl_or_null = arr;
-    ++imj->indent_lvl;
+void imjw_sink_flush(imj_t *imj) {
+    __imj_assert(imj->sb.sink != NULL, "no sink to flush to");
+
+    size_t n = imj->sb.count < imj->sb.capacity ? imj->sb.count : imj->sb.capacity;
+    if (n > 0) imj->sb.sink(imj->sb.sink_user, imj->sb.items, n);
+    imj->sb.count = 0;
 }
 
-static void __imjr_update_array_if_necessary(imj_t *imj) {
-    if (imj->lvl_or_null && imj->lvl_or_null->type == IMJ_ARRAY) {
-        ++imj->lvl_or_null->count;
+void imjw_init(imj_t *imj) {
+    imjw_init_ex(imj, IMJ_ENCODING_JSON);
+}
 
-        __imjr_skip_whitespace(imj);
-        if (__imjr_match(imj, ',')) {
-            imj->value_pending = true;
-            __imjr_skip_whitespace(imj);
-        } else {
-            imj->value_pending = false;
-        }
+void imjw_init_ex(imj_t *imj, imj_encoding_t encoding) {
+    *imj = (imj_t){0};
+    __imjw_init("", encoding, imj);
+}
+
+#ifdef _WIN32
+static bool __imj_write_handle_synced(HANDLE file, const char *data, size_t n) {
+    bool success = true;
+    while (success && n > 0) {
+        DWORD chunk = n > 0x40000000 ? 0x40000000 : (DWORD)n;
+        DWORD written = 0;
+        success = WriteFile(file, data, chunk, &written, NULL);
+        data += written;
+        n -= written;
     }
+
+    success = success && FlushFileBuffers(file);
+    return CloseHandle(file) && success;
 }
 
-static void __imjw_update_aggregate_count_if_necessary(imj_t *imj) {
-    if (imj->lvl_or_null && (imj->lvl_or_null->type == IMJ_ARRAY || imj->lvl_or_null->type == IMJ_OBJECT)) {
-        ++imj->lvl_or_null->count;
+static bool __imj_write_file_synced(const char *path, const char *data, size_t n, bool append) {
+    HANDLE file = append
+        ? CreateFileA(path, FILE_APPEND_DATA, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)
+        : CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    return __imj_write_handle_synced(file, data, n);
+}
+
+// fails with 'taken' set when 'path' already exists, the file's permissions come from the directory it's in
+static bool __imj_write_new_file_synced(const char *path, const char *like, const char *data, size_t n, bool *taken) {
+    (void)like;
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        *taken = GetLastError() == ERROR_FILE_EXISTS;
+        return false;
     }
+    return __imj_write_handle_synced(file, data, n);
 }
 
-static bool __imjr_begin_arr(imj_t *imj) {
-    if (imj->had_error) return false;
+static unsigned long __imj_temp_id(void) {
+    static LONG counter = 0;
+    return (unsigned long)InterlockedIncrement(&counter);
+}
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(!imj->lvl_or_null || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot begin array directly inside object");
+static unsigned long __imj_process_id(void) {
+    return (unsigned long)GetCurrentProcessId();
+}
 
-    __imjr_skip_whitespace(imj);
+static bool __imj_replace_file(const char *from, const char *to) {
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+#else
+static bool __imj_write_fd_synced(int fd, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(fd, data, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return false;
+        }
 
-    imj->value_pending = true;
-    bool entered = false;
-    if (!__imjr_match(imj, '[')) {
-        imj->value_pending = false;
-    } else {
-        __imjr_skip_whitespace(imj);
-        imj->value_pending = *imj->current != ']';
-        entered = true;
+        data += written;
+        n -= (size_t)written;
     }
 
-    __imj_dive_into_arr(imj, entered);
-
-    return entered;
+    bool synced = fsync(fd) == 0;
+    return close(fd) == 0 && synced;
 }
 
-static void __imjw_sb_add_str(imj_sb_t *sb, const char *s, size_t n, imj_arena_t *arena) {
-    for (size_t i = 0; i < n; ++i) __imj_da_push(sb, s[i], arena);
+static bool __imj_write_file_synced(const char *path, const char *data, size_t n, bool append) {
+    int fd = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0) return false;
+    return __imj_write_fd_synced(fd, data, n);
 }
 
-static void __imjw_sb_add_str_as_jsonstr(imj_sb_t *sb, const char *s, size_t n, imj_arena_t *arena) {
-    __imj_da_push(sb, '"', arena);
-    for (char *c = (char*)s; c < s+n; ++c) {
-        if ((unsigned char)*c > 127) {
-            __imj_assert(false, "unicode is not supported yet");
-            return;
-        }
+// fails with 'taken' set when 'path' already exists, otherwise it's created with the permissions 'like' has
+static bool __imj_write_new_file_synced(const char *path, const char *like, const char *data, size_t n, bool *taken) {
+    struct stat st;
+    bool keep = stat(like, &st) == 0;
+    mode_t mode = keep ? st.st_mode & 07777 : 0666;
 
-        switch (*c) {
-        case '"': { 
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, '"', arena);
-            break;
-        }
-        case '\\': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, '\\', arena);
-            break;
-        }
-        case '/': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, '/', arena);
-            break;
-        }
-        case '\b': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, 'b', arena);
-            break;
-        }
-        
-        case '\f': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, 'f', arena);
-            break;
-        }
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, mode);
+    if (fd < 0) {
+        *taken = errno == EEXIST;
+        return false;
+    }
 
-        case '\n': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, 'n', arena);
-            break;
-        }
+    // the umask only applies to new files, not to ones taking the place of an existing one
+    if (keep && chmod(path, mode) != 0) {
+        close(fd);
+        return false;
+    }
 
-        case '\r': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, 'n', arena);
-            break;
-        }
+    return __imj_write_fd_synced(fd, data, n);
+}
 
-        case '\t': {
-            __imj_da_push(sb, '\\', arena);
-            __imj_da_push(sb, 't', arena);
-            break;
-        }
+static unsigned long __imj_temp_id(void) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static unsigned long counter = 0;
+    pthread_mutex_lock(&lock);
+    unsigned long id = ++counter;
+    pthread_mutex_unlock(&lock);
+    return id;
+}
 
-        case '\v': case '\a': {
-            __imj_assert(false, "unsupported escape sequences");
-            break;
-        }
+static unsigned long __imj_process_id(void) {
+    return (unsigned long)getpid();
+}
 
-        default: {
-            __imj_da_push(sb, *c, arena);
-            break;
-        }
-        }
+static bool __imj_replace_file(const char *from, const char *to) {
+    if (rename(from, to) != 0) return false;
+
+    // the rename only survives a crash once the directory entry is synced too
+    const char *slash = strrchr(to, '/');
+    size_t length = slash ? (size_t)(slash - to) : 1;
+    char *dir = malloc(length + 1);
+    memcpy(dir, slash ? to : ".", length);
+    dir[length] = '\0';
+
+    int fd = open(length > 0 ? dir : "/", O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
     }
 
-    __imj_da_push(sb, '"', arena);
+    free(dir);
+    return true;
 }
+#endif
 
-static void __imjw_sb_add_indent(imj_t *imj) {
-    for (size_t i = 0; i < imj->indent_lvl; ++i) {
-        for (size_t i = 0; i < imj->indent_size; ++i) {
-            __imj_da_push(&imj->sb, ' ', &imj->arena);
-        }
+// the file is either the old contents or the new ones, never something in between
+static bool __imj_write_atomic(const char *filepath, const char *data, size_t n, imj_codec_t codec) {
+    uint8_t *compressed = NULL;
+    if (codec != IMJ_CODEC_NONE) {
+        compressed = __imj_compress(codec, data, n, &n);
+        data = (const char*)compressed;
+    }
+
+    // every flush gets its own temporary file so overlapping ones, from threads or processes, can't write into each other
+    size_t length = strlen(filepath) + 48;
+    char *tmp = malloc(length);
+    bool success = false, taken = true;
+    for (size_t attempt = 0; !success && taken && attempt < 16; ++attempt) {
+        taken = false;
+        snprintf(tmp, length, "%s.%lu.%lu.tmp", filepath, __imj_process_id(), __imj_temp_id());
+        success = __imj_write_new_file_synced(tmp, filepath, data, n, &taken);
+        if (!success && !taken) remove(tmp);
     }
+
+    if (success && !__imj_replace_file(tmp, filepath)) {
+        remove(tmp);
+        success = false;
+    }
+
+    free(tmp);
+    free(compressed);
+    return success;
 }
 
-static void __imjw_add_comma_and_ws_if_necessary(imj_t *imj) {
-    if (imj->lvl_or_null) {
-        switch (imj->lvl_or_null->type) {
-        case IMJ_KEY_VALUE: break;
-        case IMJ_ARRAY:
-        case IMJ_OBJECT: {
-            if (imj->lvl_or_null->count == 0) {
-                switch (imj->render_style) {
-                case IMJ_STYLE_MIN: break;
-                case IMJ_STYLE_SINGLE_LINE: {
-                    __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
-                    break;
-                }
-                case IMJ_STYLE_PRETTY: {
-                    __imjw_sb_add_str(&imj->sb, "\n", 1, &imj->arena);
-                    __imjw_sb_add_indent(imj);
-                    break;
-                }
-                }
-            } else {
-                switch (imj->render_style)  {
-                case IMJ_STYLE_MIN: {
-                    __imjw_sb_add_str(&imj->sb, ",", 1, &imj->arena);
-                    break;
-                }
-                case IMJ_STYLE_SINGLE_LINE: {
-                    __imjw_sb_add_str(&imj->sb, ", ", 2, &imj->arena);
-                    break;
-                }
-                case IMJ_STYLE_PRETTY: {
-                    __imjw_sb_add_str(&imj->sb, ",\n", 2, &imj->arena);
-                    __imjw_sb_add_indent(imj);
-                    break;
-                }
-                }
-            }
+#define __IMJ_XXH_P1 11400714785074694791ull
+#define __IMJ_XXH_P2 14029467366897019727ull
+#define __IMJ_XXH_P3 1609587929392839161ull
+#define __IMJ_XXH_P4 9650029242287828579ull
+#define __IMJ_XXH_P5 2870177450012600261ull
 
-            ++imj->lvl_or_null->count;
-            break;
-        }
-        default: __imj_assert(false, "invalid lvl type for writing"); break;
-        }
-    }
+static uint64_t __imj_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
 }
 
-static void __imjw_begin_arr(imj_t *imj) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+static uint64_t __imj_xxh64_read(const uint8_t *p) {
+#ifdef __IMJ_LITTLE_ENDIAN
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+#else
+    return __imj_get_le(p, 8);
+#endif
+}
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+static uint64_t __imj_xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input*__IMJ_XXH_P2;
+    return __imj_rotl64(acc, 31)*__IMJ_XXH_P1;
+}
 
-    __imjw_update_aggregate_count_if_necessary(imj);
+static uint64_t __imj_xxh64_merge(uint64_t hash, uint64_t acc) {
+    hash ^= __imj_xxh64_round(0, acc);
+    return hash*__IMJ_XXH_P1 + __IMJ_XXH_P4;
+}
 
-    __imj_dive_into_arr(imj, false);
+// xxh64, four independent lanes over 32 byte stripes so it runs at memory speed
+static uint64_t __imj_xxh64(const void *data, size_t n, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + n;
+    uint64_t hash;
+
+    if (n >= 32) {
+        uint64_t v1 = seed + __IMJ_XXH_P1 + __IMJ_XXH_P2;
+        uint64_t v2 = seed + __IMJ_XXH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - __IMJ_XXH_P1;
+
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = __imj_xxh64_round(v1, __imj_xxh64_read(p));
+            v2 = __imj_xxh64_round(v2, __imj_xxh64_read(p + 8));
+            v3 = __imj_xxh64_round(v3, __imj_xxh64_read(p + 16));
+            v4 = __imj_xxh64_round(v4, __imj_xxh64_read(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = __imj_rotl64(v1, 1) + __imj_rotl64(v2, 7) + __imj_rotl64(v3, 12) + __imj_rotl64(v4, 18);
+        hash = __imj_xxh64_merge(hash, v1);
+        hash = __imj_xxh64_merge(hash, v2);
+        hash = __imj_xxh64_merge(hash, v3);
+        hash = __imj_xxh64_merge(hash, v4);
+    } else {
+        hash = seed + __IMJ_XXH_P5;
+    }
 
-    __imjw_sb_add_str(&imj->sb, "[", 1, &imj->arena);
-}
+    hash += (uint64_t)n;
 
-bool imj_begin_arr(imj_t *imj) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_begin_arr(imj);
-        break;
+    for (; end - p >= 8; p += 8) {
+        hash ^= __imj_xxh64_round(0, __imj_xxh64_read(p));
+        hash = __imj_rotl64(hash, 27)*__IMJ_XXH_P1 + __IMJ_XXH_P4;
     }
-    case IMJ_WRITE: {
-        __imjw_begin_arr(imj);
-        break;
+
+    if (end - p >= 4) {
+        hash ^= __imj_get_le(p, 4)*__IMJ_XXH_P1;
+        hash = __imj_rotl64(hash, 23)*__IMJ_XXH_P2 + __IMJ_XXH_P3;
+        p += 4;
     }
+
+    for (; p < end; ++p) {
+        hash ^= *p*__IMJ_XXH_P5;
+        hash = __imj_rotl64(hash, 11)*__IMJ_XXH_P1;
     }
 
-    return success;
+    hash ^= hash >> 33;
+    hash *= __IMJ_XXH_P2;
+    hash ^= hash >> 29;
+    hash *= __IMJ_XXH_P3;
+    hash ^= hash >> 32;
+    return hash;
 }
 
-static bool __imjr_begin_arr_ex(imj_t *imj, size_t *count) {
-    if (imj->had_error) return false;
+uint64_t imj_content_hash(imj_t *imj) {
+    if (imj->io_mode == IMJ_READ) return __imj_xxh64(imj->src.data, imj->src.length, 0);
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(!imj->lvl_or_null || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot begin array directly inside object");
+    __imj_assert(imj->done, "must be finished to hash the output");
+    return __imj_xxh64(imj->sb.items, imj->sb.count, 0);
+}
 
-    __imjr_skip_whitespace(imj);
+// whether 'filepath' already holds 'data' written with 'codec', uncompressed files are compared block by block without loading them whole
+static bool __imj_file_holds(const char *filepath, const char *data, size_t n, imj_codec_t codec) {
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) return false;
+
+    bool same = false;
+    uint8_t header[__IMJ_CODEC_HEADER_SIZE];
+    size_t got = fread(header, 1, sizeof(header), file);
+    bool compressed = got == sizeof(header) && memcmp(header, __IMJ_CODEC_MAGIC, 4) == 0;
+
+    if (compressed) {
+        imj_t old = {0};
+        size_t size = 0;
+        char *buffer = codec != IMJ_CODEC_NONE && __imj_get_le(header + 8, 8) == n ? __imj_decompress_file(file, header, &old, &size) : NULL;
+        same = buffer != NULL && old.codec == codec && size == n && memcmp(buffer, data, n) == 0;
+        imj_free(&old);
+    } else if (codec == IMJ_CODEC_NONE) {
+        same = got <= n && memcmp(header, data, got) == 0;
+        size_t at = got;
+
+        char block[1 << 16];
+        while (same) {
+            size_t count = fread(block, 1, sizeof(block), file);
+            if (count == 0) break;
+            same = count <= n - at && memcmp(block, data + at, count) == 0;
+            at += count;
+        }
 
-    bool value_pending = true;
-    bool entered = false;
-    if (!__imjr_match(imj, '[')) {
-        *count = 0;
-        value_pending = false;
-    } else {
-        __imjr_skip_whitespace(imj);
+        same = same && at == n;
+    }
 
-        char *start = imj->current;
+    fclose(file);
+    return same;
+}
 
-        entered = true;
-        size_t seeked_count = 0;
+bool imjw_flush_if_changed(imj_t *imj, uint64_t *hash) {
+    __imj_assert(imj->filepath[0] != '\0', "cannot flush without a filepath");
+    __imj_assert(imj->sb.sink == NULL, "the output went to the sink, use imjw_sink_flush");
+    __imj_assert(imj->io_mode != IMJ_READ, "cannot flush in read mode");
+    __imj_assert(imj->done, "must be finished to flush");
 
-        while (true) {
-            __imjr_skip_whitespace(imj);
+    if (imj->had_error) return false;
 
-            if (*imj->current == '\0') {
-                __imjr_parse_error(imj, "expected ']' before end of file");
-                *count = 0;
-                break;
-            }
+    // seeded with the codec so recompressing the same content still writes, uncompressed it's imj_content_hash
+    uint64_t content_hash = __imj_xxh64(imj->sb.items, imj->sb.count, (uint64_t)imj->codec);
+    bool unchanged = hash != NULL && *hash != 0
+        ? *hash == content_hash
+        : __imj_file_holds(imj->filepath, imj->sb.items, imj->sb.count, imj->codec);
 
-            if (*imj->current == ']') {
-                break;
-            }
+    if (!unchanged && !imjw_flush(imj)) return false;
 
-            __imjr_skip_value(imj);
-            __imjr_skip_whitespace(imj);
-            ++seeked_count;
+    if (hash) *hash = content_hash;
+    return true;
+}
 
-            if (__imjr_match(imj, ',')) {
-                __imjr_skip_whitespace(imj);
+bool imjw_flush(imj_t *imj) {
+    __imj_assert(imj->filepath[0] != '\0', "cannot flush without a filepath");
+    __imj_assert(imj->sb.sink == NULL, "the output went to the sink, use imjw_sink_flush");
 
-                if (*imj->current == ']') {
-                    __imjr_parse_error(imj, "cannot use comma before closing array");
-                    return false;
-                }
-            } else {
-                if (*imj->current != ']') {
-                    __imjr_parse_error(imj, "expected ']' to close array");
-                    return false;
-                }
+    switch (imj->io_mode) {
+    case IMJ_READ: __imj_assert(false, "cannot flush in read mode"); return false;
+    case IMJ_PATCH:
+    case IMJ_WRITE: {
+        __imj_assert(imj->done, "must be finished to flush");
+        if (imj->had_error) return false;
 
-                __imjr_skip_whitespace(imj);
-            }
-        }
+        __imj_assert(__imj_codec_available(imj->codec), "codec was not built in");
 
-        *count = seeked_count;
+        if (!__imj_write_atomic(imj->filepath, imj->sb.items, imj->sb.count, imj->codec)) {
+            printf("cannot write file %s\n", imj->filepath);
+            return false;
+        }
 
-        __imjr_skip_whitespace(imj);
-        imj->value_pending = value_pending && __imjr_match(imj, ']');
-        imj->current = start;
+        return true;
+    }
     }
 
-    __imj_dive_into_arr(imj, entered);
-
-    return entered;
+    return false;
 }
 
-bool imj_begin_arr_ex(imj_t *imj, size_t *count) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_begin_arr_ex(imj, count);
-        break;
-    }
-    case IMJ_WRITE: {
-        __imjw_begin_arr(imj);
-        break;
-    }
-    }
+struct imj_flush_t {
+    imj_arena_t arena;
+    const char *filepath;
+    const char *data;
+    size_t count;
+    imj_codec_t codec;
+    bool success;
+
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    bool joinable;
+    bool done;
+#endif
+};
 
-    return success;
+#ifdef _WIN32
+static DWORD WINAPI __imj_flush_thread(LPVOID arg) {
+    imj_flush_t *flush = arg;
+    flush->success = __imj_write_atomic(flush->filepath, flush->data, flush->count, flush->codec);
+    return 0;
 }
+#else
+static void *__imj_flush_thread(void *arg) {
+    imj_flush_t *flush = arg;
+    bool success = __imj_write_atomic(flush->filepath, flush->data, flush->count, flush->codec);
+
+    pthread_mutex_lock(&flush->mutex);
+    flush->success = success;
+    flush->done = true;
+    pthread_mutex_unlock(&flush->mutex);
+    return NULL;
+}
+#endif
 
-static void __imjr_end_arr(imj_t *imj) {
-    if (imj->had_error) return;
+imj_flush_t *imjw_flush_async(imj_t *imj) {
+    __imj_assert(imj->filepath[0] != '\0', "cannot flush without a filepath");
+    __imj_assert(imj->sb.sink == NULL, "the output went to the sink, use imjw_sink_flush");
+    __imj_assert(imj->io_mode != IMJ_READ, "cannot flush in read mode");
+    __imj_assert(imj->done, "must be finished to flush");
+    __imj_assert(__imj_codec_available(imj->codec), "codec was not built in");
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_ARRAY, "ending array not inside of array");
+    if (imj->had_error) return NULL;
 
-    if (imj->lvl_or_null->left_off_or_null) {
-        __imjr_skip_whitespace(imj);
-        __imjr_skip_arr(imj);
-    }
+    imj_flush_t *flush = malloc(sizeof(imj_flush_t));
+    *flush = (imj_flush_t){0};
 
-    __imj_pop_lvl(imj);
-    --imj->indent_lvl;
+    // the output lives in the arena so the whole arena moves to the flush
+    flush->arena = imj->arena;
+    flush->data = imj->sb.items;
+    flush->count = imj->sb.count;
+    flush->codec = imj->codec;
 
-    if (imj->lvl_or_null) {
-        if (imj->lvl_or_null->type == IMJ_KEY_VALUE) {
-            __imj_pop_lvl(imj);
-        }
+    size_t length = strlen(imj->filepath);
+    char *filepath = __imj_arena_alloc(&flush->arena, length + 1);
+    memcpy(filepath, imj->filepath, length + 1);
+    flush->filepath = filepath;
 
-        __imjr_update_array_if_necessary(imj);
-    }
+    imj_shapes_t *shapes = imj->shapes;
+    imj_shapes_t local_shapes = imj->local_shapes;
+    *imj = (imj_t){0};
+    imj->shapes = shapes;
+    imj->local_shapes = local_shapes;
+
+#ifdef _WIN32
+    flush->thread = CreateThread(NULL, 0, __imj_flush_thread, flush, 0, NULL);
+    if (flush->thread == NULL) __imj_flush_thread(flush);
+#else
+    pthread_mutex_init(&flush->mutex, NULL);
+    flush->joinable = pthread_create(&flush->thread, NULL, __imj_flush_thread, flush) == 0;
+    if (!flush->joinable) __imj_flush_thread(flush);
+#endif
+
+    return flush;
 }
 
-static void __imjw_pop_necessary_lvls_after_val(imj_t *imj) {
-    if (imj->lvl_or_null) {
-        switch (imj->lvl_or_null->type) {
-        case IMJ_ARRAY: break;
-        case IMJ_KEY_VALUE: {
-            __imj_pop_lvl(imj);
-            break;
-        }
-        case IMJ_OBJECT: {
-            __imj_assert(false, "invalid level");
-            break;
-        }
+bool imjw_flush_is_done(imj_flush_t *flush) {
+    if (flush == NULL) return true;
 
-        default: __imj_assert(false, "invalid enum as level"); break;
-        }
+#ifdef _WIN32
+    return flush->thread == NULL || WaitForSingleObject(flush->thread, 0) == WAIT_OBJECT_0;
+#else
+    pthread_mutex_lock(&flush->mutex);
+    bool done = flush->done;
+    pthread_mutex_unlock(&flush->mutex);
+    return done;
+#endif
+}
+
+bool imjw_flush_wait(imj_flush_t *flush) {
+    if (flush == NULL) return false;
+
+#ifdef _WIN32
+    if (flush->thread) {
+        WaitForSingleObject(flush->thread, INFINITE);
+        CloseHandle(flush->thread);
     }
+#else
+    if (flush->joinable) pthread_join(flush->thread, NULL);
+    pthread_mutex_destroy(&flush->mutex);
+#endif
+
+    bool success = flush->success;
+    __imj_arena_free(&flush->arena);
+    free(flush);
+    return success;
 }
 
-static void __imjw_end_arr(imj_t *imj) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_ARRAY, "must be inside array to exit");
+typedef struct __imj_batch_t __imj_batch_t;
+struct __imj_batch_t {
+    const char **paths;
+    size_t n;
+    imj_batch_fn io;
+    void *user;
+    size_t ahead;
+
+#ifdef _WIN32
+    volatile LONG next;
+    volatile LONG failed;
+#else
+    pthread_mutex_t mutex;
+    size_t next;
+    size_t failed;
+#endif
+};
 
-    size_t item_count = imj->lvl_or_null->count;
+// asks the os to start reading the file into the page cache, the load itself still goes through imj_file
+static void __imj_read_ahead(const char *filepath) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#else
+    (void)filepath;
+#endif
+}
 
-    __imj_pop_lvl(imj);
-    --imj->indent_lvl;
+static void __imj_batch_run(__imj_batch_t *batch) {
+    while (true) {
+#ifdef _WIN32
+        size_t index = (size_t)(InterlockedIncrement(&batch->next) - 1);
+#else
+        pthread_mutex_lock(&batch->mutex);
+        size_t index = batch->next++;
+        pthread_mutex_unlock(&batch->mutex);
+#endif
+        if (index >= batch->n) return;
 
-    __imjw_pop_necessary_lvls_after_val(imj);
+        if (index + batch->ahead < batch->n) __imj_read_ahead(batch->paths[index + batch->ahead]);
 
-    if (item_count > 0) {
-        switch (imj->render_style) {
-        case IMJ_STYLE_MIN: break;
-        case IMJ_STYLE_SINGLE_LINE: {
-            __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
-            break;
-        }
-        case IMJ_STYLE_PRETTY: {
-            __imjw_sb_add_str(&imj->sb, "\n", 1, &imj->arena);
-            __imjw_sb_add_indent(imj);
-            break;
-        }
+        imj_t imj;
+        bool success = imj_file(batch->paths[index], &imj, IMJ_READ);
+        if (success) {
+            batch->io(&imj, index, batch->user);
+            success = !imj.had_error;
         }
+        imj_free(&imj);
+
+        if (success) continue;
+#ifdef _WIN32
+        InterlockedIncrement(&batch->failed);
+#else
+        pthread_mutex_lock(&batch->mutex);
+        ++batch->failed;
+        pthread_mutex_unlock(&batch->mutex);
+#endif
     }
+}
 
-    
-    __imjw_sb_add_str(&imj->sb, "]", 1, &imj->arena);
+#ifdef _WIN32
+static DWORD WINAPI __imj_batch_thread(LPVOID arg) {
+    __imj_batch_run(arg);
+    return 0;
+}
+#else
+static void *__imj_batch_thread(void *arg) {
+    __imj_batch_run(arg);
+    return NULL;
 }
+#endif
 
-void imj_end_arr(imj_t *imj) {
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        __imjr_end_arr(imj);
-        break;
+bool imj_load_batch(const char **paths, size_t n, imj_batch_fn io, void *user, size_t nthreads) {
+    if (nthreads == 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        nthreads = info.dwNumberOfProcessors;
+#else
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cores > 0 ? (size_t)cores : 1;
+#endif
     }
-    case IMJ_WRITE: {
-        __imjw_end_arr(imj);
-        break;
+    if (nthreads > n) nthreads = n;
+    if (nthreads == 0) return true;
+
+    // one file in flight per thread and the next round already on its way from disk
+    __imj_batch_t batch = {
+        .paths = paths,
+        .n = n,
+        .io = io,
+        .user = user,
+        .ahead = nthreads*2,
+    };
+    for (size_t i = 0; i < n && i < batch.ahead; ++i) __imj_read_ahead(paths[i]);
+
+#ifdef _WIN32
+    HANDLE *threads = malloc(sizeof(HANDLE)*nthreads);
+    for (size_t i = 1; i < nthreads; ++i) {
+        threads[i] = CreateThread(NULL, 0, __imj_batch_thread, &batch, 0, NULL);
     }
+
+    // the calling thread is a worker too
+    __imj_batch_run(&batch);
+
+    for (size_t i = 1; i < nthreads; ++i) {
+        if (threads[i] == NULL) continue;
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
     }
+#else
+    pthread_mutex_init(&batch.mutex, NULL);
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
+    pthread_t *threads = malloc(sizeof(pthread_t)*nthreads);
+    bool *started = calloc(nthreads, sizeof(bool));
+    for (size_t i = 1; i < nthreads; ++i) {
+        started[i] = pthread_create(&threads[i], NULL, __imj_batch_thread, &batch) == 0;
+    }
+
+    // the calling thread is a worker too
+    __imj_batch_run(&batch);
+
+    for (size_t i = 1; i < nthreads; ++i) {
+        if (started[i]) pthread_join(threads[i], NULL);
     }
+
+    free(started);
+    pthread_mutex_destroy(&batch.mutex);
+#endif
+
+    free(threads);
+    return batch.failed == 0;
 }
 
-static imj_lvl_t *__imj_dive_into_obj(imj_t *imj) {
-    imj_lvl_t *obj = __imj_arena_alloc(&imj->arena, sizeof(imj_lvl_t));
-    *obj = (imj_lvl_t){0};
-    obj->type = IMJ_OBJECT;
-    obj->prev = imj->lvl_or_null;
-    imj->lvl_or_null = obj;
+void imj_free(imj_t *lson) {
+    __imj_arena_free(&lson->arena);
+    imj_shapes_free(&lson->local_shapes);
+    if (lson->doc) imj_doc_release(lson->doc);
+}
 
-    ++imj->indent_lvl;
+void imj_shapes_free(imj_shapes_t *shapes) {
+    __imj_arena_free(&shapes->arena);
+    *shapes = (imj_shapes_t){0};
+}
 
-    return obj;
+void imj_strings_free(imj_strings_t *strings) {
+    bool intern = strings->intern;
+    __imj_arena_free(&strings->arena);
+    *strings = (imj_strings_t){0};
+    strings->intern = intern;
+}
+
+enum imj_log_lvl_t {
+    IMJ_LOG_INFO = 0,
+    IMJ_LOG_ERROR,
+};
+typedef enum imj_log_lvl_t imj_log_lvl_t;
+
+static void __imj_log(imj_log_lvl_t lvl, const char *format, ...) {
+    switch (lvl) {
+    case IMJ_LOG_ERROR: printf("ERROR: "); break;
+    case IMJ_LOG_INFO: printf("INFO: "); break;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+bool imj_sv_cstr_eq(imj_sv_t sv, const char *cstr) {
+    if (cstr == NULL) return false;
+
+    size_t i = 0;
+    char c = cstr[0];
+    while (i < sv.length && c != '\0') {
+        if (sv.data[i] != c) return false;
+        ++i;
+        c = cstr[i];
+
+    }
+
+    return i == sv.length && c == '\0';
+}
+
+// decodes the character at 'i', leaving 'i' on the last byte of its escape
+static bool __imj_unescape_char(imj_sv_t sv, size_t *i, char *c) {
+    *c = sv.data[*i];
+    if (*c != '\\') return true;
+
+    ++*i;
+    switch (sv.data[*i]) {
+    case '"': *c = '"'; break;
+    case '\\': *c = '\\'; break;
+    case '/': *c = '/'; break;
+    case 'b': *c = '\b'; break;
+    case 'f': *c = '\f'; break;
+    case 'n': *c = '\n'; break;
+    case 'r': *c = '\r'; break;
+    case 't': *c = '\t'; break;
+    case 'u': {
+        // only ascii is decoded, it's what control characters are escaped as
+        unsigned code = 0;
+        for (size_t j = 1; j <= 4; ++j) {
+            char h = *i + j < sv.length ? sv.data[*i + j] : '\0';
+            int digit = h >= '0' && h <= '9' ? h - '0' : h >= 'a' && h <= 'f' ? h - 'a' + 10 : h >= 'A' && h <= 'F' ? h - 'A' + 10 : -1;
+            if (digit < 0) return false;
+            code = code*16 + (unsigned)digit;
+        }
+
+        if (code > 0x7f) {
+            __imj_log(IMJ_LOG_ERROR, "unicode codepoints are not supported yet");
+            return false;
+        }
+
+        *c = (char)code;
+        *i += 4;
+        break;
+    }
+    default: return false;
+    }
+
+    return true;
+}
+
+static bool __imj_unescape(imj_sv_t sv, char *buffer, size_t n, size_t *count_out) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < sv.length; ++i) {
+        char c;
+        if (!__imj_unescape_char(sv, &i, &c)) return false;
+
+        if (buffer) {
+            if (count >= n) break;
+            buffer[count] = c;
+        }
+
+        ++count;
+    }
+
+    if (count_out) *count_out = count;
+    return true;
+}
+
+bool imj_rawsv_to_cstrn(imj_sv_t sv, char *buffer, size_t n) {
+    return __imj_unescape(sv, buffer, n, NULL);
+}
+
+bool imj_rawsv_unescape(imj_sv_t sv, char *buffer, size_t n, size_t *length) {
+    return __imj_unescape(sv, buffer, n, length);
+}
+
+// the source is src.length bytes and nothing past it is read, the caller's buffer needs no terminator
+// the end reads as '\0' so a nul byte inside the source stops scanning too, it's reported as such
+static const char *__imjr_end(imj_t *imj) {
+    return imj->src.data + imj->src.length;
+}
+
+static char __imjr_at(const char *p, const char *end) {
+    return p < end ? *p : '\0';
+}
+
+static char __imjr_peek(imj_t *imj) {
+    return __imjr_at(imj->current, __imjr_end(imj));
+}
+
+static char __imjr_next(imj_t *imj) {
+    char c = __imjr_peek(imj);
+    if (c == '\0') return '\0';
+
+    ++imj->current;
+    return c;
+}
+
+static bool __imjr_consume(imj_t *imj, char c) {
+    char check = __imjr_next(imj);
+    if (check == c) {
+        return true;
+    }
+
+    return false;
+}
+
+static void __imjr_parse_error(imj_t *imj, const char *message) {
+    if (imj->had_error) return;
+    imj->had_error = true;
+
+    if (!imj->log_errors) return;
+
+    if (imj->encoding == IMJ_ENCODING_JSON && imj->current < __imjr_end(imj) && *imj->current == '\0') {
+        message = "found nul byte in the source";
+    }
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        __imj_log(IMJ_LOG_ERROR, "%s:@%zu: %s", imj->filepath, (size_t)(imj->current - imj->src.data), message);
+        return;
+    }
+    
+    size_t line_count = 0;
+    size_t col = 0;
+    for (char *c = (char*)imj->src.data; c < imj->current; ++c) {
+        if (*c == '\n') {
+            ++line_count;
+            col = 0;
+        } else {
+            ++col;
+        }
+    }
+
+    __imj_log(IMJ_LOG_ERROR, "%s:%zu:%zu: %s", imj->filepath, line_count+1, col, message);
+}
+
+#ifdef __IMJ_SSE2
+static int __imj_ctz(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+static bool __imjr_is_whitespace(char c) {
+    switch (c) {
+    case ' ': case '\n':
+    case '\r': case '\t': return true;
+    default: return false;
+    }
+}
+
+static const char *__imjv_skip_whitespace(const char *p, const char *end) {
+    // most runs are a single space or none at all
+    if (p < end && !__imjr_is_whitespace(*p)) return p;
+    if (p + 1 < end && !__imjr_is_whitespace(p[1])) return p + 1;
+
+#ifdef __IMJ_SSE2
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8(ws) & 0xffff;
+        if (mask) return p + __imj_ctz(mask);
+        p += 16;
+    }
+#endif
+
+    while (p < end && __imjr_is_whitespace(*p)) ++p;
+    return p;
+}
+
+static void __imjr_skip_whitespace(imj_t *imj) {
+    imj->current = (char*)__imjv_skip_whitespace(imj->current, __imjr_end(imj));
+}
+
+static bool __imjr_match(imj_t *imj, char c) {
+    if (__imjr_peek(imj) == c) {
+        ++imj->current;
+        return true;
+    }
+
+    return false;
+}
+
+typedef struct __imj_profile_node_t __imj_profile_node_t;
+struct __imj_profile_node_t {
+    size_t parent;
+    size_t first_child;
+    size_t next_sibling;
+    imj_sv_t segment;
+    size_t count;
+    size_t values;
+    uint64_t ns;
+    uint64_t child_ns;
+    uint64_t bytes;
+    uint64_t cycles;
+    uint64_t branch_misses;
+};
+
+typedef struct __imj_profile_mark_t __imj_profile_mark_t;
+struct __imj_profile_mark_t {
+    uint64_t ns;
+    size_t offset;
+    uint64_t cycles;
+    uint64_t branch_misses;
+};
+
+typedef struct __imj_profile_scope_t __imj_profile_scope_t;
+struct __imj_profile_scope_t {
+    imj_lvl_t *lvl;
+    size_t node;
+    __imj_profile_mark_t start;
+};
+
+typedef struct __imj_profile_event_t __imj_profile_event_t;
+struct __imj_profile_event_t {
+    size_t node;
+    uint64_t start;
+    uint64_t ns;
+    uint64_t bytes;
+};
+
+struct imj_profile_t {
+    imj_arena_t arena;
+    struct { __imj_profile_node_t *items; size_t count; size_t capacity; } nodes;
+    struct { __imj_profile_scope_t *items; size_t count; size_t capacity; } scopes;
+    struct { __imj_profile_event_t *items; size_t count; size_t capacity; } events;
+    size_t dropped_events;
+    uint64_t epoch;
+
+    // the level the last begin or key pushed, so the scope is only opened when one was
+    imj_lvl_t *pushed;
+    __imj_profile_mark_t mark;
+
+    bool counters;
+    int cycles_fd;
+    int branch_misses_fd;
+};
+
+#ifdef IMJ_PROFILER
+static uint64_t __imj_profile_now(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart*1e9/(double)frequency.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+#else
+    // strict iso builds hide the posix clocks, the c11 one can step but is always there
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+#endif
+
+#ifdef __IMJ_PERF_COUNTERS
+static int __imj_perf_open(uint64_t config) {
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t __imj_perf_read(int fd) {
+    uint64_t value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+#endif
+
+imj_profile_t *imj_profile_new(void) {
+    imj_profile_t *profile = malloc(sizeof(imj_profile_t));
+    *profile = (imj_profile_t){
+        .cycles_fd = -1,
+        .branch_misses_fd = -1,
+    };
+#ifdef IMJ_PROFILER
+    profile->epoch = __imj_profile_now();
+#endif
+
+    // node 0 holds the roots of every document the profile saw
+    __imj_profile_node_t root = {0};
+    __imj_da_push(&profile->nodes, root, &profile->arena);
+    return profile;
+}
+
+bool imj_profile_counters(imj_profile_t *profile) {
+#ifdef __IMJ_PERF_COUNTERS
+    if (profile->counters) return true;
+
+    profile->cycles_fd = __imj_perf_open(PERF_COUNT_HW_CPU_CYCLES);
+    profile->branch_misses_fd = __imj_perf_open(PERF_COUNT_HW_BRANCH_MISSES);
+    profile->counters = profile->cycles_fd >= 0 && profile->branch_misses_fd >= 0;
+    if (profile->counters) return true;
+
+    if (profile->cycles_fd >= 0) close(profile->cycles_fd);
+    if (profile->branch_misses_fd >= 0) close(profile->branch_misses_fd);
+    profile->cycles_fd = -1;
+    profile->branch_misses_fd = -1;
+#else
+    (void)profile;
+#endif
+    return false;
+}
+
+void imj_profile_free(imj_profile_t *profile) {
+    if (profile == NULL) return;
+
+#ifdef __IMJ_PERF_COUNTERS
+    if (profile->counters) {
+        close(profile->cycles_fd);
+        close(profile->branch_misses_fd);
+    }
+#endif
+
+    __imj_arena_free(&profile->arena);
+    free(profile);
+}
+
+#ifdef IMJ_PROFILER
+static __imj_profile_mark_t __imj_profile_take(imj_t *imj) {
+    imj_profile_t *profile = imj->profile;
+    __imj_profile_mark_t mark = {
+        .ns = __imj_profile_now(),
+        .offset = imj->io_mode == IMJ_WRITE ? imj->sb.count : (size_t)(imj->current - imj->src.data),
+    };
+
+#ifdef __IMJ_PERF_COUNTERS
+    if (profile->counters) {
+        mark.cycles = __imj_perf_read(profile->cycles_fd);
+        mark.branch_misses = __imj_perf_read(profile->branch_misses_fd);
+    }
+#else
+    (void)profile;
+#endif
+    return mark;
+}
+
+static size_t __imj_profile_child(imj_profile_t *profile, size_t parent, const char *segment, size_t n) {
+    for (size_t i = profile->nodes.items[parent].first_child; i != 0; i = profile->nodes.items[i].next_sibling) {
+        imj_sv_t name = profile->nodes.items[i].segment;
+        if (name.length == n && memcmp(name.data, segment, n) == 0) return i;
+    }
+
+    char *copy = __imj_arena_alloc(&profile->arena, n + 1);
+    if (copy == NULL) return parent;
+    memcpy(copy, segment, n);
+    copy[n] = '\0';
+
+    __imj_profile_node_t node = {
+        .parent = parent,
+        .next_sibling = profile->nodes.items[parent].first_child,
+        .segment = { .data = copy, .length = n },
+    };
+
+    size_t index = profile->nodes.count;
+    __imj_da_push(&profile->nodes, node, &profile->arena);
+    if (profile->nodes.count == index) return parent;
+
+    profile->nodes.items[parent].first_child = index;
+    return index;
+}
+
+// called before a begin or key does its work so that work is part of the scope
+static void __imj_profile_mark(imj_t *imj) {
+    if (imj->profile == NULL) return;
+    imj->profile->pushed = NULL;
+    imj->profile->mark = __imj_profile_take(imj);
+}
+
+static void __imj_profile_pushed(imj_t *imj, imj_lvl_t *lvl) {
+    if (imj->profile) imj->profile->pushed = lvl;
+}
+
+// 'key' names key scopes, objects only get their own scope at the root since a key or array already covers them
+static void __imj_profile_enter(imj_t *imj, const char *key, size_t n) {
+    imj_profile_t *profile = imj->profile;
+    if (profile == NULL || profile->pushed == NULL || profile->pushed != imj->lvl_or_null) return;
+
+    imj_lvl_t *lvl = profile->pushed;
+    profile->pushed = NULL;
+
+    // a new document, whatever a cursor left open before is dropped
+    if (lvl->prev == NULL) profile->scopes.count = 0;
+
+    size_t parent = profile->scopes.count > 0 ? profile->scopes.items[profile->scopes.count-1].node : 0;
+    size_t node;
+    switch (lvl->type) {
+    case IMJ_KEY_VALUE: {
+        char segment[256];
+        size_t length = n < sizeof(segment) - 1 ? n : sizeof(segment) - 1;
+        segment[0] = '/';
+        memcpy(segment + 1, key, length);
+        node = __imj_profile_child(profile, parent, segment, length + 1);
+        break;
+    }
+
+    case IMJ_ARRAY: node = __imj_profile_child(profile, parent, "[]", 2); break;
+
+    case IMJ_OBJECT: {
+        if (lvl->prev != NULL) return;
+        node = __imj_profile_child(profile, parent, "", 0);
+        break;
+    }
+
+    default: return;
+    }
+
+    __imj_profile_scope_t scope = {
+        .lvl = lvl,
+        .node = node,
+        .start = profile->mark,
+    };
+    __imj_da_push(&profile->scopes, scope, &profile->arena);
+}
+
+static void __imj_profile_leave(imj_t *imj, imj_lvl_t *lvl) {
+    imj_profile_t *profile = imj->profile;
+    if (profile->scopes.count == 0 || profile->scopes.items[profile->scopes.count-1].lvl != lvl) return;
+
+    __imj_profile_scope_t scope = profile->scopes.items[--profile->scopes.count];
+    __imj_profile_mark_t end = __imj_profile_take(imj);
+
+    uint64_t ns = end.ns - scope.start.ns;
+    uint64_t bytes = end.offset - scope.start.offset;
+
+    __imj_profile_node_t *node = &profile->nodes.items[scope.node];
+    ++node->count;
+    node->values += lvl->type == IMJ_ARRAY ? lvl->count : 1;
+    node->ns += ns;
+    node->bytes += bytes;
+    node->cycles += end.cycles - scope.start.cycles;
+    node->branch_misses += end.branch_misses - scope.start.branch_misses;
+
+    if (profile->scopes.count > 0) {
+        profile->nodes.items[profile->scopes.items[profile->scopes.count-1].node].child_ns += ns;
+    }
+
+    if (profile->events.count >= IMJ_PROFILE_MAX_EVENTS) {
+        ++profile->dropped_events;
+        return;
+    }
+
+    __imj_profile_event_t event = {
+        .node = scope.node,
+        .start = scope.start.ns - profile->epoch,
+        .ns = ns,
+        .bytes = bytes,
+    };
+    __imj_da_push(&profile->events, event, &profile->arena);
+}
+
+#define __IMJ_PROFILE_MARK(imj) __imj_profile_mark(imj)
+#define __IMJ_PROFILE_ENTER(imj, key, n) __imj_profile_enter(imj, key, n)
+#define __IMJ_PROFILE_PUSHED(imj, lvl) __imj_profile_pushed(imj, lvl)
+#define __IMJ_PROFILE_LEAVE(imj, lvl) do { if ((imj)->profile) __imj_profile_leave(imj, lvl); } while (false)
+#else
+#define __IMJ_PROFILE_MARK(imj) ((void)0)
+#define __IMJ_PROFILE_ENTER(imj, key, n) ((void)0)
+#define __IMJ_PROFILE_PUSHED(imj, lvl) ((void)0)
+#define __IMJ_PROFILE_LEAVE(imj, lvl) ((void)0)
+#endif
+
+static size_t __imj_profile_path(imj_profile_t *profile, size_t node, char *buffer, size_t n) {
+    size_t length = 0;
+    if (node != 0 && profile->nodes.items[node].parent != 0) {
+        length = __imj_profile_path(profile, profile->nodes.items[node].parent, buffer, n);
+    }
+
+    imj_sv_t segment = profile->nodes.items[node].segment;
+    size_t fits = length + segment.length < n ? segment.length : n - length - 1;
+    memcpy(buffer + length, segment.data, fits);
+    length += fits;
+    buffer[length] = '\0';
+    return length;
+}
+
+static int __imj_profile_cmp(const void *a, const void *b) {
+    const __imj_profile_node_t *x = *(const __imj_profile_node_t**)a;
+    const __imj_profile_node_t *y = *(const __imj_profile_node_t**)b;
+    return x->ns < y->ns ? 1 : x->ns > y->ns ? -1 : 0;
+}
+
+bool imj_profile_report(imj_profile_t *profile, const char *filepath) {
+    FILE *file = filepath ? fopen(filepath, "wb") : stdout;
+    if (file == NULL) return false;
+
+    size_t count = profile->nodes.count - 1;
+    __imj_profile_node_t **sorted = malloc(sizeof(__imj_profile_node_t*)*(count > 0 ? count : 1));
+    for (size_t i = 0; i < count; ++i) sorted[i] = &profile->nodes.items[i + 1];
+    qsort(sorted, count, sizeof(*sorted), __imj_profile_cmp);
+
+    fprintf(file, "%-40s %10s %10s %12s %12s %12s", "path", "scopes", "values", "total ms", "self ms", "bytes");
+    if (profile->counters) fprintf(file, " %14s %14s", "cycles", "branch misses");
+    fprintf(file, "\n");
+
+    for (size_t i = 0; i < count; ++i) {
+        __imj_profile_node_t *node = sorted[i];
+
+        char path[256];
+        __imj_profile_path(profile, node - profile->nodes.items, path, sizeof(path));
+
+        fprintf(file, "%-40s %10zu %10zu %12.3f %12.3f %12llu", path[0] ? path : "/", node->count, node->values,
+            node->ns/1e6, (node->ns - node->child_ns)/1e6, (unsigned long long)node->bytes);
+        if (profile->counters) fprintf(file, " %14llu %14llu", (unsigned long long)node->cycles, (unsigned long long)node->branch_misses);
+        fprintf(file, "\n");
+    }
+
+    free(sorted);
+    bool success = !ferror(file);
+    if (filepath) success = fclose(file) == 0 && success;
+    return success;
+}
+
+static void __imj_profile_put_jsonstr(FILE *file, const char *s) {
+    fputc('"', file);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fputc('\\', file);
+        if (c < 0x20) fprintf(file, "\\u%04x", c);
+        else fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+bool imj_profile_trace(imj_profile_t *profile, const char *filepath) {
+    FILE *file = fopen(filepath, "wb");
+    if (file == NULL) return false;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (size_t i = 0; i < profile->events.count; ++i) {
+        __imj_profile_event_t *event = &profile->events.items[i];
+
+        char path[256];
+        __imj_profile_path(profile, event->node, path, sizeof(path));
+
+        fprintf(file, "%s\n{\"name\": ", i > 0 ? "," : "");
+        __imj_profile_put_jsonstr(file, path[0] ? path : "/");
+        fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"bytes\": %llu}}",
+            event->start/1e3, event->ns/1e3, (unsigned long long)event->bytes);
+    }
+    fprintf(file, "\n], \"otherData\": {\"dropped_events\": %zu}}\n", profile->dropped_events);
+
+    bool success = !ferror(file);
+    return fclose(file) == 0 && success;
+}
+
+static void __imj_pop_lvl(imj_t *imj) {
+    imj_lvl_t *lvl = imj->lvl_or_null;
+    imj->lvl_or_null = lvl->prev;
+    __IMJ_PROFILE_LEAVE(imj, lvl);
+
+    // fixed scratch is used as a stack, the level and everything allocated after it are free again
+    if (imj->arena.fixed && lvl != &imj->spare_lvl) {
+        imj->arena.region_back->count = (char*)lvl - imj->arena.region_back->data;
+    } else if (__imj_io_mode(imj) == IMJ_WRITE && lvl != &imj->spare_lvl) {
+        // nothing points at a writer's finished levels, so long documents reuse them instead of growing the arena
+        lvl->prev = imj->free_lvls;
+        imj->free_lvls = lvl;
+    }
+}
+
+static void __imj_out_of_scratch(imj_t *imj) {
+    if (!imj->had_error && imj->log_errors) {
+        __imj_log(IMJ_LOG_ERROR, "%s: scratch buffer needs at least %zu bytes", imj->filepath, imj->arena.required);
+    }
+    imj->had_error = true;
+}
+
+static imj_lvl_t *__imj_alloc_lvl(imj_t *imj) {
+    if (imj->free_lvls) {
+        imj_lvl_t *lvl = imj->free_lvls;
+        imj->free_lvls = lvl->prev;
+        return lvl;
+    }
+
+    imj_lvl_t *lvl = __imj_arena_alloc(&imj->arena, sizeof(imj_lvl_t));
+    if (lvl) return lvl;
+
+    // the spare is only there so the caller has a level, every later call returns right away
+    __imj_out_of_scratch(imj);
+    imj->spare_lvl = (imj_lvl_t){0};
+    return &imj->spare_lvl;
+}
+
+static bool __imjr_read_str(imj_t *imj, imj_sv_t *ret) {
+    char *start = imj->current;
+    char *previous = imj->current++;
+    while (true) {
+#ifdef __IMJ_SSE2
+        // plain runs go 16 bytes at a time, quotes, escapes and nuls are handled one by one below
+        while (__imjr_end(imj) - previous >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)previous);
+            __m128i quote = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'));
+            __m128i backslash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+            __m128i nul = _mm_cmpeq_epi8(chunk, _mm_setzero_si128());
+
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, backslash), nul));
+            if (mask) {
+                previous += __imj_ctz(mask);
+                break;
+            }
+            previous += 16;
+        }
+        imj->current = previous + 1;
+#endif
+
+        if (previous == __imjr_end(imj) || *previous == '\0') {
+            imj->current = previous;
+            __imjr_parse_error(imj, "found end of file before end of string.");
+            return false;
+        }
+        if (*previous == '\"') break;
+
+        if (*previous == '\\') {
+            switch (__imjr_peek(imj)) {
+            case '"': case '\\': case '/':
+            case 'b': case 'f': case 'n':
+            case 'r': case 't': {
+                previous = imj->current++;
+                break;
+            }
+
+            case 'u': {
+                ++imj->current;
+
+                for (size_t i = 0; i < 4; ++i) {
+                    switch (__imjr_peek(imj)) {
+                    // digits
+                    case __imj_cases_non_zero: case '0':
+
+                    // characters
+                    case 'a': case 'A': case 'b': case 'B':
+                    case 'c': case 'C': case 'd': case 'D':
+                    case 'e': case 'E': case 'f': case 'F': break;
+
+                    default: {
+                        __imjr_parse_error(imj, "invalid hex digit.");
+                        return false;
+                    }
+                    }
+
+                    ++imj->current;
+                }
+
+                --imj->current;
+                break;
+            }
+
+            default: {
+                __imjr_parse_error(imj, "invalid escape sequence.");
+                return false;
+            }
+            }
+
+        }
+
+        previous = imj->current++;
+    }
+
+    *ret = (imj_sv_t){
+        .data = start,
+        .length = previous-start,
+    };
+
+    return true;
+}
+
+static void __imjr_skip_until_whitespace_or_comma(imj_t *imj) {
+    while (true) {
+        char c = __imjr_peek(imj);
+        switch (c) {
+        case '\0': case ',': case ']': case '}': return;
+        default: break;
+        }
+
+        if (__imjr_is_whitespace(c)) return;
+        ++imj->current;
+    }
+}
+
+static size_t __imjr_max_depth(imj_t *imj) {
+    return imj->max_depth > 0 ? imj->max_depth : IMJ_MAX_DEPTH;
+}
+
+static void __imjr_check_depth(imj_t *imj) {
+    if (imj->indent_lvl > __imjr_max_depth(imj)) __imjr_parse_error(imj, "nested deeper than max_depth");
+}
+
+struct imj_doc_node_t {
+    size_t open;
+    size_t close;
+    size_t count;
+    imj_key_t *keys;
+};
+
+typedef struct imj_doc_nodes_t imj_doc_nodes_t;
+struct imj_doc_nodes_t {
+    imj_doc_node_t *items;
+    size_t count;
+    size_t capacity;
+};
+
+struct imj_doc_t {
+    imj_arena_t arena;
+    const char *filepath;
+    imj_sv_t src;
+    imj_encoding_t encoding;
+    imj_doc_nodes_t nodes;
+    bool indexed;
+
+#ifdef _WIN32
+    volatile LONG refs;
+#else
+    pthread_mutex_t mutex;
+    size_t refs;
+#endif
+};
+
+static imj_doc_t *__imj_doc_new(void) {
+    imj_doc_t *doc = malloc(sizeof(imj_doc_t));
+    *doc = (imj_doc_t){0};
+    doc->refs = 1;
+#ifndef _WIN32
+    pthread_mutex_init(&doc->mutex, NULL);
+#endif
+    return doc;
+}
+
+imj_doc_t *imj_doc_file(const char *filepath) {
+    imj_t imj;
+    if (!imj_file(filepath, &imj, IMJ_READ)) return NULL;
+
+    // the source lives in the arena so the whole arena moves to the document
+    imj_doc_t *doc = __imj_doc_new();
+    doc->arena = imj.arena;
+
+    size_t length = strlen(filepath);
+    char *path = __imj_arena_alloc(&doc->arena, length + 1);
+    memcpy(path, filepath, length + 1);
+    doc->filepath = path;
+    doc->src = imj.src;
+    doc->encoding = imj.encoding;
+
+    imj_shapes_free(&imj.local_shapes);
+    return doc;
+}
+
+imj_doc_t *imj_doc_cstrn(const char *cstr, size_t n) {
+    imj_doc_t *doc = __imj_doc_new();
+
+    char *copy = __imj_arena_alloc(&doc->arena, n + 1);
+    memcpy(copy, cstr, n);
+    copy[n] = '\0';
+
+    doc->filepath = "";
+    doc->src = (imj_sv_t){ .data = copy, .length = n };
+    doc->encoding = n >= 3 && memcmp(cstr, __IMJ_CBOR_SELF_DESCRIBE, 3) == 0 ? IMJ_ENCODING_CBOR : IMJ_ENCODING_JSON;
+    return doc;
+}
+
+void imj_doc_retain(imj_doc_t *doc) {
+#ifdef _WIN32
+    InterlockedIncrement(&doc->refs);
+#else
+    pthread_mutex_lock(&doc->mutex);
+    ++doc->refs;
+    pthread_mutex_unlock(&doc->mutex);
+#endif
+}
+
+void imj_doc_release(imj_doc_t *doc) {
+    if (doc == NULL) return;
+
+#ifdef _WIN32
+    if (InterlockedDecrement(&doc->refs) > 0) return;
+#else
+    pthread_mutex_lock(&doc->mutex);
+    size_t refs = --doc->refs;
+    pthread_mutex_unlock(&doc->mutex);
+    if (refs > 0) return;
+
+    pthread_mutex_destroy(&doc->mutex);
+#endif
+
+    __imj_arena_free(&doc->arena);
+    free(doc);
+}
+
+void imjr_doc(imj_doc_t *doc, imj_t *imj) {
+    *imj = (imj_t){0};
+    imj_doc_retain(doc);
+    __imjr_init(doc->filepath, doc->src.data, doc->src.length, doc->encoding, imj);
+    imj->doc = doc;
+}
+
+typedef struct __imj_doc_key_t __imj_doc_key_t;
+struct __imj_doc_key_t {
+    size_t node;
+    imj_key_t key;
+};
+
+bool imj_doc_index(imj_doc_t *doc) {
+    if (doc->indexed) return true;
+    if (doc->encoding != IMJ_ENCODING_JSON) return false;
+
+    imj_arena_t scratch = {0};
+    struct { size_t *items; size_t count; size_t capacity; } stack = {0};
+    struct { __imj_doc_key_t *items; size_t count; size_t capacity; } keys = {0};
+
+    const char *src = doc->src.data;
+    const char *p = src;
+    __imj_doc_key_t k = {0};
+    bool in_obj = false;
+    bool success = false;
+
+    while (__imjr_is_whitespace(*p)) ++p;
+
+    while (true) {
+        // value
+        switch (*p) {
+        case '"': {
+            ++p;
+            while (*p != '"') {
+                if (*p == '\0') goto done;
+                if (*p == '\\' && p[1] != '\0') ++p;
+                ++p;
+            }
+            ++p;
+            break;
+        }
+
+        case '{':
+        case '[': {
+            in_obj = *p == '{';
+            imj_doc_node_t node = { .open = p - src };
+            __imj_da_push(&doc->nodes, node, &scratch);
+            __imj_da_push(&stack, doc->nodes.count - 1, &scratch);
+
+            ++p;
+            while (__imjr_is_whitespace(*p)) ++p;
+
+            if (*p == (in_obj ? '}' : ']')) {
+                doc->nodes.items[--stack.count].close = p - src;
+                ++p;
+                break;
+            }
+
+            if (in_obj) goto key;
+            continue;
+        }
+
+        case '\0': case ',': case ']': case '}': goto done;
+
+        default: {
+            while (true) {
+                switch (*p) {
+                case '\0': case ',': case ']': case '}':
+                case ' ': case '\n': case '\r': case '\t': break;
+                default: ++p; continue;
+                }
+                break;
+            }
+            break;
+        }
+        }
+
+        // after a value
+        while (true) {
+            while (__imjr_is_whitespace(*p)) ++p;
+
+            if (stack.count == 0) {
+                // documents own a terminated copy, a nul before its end fails the index
+                success = p == src + doc->src.length;
+                goto done;
+            }
+
+            imj_doc_node_t *top = &doc->nodes.items[stack.items[stack.count-1]];
+            in_obj = src[top->open] == '{';
+            ++top->count;
+
+            if (*p == ',') {
+                ++p;
+                while (__imjr_is_whitespace(*p)) ++p;
+                if (*p == (in_obj ? '}' : ']')) goto done;
+                break;
+            }
+
+            if (*p != (in_obj ? '}' : ']')) goto done;
+
+            top->close = p - src;
+            --stack.count;
+            ++p;
+        }
+
+        if (!in_obj) continue;
+
+    key:
+        if (*p != '"') goto done;
+
+        k.key.name.data = ++p;
+        while (*p != '"') {
+            if (*p == '\0') goto done;
+            if (*p == '\\' && p[1] != '\0') ++p;
+            ++p;
+        }
+        k.key.name.length = p - k.key.name.data;
+        ++p;
+
+        while (__imjr_is_whitespace(*p)) ++p;
+        if (*p != ':') goto done;
+        ++p;
+        while (__imjr_is_whitespace(*p)) ++p;
+
+        k.node = stack.items[stack.count-1];
+        k.key.loc = (char*)p;
+        __imj_da_push(&keys, k, &scratch);
+    }
+
+done:
+    if (success && keys.count > 0) {
+        // keys were found interleaved with the keys of nested objects, so they are gathered per object
+        imj_key_t *all = __imj_arena_alloc(&doc->arena, sizeof(imj_key_t)*keys.count);
+        size_t *filled = __imj_arena_alloc(&scratch, sizeof(size_t)*doc->nodes.count);
+
+        size_t at = 0;
+        for (size_t i = 0; i < doc->nodes.count; ++i) {
+            filled[i] = 0;
+            if (src[doc->nodes.items[i].open] != '{') continue;
+            doc->nodes.items[i].keys = all + at;
+            at += doc->nodes.items[i].count;
+        }
+
+        for (size_t i = 0; i < keys.count; ++i) {
+            imj_doc_node_t *node = &doc->nodes.items[keys.items[i].node];
+            node->keys[filled[keys.items[i].node]++] = keys.items[i].key;
+        }
+    }
+
+    // nodes grew in the scratch arena, only their final size stays with the document
+    if (success && doc->nodes.count > 0) {
+        imj_doc_node_t *nodes = __imj_arena_alloc(&doc->arena, sizeof(imj_doc_node_t)*doc->nodes.count);
+        memcpy(nodes, doc->nodes.items, sizeof(imj_doc_node_t)*doc->nodes.count);
+        doc->nodes.items = nodes;
+        doc->nodes.capacity = doc->nodes.count;
+    } else {
+        doc->nodes = (imj_doc_nodes_t){0};
+    }
+
+    doc->indexed = success;
+
+    __imj_arena_free(&scratch);
+    return success;
+}
+
+static const imj_doc_node_t *__imj_doc_find(imj_t *imj, const char *bracket) {
+    if (imj->doc == NULL || !imj->doc->indexed) return NULL;
+
+    // nodes are recorded in the order their brackets open
+    size_t open = bracket - imj->src.data;
+    size_t lo = 0;
+    size_t hi = imj->doc->nodes.count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        size_t at = imj->doc->nodes.items[mid].open;
+        if (at == open) return &imj->doc->nodes.items[mid];
+        if (at < open) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return NULL;
+}
+
+typedef struct __imj_doc_entry_t __imj_doc_entry_t;
+struct __imj_doc_entry_t {
+    __imj_doc_entry_t *prev;
+    __imj_doc_entry_t *next;
+    imj_doc_t *doc;
+    uint64_t size;
+    uint64_t mtime;
+    size_t bytes;
+};
+
+static struct {
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+    // most recently used first
+    __imj_doc_entry_t *first;
+    __imj_doc_entry_t *last;
+    size_t budget;
+    imj_doc_cache_stats_t stats;
+} __imj_doc_cache = {
+#ifdef _WIN32
+    .lock = SRWLOCK_INIT,
+#else
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+    .budget = IMJ_DOC_CACHE_BUDGET,
+};
+
+static void __imj_doc_cache_lock(void) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&__imj_doc_cache.lock);
+#else
+    pthread_mutex_lock(&__imj_doc_cache.lock);
+#endif
+}
+
+static void __imj_doc_cache_unlock(void) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&__imj_doc_cache.lock);
+#else
+    pthread_mutex_unlock(&__imj_doc_cache.lock);
+#endif
+}
+
+static bool __imj_file_stamp(const char *filepath, uint64_t *size, uint64_t *mtime) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filepath, GetFileExInfoStandard, &data)) return false;
+    *size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    *mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(filepath, &st) != 0) return false;
+    *size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+    *mtime = (uint64_t)st.st_mtimespec.tv_sec*1000000000 + st.st_mtimespec.tv_nsec;
+#elif (defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L) || (defined(_XOPEN_SOURCE) && _XOPEN_SOURCE >= 700)
+    *mtime = (uint64_t)st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+#else
+    // strict iso builds like -std=c11 hide the nanosecond field, whole seconds miss edits within the same second
+    *mtime = (uint64_t)st.st_mtime*1000000000;
+#endif
+#endif
+    return true;
+}
+
+static size_t __imj_arena_size(imj_arena_t *arena) {
+    size_t size = 0;
+    for (imj_region_t *r = arena->region_back; r; r = r->prev) size += sizeof(imj_region_t) + r->capacity;
+    return size;
+}
+
+static void __imj_doc_cache_unlink(__imj_doc_entry_t *entry) {
+    if (entry->prev) entry->prev->next = entry->next;
+    else __imj_doc_cache.first = entry->next;
+
+    if (entry->next) entry->next->prev = entry->prev;
+    else __imj_doc_cache.last = entry->prev;
+
+    entry->prev = entry->next = NULL;
+}
+
+static void __imj_doc_cache_push_front(__imj_doc_entry_t *entry) {
+    entry->next = __imj_doc_cache.first;
+    if (entry->next) entry->next->prev = entry;
+    else __imj_doc_cache.last = entry;
+    __imj_doc_cache.first = entry;
+}
+
+static void __imj_doc_cache_remove(__imj_doc_entry_t *entry) {
+    __imj_doc_cache_unlink(entry);
+    __imj_doc_cache.stats.bytes -= entry->bytes;
+    --__imj_doc_cache.stats.count;
+
+    // cursors still reading it keep the document alive
+    imj_doc_release(entry->doc);
+    free(entry);
+}
+
+static void __imj_doc_cache_evict(void) {
+    while (__imj_doc_cache.stats.bytes > __imj_doc_cache.budget && __imj_doc_cache.last) {
+        __imj_doc_cache_remove(__imj_doc_cache.last);
+        ++__imj_doc_cache.stats.evictions;
+    }
+}
+
+static __imj_doc_entry_t *__imj_doc_cache_find(const char *filepath) {
+    for (__imj_doc_entry_t *entry = __imj_doc_cache.first; entry; entry = entry->next) {
+        if (strcmp(entry->doc->filepath, filepath) == 0) return entry;
+    }
+
+    return NULL;
+}
+
+imj_doc_t *imj_doc_cached(const char *filepath) {
+    uint64_t size, mtime;
+    if (!__imj_file_stamp(filepath, &size, &mtime)) return NULL;
+
+    __imj_doc_cache_lock();
+
+    __imj_doc_entry_t *entry = __imj_doc_cache_find(filepath);
+    if (entry && entry->size == size && entry->mtime == mtime) {
+        __imj_doc_cache_unlink(entry);
+        __imj_doc_cache_push_front(entry);
+        ++__imj_doc_cache.stats.hits;
+
+        imj_doc_retain(entry->doc);
+        __imj_doc_cache_unlock();
+        return entry->doc;
+    }
+
+    // the file changed since it was cached
+    if (entry) __imj_doc_cache_remove(entry);
+    ++__imj_doc_cache.stats.misses;
+
+    __imj_doc_cache_unlock();
+
+    // loading happens outside the lock so other files stay available meanwhile
+    imj_doc_t *doc = imj_doc_file(filepath);
+    if (!doc) return NULL;
+    imj_doc_index(doc);
+
+    entry = malloc(sizeof(__imj_doc_entry_t));
+    *entry = (__imj_doc_entry_t){
+        .doc = doc,
+        .size = size,
+        .mtime = mtime,
+        .bytes = __imj_arena_size(&doc->arena),
+    };
+
+    __imj_doc_cache_lock();
+
+    // another thread may have loaded the same file in the meantime
+    __imj_doc_entry_t *existing = __imj_doc_cache_find(filepath);
+    if (existing) __imj_doc_cache_remove(existing);
+
+    if (entry->bytes > __imj_doc_cache.budget) {
+        free(entry);
+    } else {
+        imj_doc_retain(doc);
+        __imj_doc_cache_push_front(entry);
+        __imj_doc_cache.stats.bytes += entry->bytes;
+        ++__imj_doc_cache.stats.count;
+        __imj_doc_cache_evict();
+    }
+
+    __imj_doc_cache_unlock();
+    return doc;
+}
+
+bool imj_file_cached(const char *filepath, imj_t *imj) {
+    imj_doc_t *doc = imj_doc_cached(filepath);
+    if (!doc) {
+        *imj = (imj_t){0};
+        return false;
+    }
+
+    imjr_doc(doc, imj);
+    imj_doc_release(doc);
+    return true;
+}
+
+void imj_doc_cache_budget(size_t bytes) {
+    __imj_doc_cache_lock();
+    __imj_doc_cache.budget = bytes;
+    __imj_doc_cache_evict();
+    __imj_doc_cache_unlock();
+}
+
+imj_doc_cache_stats_t imj_doc_cache_stats(void) {
+    __imj_doc_cache_lock();
+    imj_doc_cache_stats_t stats = __imj_doc_cache.stats;
+    __imj_doc_cache_unlock();
+    return stats;
+}
+
+void imj_doc_cache_clear(void) {
+    __imj_doc_cache_lock();
+    while (__imj_doc_cache.first) __imj_doc_cache_remove(__imj_doc_cache.first);
+    __imj_doc_cache.stats = (imj_doc_cache_stats_t){0};
+    __imj_doc_cache_unlock();
+}
+
+// skips the value at current, or the rest of an aggregate already entered when 'open' is IMJ_OBJECT or IMJ_ARRAY
+static void __imjr_skip_from(imj_t *imj, imj_val_kind_t open) {
+    // one bit per bracket, set for objects
+    uint64_t stack[(IMJ_MAX_DEPTH + 63)/64];
+    size_t depth = 0;
+    bool in_obj = false;
+
+    size_t entered = open == IMJ_NONE || imj->indent_lvl == 0 ? imj->indent_lvl : imj->indent_lvl - 1;
+    size_t max_depth = __imjr_max_depth(imj);
+    const char *message = NULL;
+
+    // kept local so it stays in a register, imj->current is only updated on the way out
+    char *p = imj->current;
+    const char *end = __imjr_end(imj);
+
+    if (open != IMJ_NONE) {
+        in_obj = open == IMJ_OBJECT;
+        stack[0] = in_obj;
+        depth = 1;
+
+        while (p < end && __imjr_is_whitespace(*p)) ++p;
+        if (p < end && *p == (in_obj ? '}' : ']')) {
+            imj->current = p + 1;
+            return;
+        }
+
+        if (in_obj) goto key;
+    }
+
+    while (true) {
+        // value
+        switch (__imjr_at(p, end)) {
+        case '"': {
+            ++p;
+            while (p < end && *p != '"') {
+                if (*p == '\0') break;
+                if (*p == '\\' && p + 1 < end && p[1] != '\0') ++p;
+                ++p;
+            }
+
+            if (p == end || *p != '"') {
+                message = "source ended before string closed";
+                goto fail;
+            }
+            ++p;
+            break;
+        }
+
+        case '{':
+        case '[': {
+            if (depth == 0 && imj->doc) {
+                const imj_doc_node_t *node = __imj_doc_find(imj, p);
+                if (node) {
+                    p = (char*)imj->src.data + node->close + 1;
+                    break;
+                }
+            }
+
+            if (entered + depth >= max_depth) {
+                message = "nested deeper than max_depth";
+                goto fail;
+            }
+
+            // the bit stack holds IMJ_MAX_DEPTH levels below where the skip started, whatever max_depth allows
+            if (depth >= IMJ_MAX_DEPTH) {
+                message = "skipped value nested deeper than IMJ_MAX_DEPTH";
+                goto fail;
+            }
+
+            in_obj = *p == '{';
+            if (in_obj) stack[depth/64] |= (uint64_t)1 << (depth%64);
+            else stack[depth/64] &= ~((uint64_t)1 << (depth%64));
+            ++depth;
+
+            ++p;
+            while (p < end && __imjr_is_whitespace(*p)) ++p;
+
+            if (p < end && *p == (in_obj ? '}' : ']')) {
+                ++p;
+                --depth;
+                in_obj = depth > 0 && ((stack[(depth-1)/64] >> ((depth-1)%64)) & 1);
+                break;
+            }
+
+            if (in_obj) goto key;
+            continue;
+        }
+
+        case '\0': message = "expected value before end of file"; goto fail;
+        case ',': case ']': case '}': message = "expected value"; goto fail;
+
+        default: {
+            while (true) {
+                switch (__imjr_at(p, end)) {
+                case '\0': case ',': case ']': case '}':
+                case ' ': case '\n': case '\r': case '\t': break;
+                default: ++p; continue;
+                }
+                break;
+            }
+            break;
+        }
+        }
+
+        // after a value
+        while (true) {
+            if (depth == 0) {
+                imj->current = p;
+                return;
+            }
+
+            char close = in_obj ? '}' : ']';
+            while (p < end && __imjr_is_whitespace(*p)) ++p;
+            char c = __imjr_at(p, end);
+
+            if (c == ',') {
+                ++p;
+                while (p < end && __imjr_is_whitespace(*p)) ++p;
+                if (__imjr_at(p, end) == close) {
+                    message = in_obj ? "cannot have ',' before ending an object" : "cannot have ',' before ending an array";
+                    goto fail;
+                }
+                break;
+            }
+
+            if (c == close) {
+                ++p;
+                --depth;
+                in_obj = depth > 0 && ((stack[(depth-1)/64] >> ((depth-1)%64)) & 1);
+                continue;
+            }
+
+            if (c == '\0') {
+                message = in_obj ? "expected '}' before end of file" : "expected ']' before end of file";
+            } else {
+                message = in_obj ? "expected ',' or '}' after value" : "expected ',' or ']' after value";
+            }
+            goto fail;
+        }
+
+        if (!in_obj) continue;
+
+    key:
+        if (__imjr_at(p, end) != '"') {
+            message = __imjr_at(p, end) == '\0' ? "expected '}' before end of file" : "expected key";
+            goto fail;
+        }
+
+        ++p;
+        while (p < end && *p != '"') {
+            if (*p == '\0') break;
+            if (*p == '\\' && p + 1 < end && p[1] != '\0') ++p;
+            ++p;
+        }
+
+        if (p == end || *p != '"') {
+            message = "source ended before string closed";
+            goto fail;
+        }
+        ++p;
+
+        while (p < end && __imjr_is_whitespace(*p)) ++p;
+        if (__imjr_at(p, end) != ':') {
+            message = "expected ':' after key";
+            goto fail;
+        }
+
+        ++p;
+        while (p < end && __imjr_is_whitespace(*p)) ++p;
+    }
+
+fail:
+    imj->current = p;
+    __imjr_parse_error(imj, message);
+}
+
+static void __imjr_skip_value(imj_t *imj) {
+    __imjr_skip_from(imj, IMJ_NONE);
+}
+
+static void __imjr_skip_obj(imj_t *imj) {
+    __imjr_skip_from(imj, IMJ_OBJECT);
+}
+
+static void __imjr_skip_arr(imj_t *imj) {
+    __imjr_skip_from(imj, IMJ_ARRAY);
+}
+
+static const char __imj_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 0xff for everything that isn't in the alphabet, '=' and '\\' included
+static const uint8_t __imj_base64_values[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,   62, 0xff, 0xff, 0xff,   63,
+      52,   53,   54,   55,   56,   57,   58,   59,   60,   61, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff,    0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,
+      15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,
+      41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+static size_t __imj_base64_length(size_t n) {
+    return (n + 2)/3*4;
+}
+
+// an upper bound on the bytes 'n' chars decode to, it's exact unless the text has escapes
+static size_t __imj_base64_decoded_length(const char *s, size_t n) {
+    while (n > 0 && s[n-1] == '=') --n;
+    return n/4*3 + (n%4 > 1 ? n%4 - 1 : 0);
+}
+
+// 'out' needs room for __imj_base64_length(n) chars, padding included
+static void __imj_base64_encode(const uint8_t *in, size_t n, char *out) {
+    size_t i = 0;
+
+#ifdef __IMJ_SSSE3
+    // 12 bytes become 16 chars, the load reads 4 past them so it stops short of the end
+    for (; n - i >= 16; i += 12, out += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(in + i));
+        chunk = _mm_shuffle_epi8(chunk, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+        // every 32 bit lane holds 3 bytes, spread into 4 bytes of 6 bits
+        __m128i ac = _mm_mulhi_epu16(_mm_and_si128(chunk, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i bd = _mm_mullo_epi16(_mm_and_si128(chunk, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i sextets = _mm_or_si128(ac, bd);
+
+        // the alphabet is 5 ranges, each a fixed offset from its sextets
+        __m128i range = _mm_subs_epu8(sextets, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), sextets), _mm_set1_epi8(13)));
+        __m128i offset = _mm_shuffle_epi8(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0), range);
+
+        _mm_storeu_si128((__m128i*)out, _mm_add_epi8(sextets, offset));
+    }
+#endif
+
+    for (; n - i >= 3; i += 3, out += 4) {
+        uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i+1] << 8 | in[i+2];
+        out[0] = __imj_base64_chars[v >> 18];
+        out[1] = __imj_base64_chars[(v >> 12) & 0x3f];
+        out[2] = __imj_base64_chars[(v >> 6) & 0x3f];
+        out[3] = __imj_base64_chars[v & 0x3f];
+    }
+
+    if (n - i > 0) {
+        uint32_t v = (uint32_t)in[i] << 16 | (n - i > 1 ? (uint32_t)in[i+1] << 8 : 0);
+        out[0] = __imj_base64_chars[v >> 18];
+        out[1] = __imj_base64_chars[(v >> 12) & 0x3f];
+        out[2] = n - i > 1 ? __imj_base64_chars[(v >> 6) & 0x3f] : '=';
+        out[3] = '=';
+    }
+}
+
+// padding is optional and "\/" reads as '/' since json writers may escape it
+// false when the text isn't base64 or doesn't fit 'cap'
+static bool __imj_base64_decode(const char *in, size_t n, uint8_t *out, size_t cap, size_t *length) {
+    size_t i = 0;
+    size_t o = 0;
+
+#ifdef __IMJ_SSSE3
+    // 16 chars become 12 bytes, anything unusual leaves the rest to the scalar loops
+    while (n - i >= 16 && cap - o >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(chunk, 4), _mm_set1_epi8(0x0f));
+        __m128i lo = _mm_and_si128(chunk, _mm_set1_epi8(0x0f));
+
+        // a char is in the alphabet when the classes of its nibbles share no bit
+        __m128i lo_class = _mm_shuffle_epi8(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a), lo);
+        __m128i hi_class = _mm_shuffle_epi8(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10), hi);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo_class, hi_class), _mm_setzero_si128())) != 0xffff) break;
+
+        // '+' and '/' share a high nibble, the compare moves '/' to its own offset
+        __m128i roll = _mm_shuffle_epi8(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+            _mm_add_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('/')), hi));
+        __m128i sextets = _mm_add_epi8(chunk, roll);
+
+        __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+        __m128i triples = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        __m128i bytes = _mm_shuffle_epi8(triples, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i*)(out + o), bytes);
+
+        i += 16;
+        o += 12;
+    }
+#endif
+
+    for (; n - i >= 4 && cap - o >= 3; i += 4, o += 3) {
+        uint32_t a = __imj_base64_values[(uint8_t)in[i]];
+        uint32_t b = __imj_base64_values[(uint8_t)in[i+1]];
+        uint32_t c = __imj_base64_values[(uint8_t)in[i+2]];
+        uint32_t d = __imj_base64_values[(uint8_t)in[i+3]];
+        if ((a | b | c | d) & 0x80) break;
+
+        uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        out[o] = (uint8_t)(v >> 16);
+        out[o+1] = (uint8_t)(v >> 8);
+        out[o+2] = (uint8_t)v;
+    }
+
+    // padding, escapes and whatever is left of the last group
+    uint32_t v = 0;
+    size_t have = 0;
+    for (; i < n && in[i] != '='; ++i) {
+        if (in[i] == '\\' && i + 1 < n && in[i+1] == '/') continue;
+
+        uint8_t value = __imj_base64_values[(uint8_t)in[i]];
+        if (value == 0xff) return false;
+
+        v = v << 6 | value;
+        if (++have == 4) {
+            if (cap - o < 3) return false;
+            out[o++] = (uint8_t)(v >> 16);
+            out[o++] = (uint8_t)(v >> 8);
+            out[o++] = (uint8_t)v;
+            v = 0;
+            have = 0;
+        }
+    }
+
+    size_t padding = n - i;
+    for (; i < n; ++i) {
+        if (in[i] != '=') return false;
+    }
+    if (have == 1 || (padding > 0 && (have == 0 || have + padding != 4))) return false;
+
+    if (have > 1) {
+        if (cap - o < have - 1) return false;
+        if (have == 2) {
+            out[o++] = (uint8_t)(v >> 4);
+        } else {
+            out[o++] = (uint8_t)(v >> 10);
+            out[o++] = (uint8_t)(v >> 2);
+        }
+    }
+
+    *length = o;
+    return true;
+}
+
+enum __imj_cbor_major_t {
+    __IMJ_CBOR_UINT = 0,
+    __IMJ_CBOR_NEGINT,
+    __IMJ_CBOR_BYTES,
+    __IMJ_CBOR_TEXT,
+    __IMJ_CBOR_ARRAY,
+    __IMJ_CBOR_MAP,
+    __IMJ_CBOR_TAG,
+    __IMJ_CBOR_SIMPLE,
+};
+
+// 'tag' is the last tag in front of the item, or UINT64_MAX when it has none
+static bool __imjr_cbor_head_tagged(imj_t *imj, uint8_t *initial, uint64_t *arg, uint64_t *tag) {
+    const char *end = imj->src.data + imj->src.length;
+    *tag = UINT64_MAX;
+
+    while (true) {
+        if (imj->current >= end) {
+            __imjr_parse_error(imj, "expected item before end of data");
+            return false;
+        }
+
+        uint8_t ib = (uint8_t)*imj->current;
+        uint8_t info = ib & 0x1f;
+        ++imj->current;
+
+        uint64_t a = info;
+        if (info >= 24) {
+            if (info > 27) {
+                __imjr_parse_error(imj, "indefinite length items are not supported");
+                return false;
+            }
+
+            size_t n = (size_t)1 << (info - 24);
+            if ((size_t)(end - imj->current) < n) {
+                __imjr_parse_error(imj, "item header cut off by end of data");
+                return false;
+            }
+
+            a = 0;
+            for (size_t i = 0; i < n; ++i) {
+                a = (a << 8) | (uint8_t)imj->current[i];
+            }
+            imj->current += n;
+        }
+
+        // tags only annotate the item that follows them
+        if ((ib >> 5) == __IMJ_CBOR_TAG) {
+            *tag = a;
+            continue;
+        }
+
+        *initial = ib;
+        *arg = a;
+        return true;
+    }
+}
+
+static bool __imjr_cbor_head(imj_t *imj, uint8_t *initial, uint64_t *arg) {
+    uint64_t tag;
+    return __imjr_cbor_head_tagged(imj, initial, arg, &tag);
+}
+
+static bool __imjr_cbor_payload(imj_t *imj, uint64_t length) {
+    if ((uint64_t)(imj->src.data + imj->src.length - imj->current) < length) {
+        __imjr_parse_error(imj, "string cut off by end of data");
+        return false;
+    }
+
+    imj->current += length;
+    return true;
+}
+
+// aggregates only add their items to what's left to skip, so nesting doesn't need a stack
+static void __imjr_cbor_skip_items(imj_t *imj, size_t count) {
+    size_t left = count;
+    while (left > 0 && !imj->had_error) {
+        --left;
+
+        uint8_t ib;
+        uint64_t arg;
+        if (!__imjr_cbor_head(imj, &ib, &arg)) return;
+
+        uint64_t items = 0;
+        switch (ib >> 5) {
+        case __IMJ_CBOR_BYTES:
+        case __IMJ_CBOR_TEXT: __imjr_cbor_payload(imj, arg); break;
+        case __IMJ_CBOR_ARRAY: items = arg; break;
+        case __IMJ_CBOR_MAP: items = arg > UINT64_MAX/2 ? UINT64_MAX : arg*2; break;
+        default: break;
+        }
+
+        // every item takes at least a byte
+        if (items > (uint64_t)(imj->src.data + imj->src.length - imj->current)) {
+            __imjr_parse_error(imj, "more items than data left");
+            return;
+        }
+
+        left += (size_t)items;
+    }
+}
+
+static void __imjr_cbor_skip(imj_t *imj) {
+    __imjr_cbor_skip_items(imj, 1);
+}
+
+static double __imj_half_to_double(uint16_t half) {
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+
+    double val;
+    if (exp == 0) val = ldexp(mant, -24);
+    else if (exp != 31) val = ldexp(mant + 1024, exp - 25);
+    else val = mant == 0 ? INFINITY : NAN;
+
+    return (half & 0x8000) ? -val : val;
+}
+
+static bool __imjr_cbor_read_val(imj_t *imj, imj_val_t *ret) {
+    *ret = (imj_val_t){0};
+
+    char *start = imj->current;
+    uint8_t ib;
+    uint64_t arg, tag;
+    if (!__imjr_cbor_head_tagged(imj, &ib, &arg, &tag)) return false;
+
+    switch (ib >> 5) {
+    case __IMJ_CBOR_UINT: {
+        ret->kind = IMJ_NUMBER;
+        ret->s = arg;
+        ret->i = (int64_t)arg;
+        ret->d = (double)arg;
+        ret->b = arg != 0;
+        ret->integral = true;
+        break;
+    }
+
+    case __IMJ_CBOR_NEGINT: {
+        ret->kind = IMJ_NUMBER;
+        ret->i = (int64_t)~arg;
+        ret->s = (uint64_t)ret->i;
+        ret->d = -1.0 - (double)arg;
+        ret->b = true;
+        ret->integral = true;
+        break;
+    }
+
+    case __IMJ_CBOR_BYTES: {
+        const uint8_t *bytes = (const uint8_t *)imj->current;
+        if (!__imjr_cbor_payload(imj, arg)) return false;
+        ret->kind = IMJ_NONE;
+
+        // bignums are big-endian magnitudes, 2 for n and 3 for -1-n
+        // ones that fit 64 bits read exactly like the plain integer heads, larger ones are out of range as doubles
+        if (tag == 2 || tag == 3) {
+            uint64_t n = 0;
+            double d = 0;
+            size_t significant = 0;
+            for (uint64_t i = 0; i < arg; ++i) {
+                if (significant > 0 || bytes[i] != 0) ++significant;
+                n = (n << 8) | bytes[i];
+                d = d*256.0 + bytes[i];
+            }
+
+            bool negative = tag == 3;
+            ret->kind = IMJ_NUMBER;
+            ret->d = negative ? -1.0 - d : d;
+            ret->b = negative || d != 0;
+            ret->integral = significant <= 8;
+            ret->i = negative ? (int64_t)~n : (int64_t)n;
+            ret->s = negative ? (uint64_t)ret->i : n;
+        }
+        break;
+    }
+
+    case __IMJ_CBOR_TEXT: {
+        ret->kind = IMJ_STRING;
+        ret->sv.data = imj->current;
+        ret->sv.length = (size_t)arg;
+        if (!__imjr_cbor_payload(imj, arg)) return false;
+        break;
+    }
+
+    case __IMJ_CBOR_ARRAY:
+    case __IMJ_CBOR_MAP: {
+        imj->current = start;
+        __imjr_cbor_skip(imj);
+        ret->kind = (ib >> 5) == __IMJ_CBOR_MAP ? IMJ_OBJECT : IMJ_ARRAY;
+        break;
+    }
+
+    case __IMJ_CBOR_SIMPLE: {
+        switch (ib & 0x1f) {
+        case 20: case 21: {
+            ret->kind = IMJ_BOOL;
+            ret->b = (ib & 0x1f) == 21;
+            ret->s = (size_t)ret->b;
+            ret->i = (long)ret->b;
+            ret->d = (double)ret->b;
+            break;
+        }
+
+        case 22: case 23: ret->kind = IMJ_NULL; break;
+
+        case 25: case 26: case 27: {
+            double d;
+            if ((ib & 0x1f) == 25) {
+                d = __imj_half_to_double((uint16_t)arg);
+            } else if ((ib & 0x1f) == 26) {
+                uint32_t bits = (uint32_t)arg;
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                d = f;
+            } else {
+                memcpy(&d, &arg, sizeof(d));
+            }
+
+            ret->kind = IMJ_NUMBER;
+            ret->d = d;
+            ret->b = d != 0;
+            break;
+        }
+
+        default: {
+            __imjr_parse_error(imj, "unsupported simple value");
+            return false;
+        }
+        }
+        break;
+    }
+    }
+
+    // numbers keep their encoded span, tags included, like json numbers keep their text
+    if (ret->kind == IMJ_NUMBER) {
+        ret->sv.data = start;
+        ret->sv.length = imj->current - start;
+    }
+
+    return true;
+}
+
+static bool __imjr_cbor_begin_agg(imj_t *imj, uint8_t major, size_t *length) {
+    *length = 0;
+    if (!imj->value_pending) return false;
+
+    char *start = imj->current;
+    uint8_t ib;
+    uint64_t arg;
+    if (!__imjr_cbor_head(imj, &ib, &arg)) return false;
+
+    if ((ib >> 5) != major) {
+        imj->current = start;
+        __imjr_cbor_skip(imj);
+        return false;
+    }
+
+    *length = (size_t)arg;
+    return true;
+}
+
+static void __imj_dive_into_arr(imj_t *imj, bool use_left_off) {
+    imj_lvl_t *arr = __imj_alloc_lvl(imj);
+    *arr = (imj_lvl_t){0};
+    arr->type = IMJ_ARRAY;
+    arr->prev = imj->lvl_or_null;
+    arr->left_off_or_null = use_left_off ? imj->current : NULL;
+    imj->lvl_or_null = arr;
+    __IMJ_PROFILE_PUSHED(imj, arr);
+    ++imj->indent_lvl;
+}
+
+static void __imjr_update_array_if_necessary(imj_t *imj) {
+    if (imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT) {
+        imj->lvl_or_null->value_end = imj->current;
+        return;
+    }
+
+    if (imj->lvl_or_null && imj->lvl_or_null->type == IMJ_ARRAY) {
+        ++imj->lvl_or_null->count;
+
+        if (imj->encoding == IMJ_ENCODING_CBOR) {
+            if (imj->lvl_or_null->remaining > 0) --imj->lvl_or_null->remaining;
+            imj->value_pending = imj->lvl_or_null->remaining > 0;
+            return;
+        }
+
+        __imjr_skip_whitespace(imj);
+        if (__imjr_match(imj, ',')) {
+            imj->value_pending = true;
+            __imjr_skip_whitespace(imj);
+        } else {
+            imj->value_pending = false;
+        }
+    }
+}
+
+static bool __imjr_begin_arr(imj_t *imj) {
+    if (imj->had_error) return false;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(!imj->lvl_or_null || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot begin array directly inside object");
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        size_t length;
+        bool entered = __imjr_cbor_begin_agg(imj, __IMJ_CBOR_ARRAY, &length);
+        __imj_dive_into_arr(imj, entered);
+        __imjr_check_depth(imj);
+        imj->lvl_or_null->remaining = length;
+        imj->value_pending = length > 0;
+        return entered;
+    }
+
+    __imjr_skip_whitespace(imj);
+
+    char *open = imj->current;
+
+    imj->value_pending = true;
+    bool entered = false;
+    if (!__imjr_match(imj, '[')) {
+        imj->value_pending = false;
+    } else {
+        __imjr_skip_whitespace(imj);
+        imj->value_pending = __imjr_peek(imj) != ']';
+        entered = true;
+    }
+
+    __imj_dive_into_arr(imj, entered);
+    __imjr_check_depth(imj);
+    if (entered) imj->lvl_or_null->node = __imj_doc_find(imj, open);
+
+    return entered;
+}
+
+// a fixed buffer is never grown, false when 'n' more bytes don't fit
+static bool __imjw_sb_reserve(imj_sb_t *sb, size_t n, imj_arena_t *arena) {
+    if (sb->count + n <= sb->capacity) return true;
+
+    // a fixed buffer that already overflowed has lost data, it only keeps counting
+    if (sb->sink && sb->count > 0 && sb->count <= sb->capacity) {
+        sb->sink(sb->sink_user, sb->items, sb->count);
+        sb->count = 0;
+        if (n <= sb->capacity) return true;
+    }
+
+    if (sb->fixed) return false;
+
+    size_t new_cap = sb->capacity == 0 ? 8 : sb->capacity*2;
+    while (new_cap < sb->count + n) new_cap *= 2;
+    sb->items = __imj_arena_realloc(arena, sb->items, sb->capacity, new_cap);
+    sb->capacity = new_cap;
+    return true;
+}
+
+static char *__imjw_sb_extend(imj_sb_t *sb, size_t n, imj_arena_t *arena) {
+    if (!__imjw_sb_reserve(sb, n, arena)) {
+        sb->count += n;
+        return NULL;
+    }
+
+    char *tail = sb->items + sb->count;
+    sb->count += n;
+    return tail;
+}
+
+static void __imjw_sb_add_str(imj_sb_t *sb, const char *s, size_t n, imj_arena_t *arena) {
+    if (n == 0) return;
+    char *tail = __imjw_sb_extend(sb, n, arena);
+    if (tail) memcpy(tail, s, n);
+}
+
+static size_t __imjw_jsonstr_length(const char *s, size_t n) {
+    size_t length = n + 2;
+    for (size_t i = 0; i < n; ++i) {
+        switch (s[i]) {
+        case '"': case '\\': case '/': case '\b': case '\f': case '\n': case '\r': case '\t': ++length; break;
+        case '\v': case '\a': --length; break;
+        default: break;
+        }
+    }
+    return length;
+}
+
+static void __imjw_sb_add_str_as_jsonstr(imj_sb_t *sb, const char *s, size_t n, imj_arena_t *arena) {
+    // every character escapes to at most two, past that only a fixed buffer needs the exact length
+    if (!__imjw_sb_reserve(sb, 2*n + 2, arena)) {
+        size_t length = __imjw_jsonstr_length(s, n);
+        if (!__imjw_sb_reserve(sb, length, arena)) {
+            sb->count += length;
+            return;
+        }
+    }
+
+    char *out = sb->items + sb->count;
+    *out++ = '"';
+    for (char *c = (char*)s; c < s+n; ++c) {
+        if ((unsigned char)*c > 127) {
+            __imj_assert(false, "unicode is not supported yet");
+            break;
+        }
+
+        switch (*c) {
+        case '"': *out++ = '\\'; *out++ = '"'; break;
+        case '\\': *out++ = '\\'; *out++ = '\\'; break;
+        case '/': *out++ = '\\'; *out++ = '/'; break;
+        case '\b': *out++ = '\\'; *out++ = 'b'; break;
+        case '\f': *out++ = '\\'; *out++ = 'f'; break;
+        case '\n': *out++ = '\\'; *out++ = 'n'; break;
+        case '\r': *out++ = '\\'; *out++ = 'n'; break;
+        case '\t': *out++ = '\\'; *out++ = 't'; break;
+        case '\v': case '\a': {
+            __imj_assert(false, "unsupported escape sequences");
+            break;
+        }
+        default: *out++ = *c; break;
+        }
+    }
+    *out++ = '"';
+
+    sb->count = out - sb->items;
+}
+
+static void __imjw_sb_add_indent(imj_t *imj) {
+    size_t n = imj->indent_lvl*imj->indent_size;
+    if (n == 0) return;
+
+    char *tail = __imjw_sb_extend(&imj->sb, n, &imj->arena);
+    if (tail) memset(tail, ' ', n);
+}
+
+static void __imjw_cbor_head(imj_t *imj, uint8_t major, uint64_t arg) {
+    char buffer[9];
+    size_t n = 0;
+
+    if (arg < 24) {
+        buffer[n++] = (char)((major << 5) | arg);
+    } else {
+        size_t size = arg <= 0xff ? 1 : arg <= 0xffff ? 2 : arg <= 0xffffffff ? 4 : 8;
+        buffer[n++] = (char)((major << 5) | (size == 1 ? 24 : size == 2 ? 25 : size == 4 ? 26 : 27));
+        for (size_t i = size; i > 0; --i) {
+            buffer[n++] = (char)(arg >> ((i-1)*8));
+        }
+    }
+
+    __imjw_sb_add_str(&imj->sb, buffer, n, &imj->arena);
+}
+
+static void __imjw_put_null(imj_t *imj) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: __imjw_sb_add_str(&imj->sb, "null", 4, &imj->arena); break;
+    case IMJ_ENCODING_CBOR: __imjw_sb_add_str(&imj->sb, "\xf6", 1, &imj->arena); break;
+    }
+}
+
+static void __imjw_put_bool(imj_t *imj, bool val) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        __imjw_sb_add_str(&imj->sb,
+            val ? "true" : "false",
+            val ? 4 : 5,
+            &imj->arena);
+        break;
+    }
+    case IMJ_ENCODING_CBOR: __imjw_sb_add_str(&imj->sb, val ? "\xf5" : "\xf4", 1, &imj->arena); break;
+    }
+}
+
+static void __imjw_put_int(imj_t *imj, long long val) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        char buffer[24];
+        int len = sprintf(buffer, "%lld", val);
+        __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+        break;
+    }
+    case IMJ_ENCODING_CBOR: {
+        if (val < 0) __imjw_cbor_head(imj, __IMJ_CBOR_NEGINT, ~(uint64_t)val);
+        else __imjw_cbor_head(imj, __IMJ_CBOR_UINT, (uint64_t)val);
+        break;
+    }
+    }
+}
+
+static void __imjw_put_uint(imj_t *imj, unsigned long long val) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        char buffer[24];
+        int len = sprintf(buffer, "%llu", val);
+        __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+        break;
+    }
+    case IMJ_ENCODING_CBOR: __imjw_cbor_head(imj, __IMJ_CBOR_UINT, (uint64_t)val); break;
+    }
+}
+
+static void __imjw_put_float(imj_t *imj, float val) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        char buffer[32];
+        int len = sprintf(buffer, "%g", val);
+        __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+        break;
+    }
+    case IMJ_ENCODING_CBOR: {
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        __imjw_sb_add_str(&imj->sb, "\xfa", 1, &imj->arena);
+        char *p = __imjw_sb_extend(&imj->sb, 4, &imj->arena);
+        for (size_t i = 0; p && i < 4; ++i) p[i] = (char)(bits >> ((3-i)*8));
+        break;
+    }
+    }
+}
+
+static void __imjw_put_double(imj_t *imj, double val) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        char buffer[32];
+        int len = sprintf(buffer, "%g", val);
+        __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+        break;
+    }
+    case IMJ_ENCODING_CBOR: {
+        uint64_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        __imjw_sb_add_str(&imj->sb, "\xfb", 1, &imj->arena);
+        char *p = __imjw_sb_extend(&imj->sb, 8, &imj->arena);
+        for (size_t i = 0; p && i < 8; ++i) p[i] = (char)(bits >> ((7-i)*8));
+        break;
+    }
+    }
+}
+
+static void __imjw_put_str(imj_t *imj, const char *s, size_t n) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: __imjw_sb_add_str_as_jsonstr(&imj->sb, s, n, &imj->arena); break;
+    case IMJ_ENCODING_CBOR: {
+        __imjw_cbor_head(imj, __IMJ_CBOR_TEXT, n);
+        __imjw_sb_add_str(&imj->sb, s, n, &imj->arena);
+        break;
+    }
+    }
+}
+
+// 'sv' is the escaped contents of a json string
+static void __imjw_put_rawstr(imj_t *imj, imj_sv_t sv) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        char *p = __imjw_sb_extend(&imj->sb, sv.length + 2, &imj->arena);
+        if (p) {
+            p[0] = '"';
+            if (sv.length > 0) memcpy(p + 1, sv.data, sv.length);
+            p[sv.length + 1] = '"';
+        }
+        break;
+    }
+    case IMJ_ENCODING_CBOR: {
+        size_t length = 0;
+        __imj_unescape(sv, NULL, 0, &length);
+        __imjw_cbor_head(imj, __IMJ_CBOR_TEXT, length);
+        char *p = __imjw_sb_extend(&imj->sb, length, &imj->arena);
+        if (p) __imj_unescape(sv, p, length, NULL);
+        break;
+    }
+    }
+}
+
+static void __imjw_put_bytes(imj_t *imj, const void *data, size_t n) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: {
+        // base64 needs no escaping so it's encoded straight into the output
+        size_t length = __imj_base64_length(n);
+        char *p = __imjw_sb_extend(&imj->sb, length + 2, &imj->arena);
+        if (p == NULL) break;
+
+        p[0] = '"';
+        __imj_base64_encode(data, n, p + 1);
+        p[length + 1] = '"';
+        break;
+    }
+    case IMJ_ENCODING_CBOR: {
+        __imjw_cbor_head(imj, __IMJ_CBOR_BYTES, n);
+        __imjw_sb_add_str(&imj->sb, data, n, &imj->arena);
+        break;
+    }
+    }
+}
+
+static void __imjw_put_open(imj_t *imj, imj_val_kind_t kind) {
+    switch (imj->encoding) {
+    case IMJ_ENCODING_JSON: __imjw_sb_add_str(&imj->sb, kind == IMJ_OBJECT ? "{" : "[", 1, &imj->arena); break;
+    case IMJ_ENCODING_CBOR: {
+        // the length is unknown until the end so it's patched in then
+        imj->lvl_or_null->head_at = imj->sb.count;
+        __imjw_sb_add_str(&imj->sb, kind == IMJ_OBJECT ? "\xba\0\0\0\0" : "\x9a\0\0\0\0", 5, &imj->arena);
+        break;
+    }
+    }
+}
+
+static void __imjw_cbor_patch_length(imj_t *imj, size_t head_at, size_t length) {
+    __imj_assert(length <= 0xffffffff, "too many items for a cbor aggregate");
+    if (head_at + 5 > imj->sb.capacity) return;
+
+    char *p = imj->sb.items + head_at + 1;
+    for (size_t i = 0; i < 4; ++i) p[i] = (char)(length >> ((3-i)*8));
+}
+
+static void __imjw_add_comma_and_ws_if_necessary(imj_t *imj) {
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        if (imj->lvl_or_null && imj->lvl_or_null->type != IMJ_KEY_VALUE) ++imj->lvl_or_null->count;
+        return;
+    }
+
+    if (imj->lvl_or_null) {
+        switch (imj->lvl_or_null->type) {
+        case IMJ_KEY_VALUE: break;
+        case IMJ_ARRAY:
+        case IMJ_OBJECT: {
+            if (imj->lvl_or_null->count == 0) {
+                switch (imj->render_style) {
+                case IMJ_STYLE_MIN: break;
+                case IMJ_STYLE_SINGLE_LINE: {
+                    __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
+                    break;
+                }
+                case IMJ_STYLE_PRETTY: {
+                    __imjw_sb_add_str(&imj->sb, "\n", 1, &imj->arena);
+                    __imjw_sb_add_indent(imj);
+                    break;
+                }
+                }
+            } else {
+                switch (imj->render_style)  {
+                case IMJ_STYLE_MIN: {
+                    __imjw_sb_add_str(&imj->sb, ",", 1, &imj->arena);
+                    break;
+                }
+                case IMJ_STYLE_SINGLE_LINE: {
+                    __imjw_sb_add_str(&imj->sb, ", ", 2, &imj->arena);
+                    break;
+                }
+                case IMJ_STYLE_PRETTY: {
+                    __imjw_sb_add_str(&imj->sb, ",\n", 2, &imj->arena);
+                    __imjw_sb_add_indent(imj);
+                    break;
+                }
+                }
+            }
+
+            ++imj->lvl_or_null->count;
+            break;
+        }
+        default: __imj_assert(false, "invalid lvl type for writing"); break;
+        }
+    }
+}
+
+static void __imjw_begin_arr(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    __imj_dive_into_arr(imj, false);
+
+    __imjw_put_open(imj, IMJ_ARRAY);
+}
+
+bool imj_begin_arr(imj_t *imj) {
+    __IMJ_PROFILE_MARK(imj);
+
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_begin_arr(imj);
+        break;
+    }
+    case IMJ_WRITE: {
+        __imjw_begin_arr(imj);
+        break;
+    }
+    case IMJ_PATCH: {
+        success = __imjp_begin_agg(imj, IMJ_ARRAY);
+        break;
+    }
+    }
+
+    __IMJ_PROFILE_ENTER(imj, NULL, 0);
+    return success;
+}
+
+static bool __imjr_begin_arr_ex(imj_t *imj, size_t *count) {
+    if (imj->had_error) return false;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(!imj->lvl_or_null || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot begin array directly inside object");
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        bool entered = __imjr_cbor_begin_agg(imj, __IMJ_CBOR_ARRAY, count);
+        __imj_dive_into_arr(imj, entered);
+        __imjr_check_depth(imj);
+        imj->lvl_or_null->remaining = *count;
+        imj->value_pending = *count > 0;
+        return entered;
+    }
+
+    __imjr_skip_whitespace(imj);
+
+    char *open = imj->current;
+    const imj_doc_node_t *node = __imj_doc_find(imj, open);
+
+    bool value_pending = true;
+    bool entered = false;
+    if (!__imjr_match(imj, '[')) {
+        *count = 0;
+        value_pending = false;
+    } else if (node) {
+        __imjr_skip_whitespace(imj);
+        *count = node->count;
+        imj->value_pending = __imjr_peek(imj) != ']';
+        entered = true;
+    } else {
+        __imjr_skip_whitespace(imj);
+
+        char *start = imj->current;
+
+        entered = true;
+        size_t seeked_count = 0;
+
+        while (true) {
+            __imjr_skip_whitespace(imj);
+
+            if (__imjr_peek(imj) == '\0') {
+                __imjr_parse_error(imj, "expected ']' before end of file");
+                *count = 0;
+                break;
+            }
+
+            if (__imjr_peek(imj) == ']') {
+                break;
+            }
+
+            __imjr_skip_value(imj);
+            __imjr_skip_whitespace(imj);
+            ++seeked_count;
+
+            if (__imjr_match(imj, ',')) {
+                __imjr_skip_whitespace(imj);
+
+                if (__imjr_peek(imj) == ']') {
+                    __imjr_parse_error(imj, "cannot use comma before closing array");
+                    return false;
+                }
+            } else {
+                if (__imjr_peek(imj) != ']') {
+                    __imjr_parse_error(imj, "expected ']' to close array");
+                    return false;
+                }
+
+                __imjr_skip_whitespace(imj);
+            }
+        }
+
+        *count = seeked_count;
+
+        __imjr_skip_whitespace(imj);
+        imj->value_pending = value_pending && __imjr_match(imj, ']');
+        imj->current = start;
+    }
+
+    __imj_dive_into_arr(imj, entered);
+    __imjr_check_depth(imj);
+    if (entered) imj->lvl_or_null->node = node;
+
+    return entered;
+}
+
+bool imj_begin_arr_ex(imj_t *imj, size_t *count) {
+    __IMJ_PROFILE_MARK(imj);
+
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_begin_arr_ex(imj, count);
+        break;
+    }
+    case IMJ_WRITE: {
+        __imjw_begin_arr(imj);
+        break;
+    }
+    case IMJ_PATCH: {
+        success = __imjp_begin_agg(imj, IMJ_ARRAY);
+        break;
+    }
+    }
+
+    __IMJ_PROFILE_ENTER(imj, NULL, 0);
+    return success;
+}
+
+static void __imjr_end_arr(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_ARRAY, "ending array not inside of array");
+
+    char *unvisited = imj->value_pending ? imj->current : NULL;
+
+    if (imj->lvl_or_null->left_off_or_null) {
+        if (imj->encoding == IMJ_ENCODING_CBOR) {
+            __imjr_cbor_skip_items(imj, imj->lvl_or_null->remaining);
+        } else if (imj->lvl_or_null->node) {
+            imj->current = (char*)imj->src.data + imj->lvl_or_null->node->close + 1;
+        } else {
+            __imjr_skip_whitespace(imj);
+            __imjr_skip_arr(imj);
+        }
+
+        if (__imj_io_mode(imj) == IMJ_PATCH) __imjp_close(imj, unvisited);
+    }
+
+    __imj_pop_lvl(imj);
+    --imj->indent_lvl;
+
+    if (imj->lvl_or_null) {
+        if (imj->lvl_or_null->type == IMJ_KEY_VALUE) {
+            __imj_pop_lvl(imj);
+        }
+
+        __imjr_update_array_if_necessary(imj);
+    }
+}
+
+static void __imjw_pop_necessary_lvls_after_val(imj_t *imj) {
+    if (imj->lvl_or_null) {
+        switch (imj->lvl_or_null->type) {
+        case IMJ_ARRAY: break;
+        case IMJ_KEY_VALUE: {
+            __imj_pop_lvl(imj);
+            break;
+        }
+        case IMJ_OBJECT: {
+            __imj_assert(false, "invalid level");
+            break;
+        }
+
+        default: __imj_assert(false, "invalid enum as level"); break;
+        }
+    }
+}
+
+static void __imjw_end_arr(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_ARRAY, "must be inside array to exit");
+
+    size_t item_count = imj->lvl_or_null->count;
+    size_t head_at = imj->lvl_or_null->head_at;
+
+    __imj_pop_lvl(imj);
+    --imj->indent_lvl;
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        __imjw_cbor_patch_length(imj, head_at, item_count);
+        return;
+    }
+
+    if (item_count > 0) {
+        switch (imj->render_style) {
+        case IMJ_STYLE_MIN: break;
+        case IMJ_STYLE_SINGLE_LINE: {
+            __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
+            break;
+        }
+        case IMJ_STYLE_PRETTY: {
+            __imjw_sb_add_str(&imj->sb, "\n", 1, &imj->arena);
+            __imjw_sb_add_indent(imj);
+            break;
+        }
+        }
+    }
+
+    
+    __imjw_sb_add_str(&imj->sb, "]", 1, &imj->arena);
+}
+
+void imj_end_arr(imj_t *imj) {
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        __imjr_end_arr(imj);
+        break;
+    }
+    case IMJ_WRITE: {
+        __imjw_end_arr(imj);
+        break;
+    }
+    case IMJ_PATCH: {
+        __imjp_end_agg(imj, IMJ_ARRAY);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+}
+
+static imj_lvl_t *__imj_dive_into_obj(imj_t *imj) {
+    imj_lvl_t *obj = __imj_alloc_lvl(imj);
+    *obj = (imj_lvl_t){0};
+    obj->type = IMJ_OBJECT;
+    obj->prev = imj->lvl_or_null;
+    imj->lvl_or_null = obj;
+    __IMJ_PROFILE_PUSHED(imj, obj);
+
+    ++imj->indent_lvl;
+
+    return obj;
 }
 
 static bool __imjr_begin_obj(imj_t *imj) {
@@ -1047,999 +4295,4021 @@ static bool __imjr_begin_obj(imj_t *imj) {
     }
 
     __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(!imj->lvl_or_null || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot start object directly inside object");
+    __imj_assert(!imj->lvl_or_null || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot start object directly inside object");
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        size_t length;
+        bool entered = __imjr_cbor_begin_agg(imj, __IMJ_CBOR_MAP, &length);
+        imj_lvl_t *obj = __imj_dive_into_obj(imj);
+        __imjr_check_depth(imj);
+        obj->left_off_or_null = entered ? imj->current : NULL;
+        obj->remaining = length;
+        return entered;
+    }
+
+    imj_lvl_t *obj = __imj_dive_into_obj(imj);
+    __imjr_check_depth(imj);
+
+    bool incorrect_pending_value = imj->value_pending && __imjr_peek(imj) != '{';
+    bool is_at_root = imj->lvl_or_null->prev == NULL;
+    if (incorrect_pending_value || (!is_at_root && !imj->value_pending)) {
+        obj->left_off_or_null = NULL;
+        return false;
+    }
+
+    __imjr_skip_whitespace(imj);
+
+    char *open = imj->current;
+
+    if (!__imjr_consume(imj, '{')) {
+        __imjr_parse_error(imj, "expected '{' for object");
+    }
+
+    __imjr_skip_whitespace(imj);
+
+    obj->left_off_or_null = imj->current;
+    // learning shapes allocates, so it's off for fixed scratch
+    obj->shape = imj->arena.fixed ? NULL : &__imj_shapes(imj)->root;
+
+    obj->node = __imj_doc_find(imj, open);
+    if (obj->node) {
+        // every key is already known, a key missing from them is never scanned for
+        // capacity matches count so a push copies them out of the shared document first
+        obj->keys = (imj_keys_t){ .items = obj->node->keys, .count = obj->node->count, .capacity = obj->node->count };
+        obj->left_off_or_null = (char*)imj->src.data + obj->node->close;
+    }
+
+    return true;
+}
+
+static void __imjw_begin_obj(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    __imj_dive_into_obj(imj);
+
+    __imjw_put_open(imj, IMJ_OBJECT);
+}
+
+bool imj_begin_obj(imj_t *imj) {
+    __IMJ_PROFILE_MARK(imj);
+
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_begin_obj(imj);
+        break;
+    }
+    case IMJ_WRITE: {
+        __imjw_begin_obj(imj);
+        break;
+    }
+    case IMJ_PATCH: {
+        success = __imjp_begin_agg(imj, IMJ_OBJECT);
+        break;
+    }
+    }
+
+    __IMJ_PROFILE_ENTER(imj, NULL, 0);
+    return success;
+}
+
+static bool __imjr_begin_obj_ex(imj_t *imj, size_t *count) {
+    *count = 0;
+
+    bool entered = __imjr_begin_obj(imj);
+    if (!entered || imj->had_error) return entered;
+
+    imj_lvl_t *obj = imj->lvl_or_null;
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        *count = obj->remaining;
+        return true;
+    }
+
+    if (obj->node) {
+        *count = obj->node->count;
+        return true;
+    }
+
+    size_t seeked_count = 0;
+    while (__imjr_match(imj, '\"')) {
+        imj_sv_t name;
+        if (!__imjr_read_str(imj, &name)) break;
+
+        __imjr_skip_whitespace(imj);
+        if (!__imjr_consume(imj, ':')) {
+            __imjr_parse_error(imj, "expected ':' after key");
+            break;
+        }
+
+        __imjr_skip_whitespace(imj);
+        __imjr_skip_value(imj);
+        __imjr_skip_whitespace(imj);
+        ++seeked_count;
+
+        if (!__imjr_match(imj, ',')) break;
+        __imjr_skip_whitespace(imj);
+    }
+
+    *count = seeked_count;
+    imj->current = obj->left_off_or_null;
+    return true;
+}
+
+bool imj_begin_obj_ex(imj_t *imj, size_t *count) {
+    __IMJ_PROFILE_MARK(imj);
+
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_begin_obj_ex(imj, count);
+        break;
+    }
+    case IMJ_WRITE: {
+        __imjw_begin_obj(imj);
+        break;
+    }
+    case IMJ_PATCH: {
+        success = __imjp_begin_agg(imj, IMJ_OBJECT);
+        break;
+    }
+    }
+
+    __IMJ_PROFILE_ENTER(imj, NULL, 0);
+    return success;
+}
+
+static void __imjr_end_obj(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "cannot end object without being inside an object");
+
+    if (imj->lvl_or_null->left_off_or_null) {
+        imj->current = imj->lvl_or_null->left_off_or_null;
+        if (imj->encoding == IMJ_ENCODING_CBOR) {
+            __imjr_cbor_skip_items(imj, imj->lvl_or_null->remaining*2);
+        } else {
+            __imjr_skip_obj(imj);
+        }
+
+        if (__imj_io_mode(imj) == IMJ_PATCH) __imjp_close(imj, NULL);
+    }
+
+    __imj_pop_lvl(imj);
+    --imj->indent_lvl;
+
+    if (imj->lvl_or_null) {
+        if (imj->lvl_or_null->type == IMJ_KEY_VALUE) {
+            __imj_pop_lvl(imj);
+        }
+
+        __imjr_update_array_if_necessary(imj);
+    }
+}
+
+static void __imjw_end_obj(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null->type == IMJ_OBJECT, "must be inside array to exit");
+
+    size_t key_value_count = imj->lvl_or_null->count;
+    size_t head_at = imj->lvl_or_null->head_at;
+    __imj_pop_lvl(imj);
+    --imj->indent_lvl;
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        __imjw_cbor_patch_length(imj, head_at, key_value_count);
+        return;
+    }
+
+    if (key_value_count > 0) {
+        switch (imj->render_style) {
+        case IMJ_STYLE_MIN: break;
+        case IMJ_STYLE_SINGLE_LINE: {
+            __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
+            break;
+        }
+        case IMJ_STYLE_PRETTY: {
+            __imjw_sb_add_str(&imj->sb, "\n", 1, &imj->arena);
+            __imjw_sb_add_indent(imj);
+            break;
+        }
+        }
+    }
+
+    __imjw_sb_add_str(&imj->sb, "}", 1, &imj->arena);
+}
+
+void imj_end_obj(imj_t *imj) {
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        __imjr_end_obj(imj);
+        break;
+    }
+    case IMJ_WRITE: {
+        __imjw_end_obj(imj);
+        break;
+    }
+    case IMJ_PATCH: {
+        __imjp_end_agg(imj, IMJ_OBJECT);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+}
+
+static void __imj_dive_into_key(imj_t *imj, bool value_pending) {
+    imj_lvl_t *lvl = __imj_alloc_lvl(imj);
+    *lvl = (imj_lvl_t){0};
+    lvl->type = IMJ_KEY_VALUE;
+    lvl->prev = imj->lvl_or_null;
+    imj->lvl_or_null = lvl;
+    __IMJ_PROFILE_PUSHED(imj, lvl);
+    imj->value_pending = value_pending;
+}
+
+static bool __imj_key_eq(imj_sv_t name, const char *key, size_t key_length) {
+    return name.length == key_length && memcmp(name.data, key, key_length) == 0;
+}
+
+static imj_shape_t *__imj_shape_next(imj_t *imj, imj_shape_t *shape, imj_sv_t key) {
+    if (shape == NULL) return NULL;
+
+    imj_shapes_t *shapes = __imj_shapes(imj);
+    ++shapes->misses;
+
+    imj_shape_t *prev = NULL;
+    imj_shape_t *next = shape->child;
+    while (next && !__imj_key_eq(next->key, key.data, key.length)) {
+        prev = next;
+        next = next->sibling;
+    }
+
+    if (next == NULL) {
+        if (shapes->node_count >= IMJ_SHAPES_MAX_NODES) return NULL;
+        ++shapes->node_count;
+
+        char *name = __imj_arena_alloc(&shapes->arena, key.length + 1);
+        memcpy(name, key.data, key.length);
+        name[key.length] = '\0';
+
+        next = __imj_arena_alloc(&shapes->arena, sizeof(imj_shape_t));
+        *next = (imj_shape_t){0};
+        next->key = (imj_sv_t){ .data = name, .length = key.length };
+    } else if (prev) {
+        prev->sibling = next->sibling;
+    } else {
+        return next;
+    }
+
+    // the most recent transition is the one predicted next time
+    next->sibling = shape->child;
+    shape->child = next;
+    return next;
+}
+
+static bool __imjr_read_key(imj_t *imj, imj_lvl_t *obj, imj_sv_t *ret) {
+    imj_shape_t *predicted = obj->shape ? obj->shape->child : NULL;
+
+    if (predicted) {
+        size_t n = predicted->key.length;
+        size_t left = imj->src.data + imj->src.length - imj->current;
+        if (left > n && imj->current[n] == '"' && memcmp(imj->current, predicted->key.data, n) == 0) {
+            *ret = (imj_sv_t){
+                .data = imj->current,
+                .length = n,
+            };
+
+            imj->current += n + 1;
+            obj->shape = predicted;
+            ++__imj_shapes(imj)->hits;
+            return true;
+        }
+    }
+
+    if (!__imjr_read_str(imj, ret)) return false;
+
+    obj->shape = __imj_shape_next(imj, obj->shape, *ret);
+    return true;
+}
+
+// moves past the value at current and whatever separates it from the next key
+static bool __imjr_pass_key_value(imj_t *imj, imj_lvl_t *obj) {
+    // a value that was already read ended at value_end, so it isn't scanned a second time
+    bool was_read = obj->value_end > imj->current;
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        if (was_read) imj->current = obj->value_end;
+        else __imjr_cbor_skip(imj);
+        if (imj->had_error) return false;
+
+        --obj->remaining;
+        obj->left_off_or_null = imj->current;
+        return true;
+    }
+
+    if (was_read) imj->current = obj->value_end;
+    else __imjr_skip_value(imj);
+
+    __imjr_skip_whitespace(imj);
+
+    if (__imjr_match(imj, ',')) {
+        __imjr_skip_whitespace(imj);
+        if (__imjr_peek(imj) == '}') {
+            __imjr_parse_error(imj, "cannot end object with ','");
+            return false;
+        }
+    }
+
+    obj->left_off_or_null = imj->current;
+    return !imj->had_error;
+}
+
+// reads the key at left_off into the key cache and leaves current at its value, false at the end of the object
+static bool __imjr_scan_key(imj_t *imj, imj_lvl_t *obj, imj_key_t *ret) {
+    imj->current = obj->left_off_or_null;
+
+    // the last key found was never passed, so it isn't scanned twice
+    if (obj->keys.count > 0 && obj->keys.items[obj->keys.count-1].loc > obj->left_off_or_null) {
+        imj->current = obj->keys.items[obj->keys.count-1].loc;
+        if (!__imjr_pass_key_value(imj, obj)) return false;
+    }
+
+    imj_sv_t key_name;
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        if (obj->remaining == 0) return false;
+
+        uint8_t ib;
+        uint64_t arg;
+        if (!__imjr_cbor_head(imj, &ib, &arg)) return false;
+
+        if ((ib >> 5) != __IMJ_CBOR_TEXT) {
+            __imjr_parse_error(imj, "only text keys are supported");
+            return false;
+        }
+
+        key_name = (imj_sv_t){
+            .data = imj->current,
+            .length = (size_t)arg,
+        };
+
+        if (!__imjr_cbor_payload(imj, arg)) return false;
+    } else {
+        if (__imjr_peek(imj) == '}') {
+            ++imj->current;
+            return false;
+        }
+
+        if (__imjr_peek(imj) == '\0') {
+            __imjr_parse_error(imj, "object needs '}' to close");
+            return false;
+        }
+
+        if (!__imjr_match(imj, '\"')) {
+            __imjr_parse_error(imj, "unexpected character.");
+            return false;
+        }
+
+        if (!__imjr_read_key(imj, obj, &key_name)) return false;
+
+        __imjr_skip_whitespace(imj);
+
+        if (!__imjr_consume(imj, ':')) {
+            __imjr_parse_error(imj, "expected ':' after key");
+            return false;
+        }
+
+        __imjr_skip_whitespace(imj);
+    }
+
+    *ret = (imj_key_t){
+        .name = key_name,
+        .loc = imj->current,
+    };
+
+    size_t key_count = obj->keys.count;
+    __imj_da_push(&obj->keys, *ret, &imj->arena);
+    if (obj->keys.count == key_count) {
+        __imj_out_of_scratch(imj);
+        return false;
+    }
+
+    return true;
+}
+
+static bool __imjr_keyn(imj_t *imj, const char *key, size_t key_length) {
+
+    imj->value_pending = false;
+
+    if (imj->had_error) return false;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "keys can only reside inside objects");
+
+    imj_lvl_t *obj = imj->lvl_or_null;
+
+    if (imj->lvl_or_null->left_off_or_null == NULL) {
+        __imj_dive_into_key(imj, false);
+        return false;
+    }
+
+    for (size_t i = 0; i < obj->keys.count; ++i) {
+        imj_key_t k = obj->keys.items[i];
+        if (__imj_key_eq(k.name, key, key_length)) {
+            imj->current = k.loc;
+            __imj_dive_into_key(imj, true);
+            return true;
+        }
+    }
+
+    imj_key_t k;
+    while (__imjr_scan_key(imj, obj, &k)) {
+        if (__imj_key_eq(k.name, key, key_length)) {
+            __imj_dive_into_key(imj, true);
+            return true;
+        }
+
+        if (!__imjr_pass_key_value(imj, obj)) return false;
+    }
+
+    if (imj->had_error) return false;
+
+    // no value consumed, we haven't found the key
+    // but user expects value to be pending.
+    __imj_dive_into_key(imj, false);
+    return false;
+}
+
+static bool __imjr_next_key(imj_t *imj, imj_sv_t *key) {
+    imj->value_pending = false;
+
+    if (imj->had_error) return false;
+
+    // the value of the previous key was left unread
+    if (imj->lvl_or_null && imj->lvl_or_null->type == IMJ_KEY_VALUE) {
+        __imj_pop_lvl(imj);
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "keys can only reside inside objects");
+
+    imj_lvl_t *obj = imj->lvl_or_null;
+    if (obj->left_off_or_null == NULL) return false;
+
+    // keys are cached in source order, whether imj_key or an index found them first
+    imj_key_t k;
+    if (obj->next_key < obj->keys.count) {
+        k = obj->keys.items[obj->next_key];
+        imj->current = k.loc;
+    } else if (!__imjr_scan_key(imj, obj, &k)) {
+        return false;
+    }
+
+    ++obj->next_key;
+    *key = k.name;
+    __imj_dive_into_key(imj, true);
+    return true;
+}
+
+static void __imjw_keyn(imj_t *imj, const char *key, size_t n, bool raw) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "keys can only reside inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    __imj_dive_into_key(imj, false);
+
+    if (raw) {
+        __imjw_put_rawstr(imj, (imj_sv_t){ .data = key, .length = n });
+    } else {
+        __imjw_put_str(imj, key, n);
+    }
+
+    if (imj->encoding == IMJ_ENCODING_CBOR) return;
+
+    switch (imj->render_style) {
+    case IMJ_STYLE_MIN: __imjw_sb_add_str(&imj->sb, ":", 1, &imj->arena); break;
+    case IMJ_STYLE_SINGLE_LINE:
+    case IMJ_STYLE_PRETTY: __imjw_sb_add_str(&imj->sb, ": ", 2, &imj->arena); break;
+    }
+}
+
+bool imj_key(imj_t *imj, const char *key) {
+    return imj_keyn(imj, key, strlen(key));
+}
+
+bool imj_keyn(imj_t *imj, const char *key, size_t n) {
+    __IMJ_PROFILE_MARK(imj);
+
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_keyn(imj, key, n);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_keyn(imj, key, n, false);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        success = __imjp_keyn(imj, key, n);
+        break;
+    }
+    }
+
+    __IMJ_PROFILE_ENTER(imj, key, n);
+    return success;
+}
+
+bool imj_next_key(imj_t *imj, imj_sv_t *key) {
+    __IMJ_PROFILE_MARK(imj);
+
+    bool success = false;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: success = __imjr_next_key(imj, key); break;
+    case IMJ_WRITE: __imj_assert(false, "keys can only be iterated when reading"); return false;
+    case IMJ_PATCH: success = !imj->is_rendering && __imjr_next_key(imj, key); break;
+    }
+
+    if (success) __IMJ_PROFILE_ENTER(imj, key->data, key->length);
+    return success;
+}
+
+static bool __imjr_is_digit(char c) {
+    switch (c) {
+    case '0': case __imj_cases_non_zero: return true;
+    }
+    return false;
+}
+
+#ifdef __IMJ_LITTLE_ENDIAN
+// swar: checks and converts 8 ascii digits at once, the first digit sits in the low byte
+static bool __imj_is_8_digits(uint64_t v) {
+    return (((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+static uint64_t __imj_parse_8_digits(uint64_t v) {
+    v -= 0x3030303030303030ULL;
+    v = (v*10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL)*0x000F424000000064ULL) + (((v >> 16) & 0x000000FF000000FFULL)*0x0000271000000001ULL)) >> 32;
+    return v;
+}
+#endif
+
+// false when the digits do not fit in 64 bits
+static bool __imj_parse_digits_checked(const char *digits, size_t count, uint64_t *out) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t digit = (uint64_t)(digits[i] - '0');
+        if (val > (UINT64_MAX - digit)/10) return false;
+        val = val*10 + digit;
+    }
+
+    *out = val;
+    return true;
+}
+
+// digits past what a uint64_t holds only move the scale, for numbers too long for the fast path
+static void __imj_parse_digits_capped(const char *c, const char *end, uint64_t *mantissa, int64_t *scale) {
+    int digits = 0;
+    *mantissa = 0;
+    *scale = 0;
+
+    for (; c < end && __imjr_is_digit(*c); ++c) {
+        if (digits < 19) {
+            *mantissa = *mantissa*10 + (uint64_t)(*c - '0');
+            digits += *mantissa != 0;
+        } else ++*scale;
+    }
+
+    if (c < end && *c == '.') {
+        for (++c; c < end && __imjr_is_digit(*c); ++c) {
+            if (digits < 19) {
+                *mantissa = *mantissa*10 + (uint64_t)(*c - '0');
+                digits += *mantissa != 0;
+                --*scale;
+            }
+        }
+    }
+}
+
+// json numbers are decoded to digits and a power of ten on the way through, the conversion
+// to a double only happens when one is asked for
+static bool __imj_read_num(imj_t *imj, imj_val_t *ret) {
+    *ret = __imj_val_error;
+
+    // kept local so it stays in a register, imj->current is only updated on the way out
+    char *start = imj->current;
+    char *p = start;
+    const char *end = __imjr_end(imj);
+    if (p < end && *p == '-') ++p;
+
+    char *first = p;
+    uint64_t mantissa = 0;
+    int64_t scale = 0;
+    bool integral = true;
+
+    switch (__imjr_at(p, end)) {
+    case '0': {
+        ++p;
+        break;
+    }
+
+    case __imj_cases_non_zero: {
+#ifdef __IMJ_LITTLE_ENDIAN
+        // two chunks are at most 16 digits so they cannot overflow
+        for (int i = 0; i < 2 && end - p >= 8; ++i) {
+            uint64_t chunk;
+            memcpy(&chunk, p, sizeof(chunk));
+            if (!__imj_is_8_digits(chunk)) break;
+            mantissa = mantissa*100000000 + __imj_parse_8_digits(chunk);
+            p += 8;
+        }
+#endif
+
+        while (p < end && __imjr_is_digit(*p)) {
+            mantissa = mantissa*10 + (uint64_t)(*p - '0');
+            ++p;
+        }
+        break;
+    }
+
+    default: {
+        imj->current = p;
+        __imjr_parse_error(imj, "expected digit");
+        return false;
+    }
+    }
+
+    size_t digits = p - first;
+
+    if (__imjr_at(p, end) == '.') {
+        ++p;
+        integral = false;
+        if (!__imjr_is_digit(__imjr_at(p, end))) {
+            imj->current = p;
+            __imjr_parse_error(imj, "expected digit");
+            return false;
+        }
+
+        char *fraction = p;
+        while (p < end && __imjr_is_digit(*p)) {
+            mantissa = mantissa*10 + (uint64_t)(*p - '0');
+            ++p;
+        }
+
+        scale = fraction - p;
+        digits -= scale;
+    }
+
+    // only 20 digit integers can still fit, anything else that long may have wrapped
+    if (digits >= 20) {
+        if (!integral || digits > 20 || !__imj_parse_digits_checked(first, digits, &mantissa)) {
+            integral = false;
+            __imj_parse_digits_capped(first, p, &mantissa, &scale);
+        }
+    }
+
+    if (__imjr_at(p, end) == 'e' || __imjr_at(p, end) == 'E') {
+        ++p;
+        integral = false;
+        bool exp_neg = __imjr_at(p, end) == '-';
+        if (exp_neg || __imjr_at(p, end) == '+') ++p;
+
+        if (!__imjr_is_digit(__imjr_at(p, end))) {
+            imj->current = p;
+            __imjr_parse_error(imj, "expected digit");
+            return false;
+        }
+
+        int64_t exp = 0;
+        while (p < end && __imjr_is_digit(*p)) {
+            if (exp < 100000) exp = exp*10 + (*p - '0');
+            ++p;
+        }
+
+        scale += exp_neg ? -exp : exp;
+    }
+
+    imj->current = p;
+    ret->kind = IMJ_NUMBER;
+    ret->sv.data = start;
+    ret->sv.length = imj->current - start;
+    ret->s = mantissa;
+    ret->i = scale;
+    ret->integral = integral;
+
+    return true;
+}
+
+static double __imjr_num_double(imj_t *imj, const imj_val_t *val) {
+    if (imj->encoding == IMJ_ENCODING_CBOR) return val->d;
+
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    // a mantissa up to 2^53 and a power up to 1e22 are both exact doubles, so one multiply or divide rounds correctly
+    if (val->s <= (1ull << 53) && val->i >= -22 && val->i <= 22) {
+        double num = (double)val->s;
+        num = val->i >= 0 ? num*powers[val->i] : num/powers[-val->i];
+        return val->sv.data[0] == '-' ? -num : num;
+    }
+
+    // anything else would round twice, strtod rounds the text once but needs it nul terminated
+    // it's rebuilt as digits and an exponent, a double is decided by its first 768 significant digits
+    // and past them only whether the rest is all zeros, which a trailing 1 keeps
+    char text[800];
+    size_t n = 0, kept = 0;
+    int64_t exp = 0;
+    bool point = false, dropped = false;
+    const char *p = val->sv.data, *end = p + val->sv.length;
+    if (__imjr_at(p, end) == '-') text[n++] = *p++;
+
+    for (; p < end && *p != 'e' && *p != 'E'; ++p) {
+        if (*p == '.') {
+            point = true;
+        } else if (kept == 0 && *p == '0') {
+            if (point) --exp;
+        } else if (kept < 768) {
+            text[n++] = *p;
+            ++kept;
+            if (point) --exp;
+        } else {
+            dropped = dropped || *p != '0';
+            if (!point) ++exp;
+        }
+    }
+
+    if (kept == 0) text[n++] = '0';
+    if (dropped) {
+        text[n++] = '1';
+        --exp;
+    }
+
+    if (__imjr_at(p, end) == 'e' || __imjr_at(p, end) == 'E') {
+        ++p;
+        bool exp_neg = __imjr_at(p, end) == '-';
+        if (exp_neg || __imjr_at(p, end) == '+') ++p;
+
+        int64_t written = 0;
+        while (p < end && __imjr_is_digit(*p)) {
+            if (written < 100000) written = written*10 + (*p - '0');
+            ++p;
+        }
+        exp += exp_neg ? -written : written;
+    }
+
+    snprintf(text + n, sizeof(text) - n, "e%lld", (long long)exp);
+    return strtod(text, NULL);
+}
+
+static bool __imjr_num_i64(imj_t *imj, const imj_val_t *val, int64_t *out) {
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        // integers keep their exact value whatever tags wrap them, the sign tells a uint from a negint
+        if (val->integral) {
+            if (val->d >= 0) {
+                if (val->s > (uint64_t)INT64_MAX) return false;
+                *out = (int64_t)val->s;
+                return true;
+            }
+
+            if (val->i >= 0) return false;
+            *out = (int64_t)val->i;
+            return true;
+        }
+    } else if (val->integral) {
+        if (val->sv.data[0] != '-') {
+            if (val->s > (uint64_t)INT64_MAX) return false;
+            *out = (int64_t)val->s;
+        } else {
+            if (val->s > (uint64_t)INT64_MAX + 1) return false;
+            *out = val->s == 0 ? 0 : -1 - (int64_t)(val->s - 1);
+        }
+        return true;
+    }
+
+    double d = __imjr_num_double(imj, val);
+    if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) return false;
+    *out = (int64_t)d;
+    return true;
+}
+
+static bool __imjr_num_u64(imj_t *imj, const imj_val_t *val, uint64_t *out) {
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        if (val->integral) {
+            if (val->d < 0) return false;
+            *out = val->s;
+            return true;
+        }
+    } else if (val->integral) {
+        if (val->sv.data[0] == '-' && val->s != 0) return false;
+        *out = val->s;
+        return true;
+    }
+
+    double d = __imjr_num_double(imj, val);
+    if (!(d > -1.0 && d < 18446744073709551616.0)) return false;
+    *out = (uint64_t)d;
+    return true;
+}
+
+static bool __imjr_read_val(imj_t *imj, imj_val_t *ret) {
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        return __imjr_cbor_read_val(imj, ret);
+    }
+
+    switch (__imjr_peek(imj)) {
+    case '{': {
+        __imjr_skip_value(imj);
+        ret->kind = IMJ_OBJECT;
+        break;
+    }
+
+    case '[': {
+        __imjr_skip_value(imj);
+        ret->kind = IMJ_ARRAY;
+        break;
+    }
+
+    case '0': case '-': case __imj_cases_non_zero: {
+        *ret = (imj_val_t){0};
+        if (!__imj_read_num(imj, ret)) return false;
+        break;
+    }
+
+    case '"': {
+        imj_sv_t sv;
+        ++imj->current;
+        if (!__imjr_read_str(imj, &sv)) return false;
+        *ret = (imj_val_t){0};
+        ret->kind = IMJ_STRING;
+        ret->sv = sv;
+        break;
+    }
+
+    default: {
+        char *start = imj->current;
+        __imjr_skip_until_whitespace_or_comma(imj);
+        imj_sv_t sv = {
+            .data = start,
+            .length = imj->current-start,
+        };
+
+        if (imj_sv_cstr_eq(sv, "true")) {
+            *ret = (imj_val_t){0};
+            ret->kind = IMJ_BOOL;
+            ret->b = true;
+            ret->s = (size_t)true;
+            ret->i = (long)true;
+            ret->d = (double)true;
+        } else if (imj_sv_cstr_eq(sv, "false") || imj_sv_cstr_eq(sv, "null")) {
+            *ret = (imj_val_t){0};
+            ret->kind = sv.data[0] == 'n' ? IMJ_NULL : IMJ_BOOL;
+            ret->b = false;
+            ret->s = (size_t)false;
+            ret->i = (long)false;
+            ret->d = (double)false;
+        } else {
+            __imjr_parse_error(imj, "unexpected value");
+            return false;
+        }
+        break;
+    }
+    }
+
+    return true;
+}
+
+static bool __imjr_use_default_value_and_pop_lvl_if_possible(imj_t *imj) {
+    bool value_pending = imj->value_pending;
+    imj->value_pending = false;
+
+    if (imj->lvl_or_null) {
+        switch (imj->lvl_or_null->type) {
+        case IMJ_OBJECT: {
+            __imjr_parse_error(imj, "cannot have objects directly inside objects");
+            return true;
+        }
+
+        case IMJ_KEY_VALUE: {
+            __imj_pop_lvl(imj);
+            break;
+        }
+
+        case IMJ_ARRAY: break;
+
+        default: assert(false); break;
+    }
+    }
+
+    return !value_pending;
+}
+
+static bool __imjr_valnull(imj_t *imj) {
+    if (imj->had_error) {
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        return false;
+    }
+
+    imj_val_t val;
+    bool success = __imjr_read_val(imj, &val);
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success && val.kind == IMJ_NULL;
+}
+
+static void __imjw_valnull(imj_t *imj) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    __imjw_put_null(imj);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_valnull(imj_t *imj) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valnull(imj);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valnull(imj);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valnull(imj);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+static bool __imjr_valb(imj_t *imj, bool *value, bool default_) {
+    if (imj->had_error) {
+        *value = default_;
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        *value = default_;
+        return false;
+    }
+
+    imj_val_t val;
+    bool success = __imjr_read_val(imj, &val);
+    if (success && val.kind == IMJ_BOOL) {
+        *value = (bool)val.i;
+    } else {
+        *value = default_;
+    }
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success && val.kind == IMJ_BOOL;
+}
+
+static void __imjw_valb(imj_t *imj, bool *value, bool default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    bool val = value ? *value : default_;
+    __imjw_put_bool(imj, val);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_valb(imj_t *imj, bool *value, bool default_) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valb(imj, value, default_);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valb(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valb(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+// out of range values read as the default and fail
+static bool __imjr_valint(imj_t *imj, int64_t *value, int64_t default_, int64_t min, int64_t max) {
+    if (imj->had_error) {
+        *value = default_;
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        *value = default_;
+        return false;
+    }
+
+    imj_val_t val;
+    int64_t num = 0;
+    bool success = __imjr_read_val(imj, &val) && val.kind == IMJ_NUMBER
+        && __imjr_num_i64(imj, &val, &num) && num >= min && num <= max;
+    *value = success ? num : default_;
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success;
+}
+
+static bool __imjr_valuint(imj_t *imj, uint64_t *value, uint64_t default_, uint64_t max) {
+    if (imj->had_error) {
+        *value = default_;
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        *value = default_;
+        return false;
+    }
+
+    imj_val_t val;
+    uint64_t num = 0;
+    bool success = __imjr_read_val(imj, &val) && val.kind == IMJ_NUMBER
+        && __imjr_num_u64(imj, &val, &num) && num <= max;
+    *value = success ? num : default_;
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success;
+}
+
+static bool __imjr_vali(imj_t *imj, int *value, int default_) {
+    int64_t val;
+    bool success = __imjr_valint(imj, &val, default_, INT_MIN, INT_MAX);
+    *value = (int)val;
+    return success;
+}
+
+static void __imjw_vali(imj_t *imj, int *value, int default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    int val = value ? *value : default_;
+    __imjw_put_int(imj, val);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_vali(imj_t *imj, int *value, int default_) {
+    bool success = false;
+
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_vali(imj, value, default_);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_vali(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_vali(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+static bool __imjr_vals(imj_t *imj, size_t *value, size_t default_) {
+    uint64_t val;
+    bool success = __imjr_valuint(imj, &val, default_, SIZE_MAX);
+    *value = (size_t)val;
+    return success;
+}
+
+static void __imjw_vals(imj_t *imj, size_t *value, size_t default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    size_t val = value ? *value : default_;
+    __imjw_put_uint(imj, val);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_vals(imj_t *imj, size_t *value, size_t default_) {
+    bool success = true;
+    switch(__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_vals(imj, value, default_);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_vals(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_vals(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+static void __imjw_valint(imj_t *imj, int64_t value) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    __imjw_put_int(imj, value);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+static void __imjw_valuint(imj_t *imj, uint64_t value) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    __imjw_put_uint(imj, value);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+static bool __imj_valint(imj_t *imj, int64_t *value, int64_t default_, int64_t min, int64_t max) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valint(imj, value, default_, min, max);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valint(imj, *value);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valint(imj, *value, min, max);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+static bool __imj_valuint(imj_t *imj, uint64_t *value, uint64_t default_, uint64_t max) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valuint(imj, value, default_, max);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valuint(imj, *value);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valuint(imj, *value, max);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+// the sized integers go through one 64-bit value, only writing and patching read what the caller passed in
+bool imj_vali64(imj_t *imj, int64_t *value, int64_t default_) {
+    int64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valint(imj, &val, default_, INT64_MIN, INT64_MAX);
+    if (value) *value = (int64_t)val;
+    return success;
+}
+
+bool imj_valu64(imj_t *imj, uint64_t *value, uint64_t default_) {
+    uint64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valuint(imj, &val, default_, UINT64_MAX);
+    if (value) *value = (uint64_t)val;
+    return success;
+}
+
+bool imj_vali32(imj_t *imj, int32_t *value, int32_t default_) {
+    int64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valint(imj, &val, default_, INT32_MIN, INT32_MAX);
+    if (value) *value = (int32_t)val;
+    return success;
+}
+
+bool imj_valu32(imj_t *imj, uint32_t *value, uint32_t default_) {
+    uint64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valuint(imj, &val, default_, UINT32_MAX);
+    if (value) *value = (uint32_t)val;
+    return success;
+}
+
+bool imj_vali16(imj_t *imj, int16_t *value, int16_t default_) {
+    int64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valint(imj, &val, default_, INT16_MIN, INT16_MAX);
+    if (value) *value = (int16_t)val;
+    return success;
+}
+
+bool imj_valu16(imj_t *imj, uint16_t *value, uint16_t default_) {
+    uint64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valuint(imj, &val, default_, UINT16_MAX);
+    if (value) *value = (uint16_t)val;
+    return success;
+}
+
+bool imj_vali8(imj_t *imj, int8_t *value, int8_t default_) {
+    int64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valint(imj, &val, default_, INT8_MIN, INT8_MAX);
+    if (value) *value = (int8_t)val;
+    return success;
+}
+
+bool imj_valu8(imj_t *imj, uint8_t *value, uint8_t default_) {
+    uint64_t val = value && __imj_io_mode(imj) != IMJ_READ ? *value : default_;
+    bool success = __imj_valuint(imj, &val, default_, UINT8_MAX);
+    if (value) *value = (uint8_t)val;
+    return success;
+}
+
+static bool __imjr_valf(imj_t *imj, float *value, float default_) {
+    if (imj->had_error) {
+        *value = default_;
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        *value = default_;
+        return false;
+    }
+
+    imj_val_t val;
+    bool success = __imjr_read_val(imj, &val);
+    if (success && val.kind == IMJ_NUMBER) {
+        *value = (float)__imjr_num_double(imj, &val);
+    } else {
+        *value = (float)default_;
+    }
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success && val.kind == IMJ_NUMBER;
+}
+
+static void __imjw_valf(imj_t *imj, float *value, float default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+	float val = value ? *value : default_;
+    __imjw_put_float(imj, val);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_valf(imj_t *imj, float *value, float default_) {
+    bool success = true;
+    switch(__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valf(imj, value, default_);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valf(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valf(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+static bool __imjr_vald(imj_t *imj, double *value, double default_) {
+    if (imj->had_error) {
+        *value = default_;
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        *value = default_;
+        return false;
+    }
+
+    imj_val_t val;
+    bool success = __imjr_read_val(imj, &val);
+    if (success && val.kind == IMJ_NUMBER) {
+        *value = __imjr_num_double(imj, &val);
+    } else {
+        *value = default_;
+    }
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success && val.kind == IMJ_NUMBER;
+}
+
+static void __imjw_vald(imj_t *imj, double *value, double default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+	double val = value ? *value : default_;
+    __imjw_put_double(imj, val);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_vald(imj_t *imj, double *value, double default_) {
+    bool success = true;
+    switch(__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_vald(imj, value, default_);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_vald(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_vald(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+static bool __imjr_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
+    if (imj->had_error) {
+        *value = imj_cstr2sv(default_);
+        return false;
+    }
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        *value = imj_cstr2sv(default_);
+        return false;
+    }
+
+    imj_val_t val;
+    bool success = __imjr_read_val(imj, &val);
+    if (success && val.kind == IMJ_STRING) {
+        *value = val.sv;
+    } else {
+        *value = imj_cstr2sv(default_);
+    }
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success && val.kind == IMJ_STRING;
+}
+
+static void __imjw_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    imj_sv_t val = value ? *value : imj_cstr2sv(default_);
+    __imjw_put_str(imj, val.data, val.length);
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valrawsv(imj, value, default_);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valrawsv(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valrawsv(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+bool imj_path_compile(imj_path_t *path, const char *pointer) {
+    path->count = 0;
+
+    // the empty pointer is the whole document
+    size_t length = 0;
+    const char *c = pointer;
+    while (*c) {
+        if (*c != '/' || path->count == IMJ_PATH_MAX_SEGMENTS) return false;
+        ++c;
+
+        imj_path_segment_t *segment = &path->segments[path->count++];
+        segment->offset = length;
+        for (; *c && *c != '/'; ++c) {
+            char ch = *c;
+            if (ch == '~') {
+                ++c;
+                if (*c == '0') ch = '~';
+                else if (*c == '1') ch = '/';
+                else return false;
+            }
+
+            if (length == IMJ_PATH_MAX_LENGTH) return false;
+            path->text[length++] = ch;
+        }
+        segment->length = length - segment->offset;
+
+        // array indices are digits without leading zeros
+        const char *digits = path->text + segment->offset;
+        bool is_index = segment->length > 0 && segment->length < 20 && (digits[0] != '0' || segment->length == 1);
+        size_t index = 0;
+        for (size_t i = 0; i < segment->length && is_index; ++i) {
+            is_index = __imjr_is_digit(digits[i]);
+            index = index*10 + (size_t)(digits[i] - '0');
+        }
+        segment->index = is_index ? index : SIZE_MAX;
+    }
+
+    return true;
+}
+
+static bool __imj_path_key_eq(const imj_path_t *path, const imj_path_segment_t *segment, imj_sv_t key, bool escaped) {
+    const char *want = path->text + segment->offset;
+    if (!escaped || memchr(key.data, '\\', key.length) == NULL) {
+        return key.length == segment->length && memcmp(key.data, want, key.length) == 0;
+    }
+
+    // compared as it's unescaped, so keys of any length are matched whole
+    size_t at = 0;
+    for (size_t i = 0; i < key.length; ++i) {
+        char c;
+        if (!__imj_unescape_char(key, &i, &c) || at == segment->length || c != want[at]) return false;
+        ++at;
+    }
+    return at == segment->length;
+}
+
+static bool __imjr_json_path_step(imj_t *imj, const imj_path_t *path, const imj_path_segment_t *segment) {
+    __imjr_skip_whitespace(imj);
+
+    if (__imjr_match(imj, '{')) {
+        __imjr_skip_whitespace(imj);
+        if (__imjr_match(imj, '}')) return false;
+
+        while (!imj->had_error) {
+            imj_sv_t key;
+            __imjr_skip_whitespace(imj);
+            if (!__imjr_consume(imj, '"')) {
+                __imjr_parse_error(imj, "expected key");
+                return false;
+            }
+            if (!__imjr_read_str(imj, &key)) return false;
+
+            __imjr_skip_whitespace(imj);
+            if (!__imjr_consume(imj, ':')) {
+                __imjr_parse_error(imj, "expected ':' after key");
+                return false;
+            }
+            __imjr_skip_whitespace(imj);
+
+            if (__imj_path_key_eq(path, segment, key, true)) return true;
+            __imjr_skip_value(imj);
+
+            __imjr_skip_whitespace(imj);
+            if (!__imjr_match(imj, ',')) return false;
+        }
+        return false;
+    }
+
+    if (__imjr_match(imj, '[')) {
+        if (segment->index == SIZE_MAX) return false;
+        __imjr_skip_whitespace(imj);
+        if (__imjr_peek(imj) == ']') return false;
+
+        for (size_t i = 0; i < segment->index && !imj->had_error; ++i) {
+            __imjr_skip_value(imj);
+            __imjr_skip_whitespace(imj);
+            if (!__imjr_match(imj, ',')) return false;
+            __imjr_skip_whitespace(imj);
+        }
+        return !imj->had_error;
+    }
+
+    return false;
+}
+
+static bool __imjr_cbor_path_step(imj_t *imj, const imj_path_t *path, const imj_path_segment_t *segment) {
+    uint8_t ib;
+    uint64_t length;
+    if (!__imjr_cbor_head(imj, &ib, &length)) return false;
+
+    if ((ib >> 5) == __IMJ_CBOR_MAP) {
+        for (uint64_t i = 0; i < length && !imj->had_error; ++i) {
+            imj_val_t key;
+            if (!__imjr_cbor_read_val(imj, &key)) return false;
+            if (key.kind == IMJ_STRING && __imj_path_key_eq(path, segment, key.sv, false)) return true;
+            __imjr_cbor_skip(imj);
+        }
+        return false;
+    }
+
+    if ((ib >> 5) == __IMJ_CBOR_ARRAY) {
+        if (segment->index >= length) return false;
+        __imjr_cbor_skip_items(imj, segment->index);
+        return !imj->had_error;
+    }
+
+    return false;
+}
+
+// reads the value at 'path' and puts the cursor back, false when there is none
+static bool __imjr_path_val(imj_t *imj, const imj_path_t *path, imj_val_t *val) {
+    if (imj->had_error) return false;
+
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: case IMJ_PATCH: break;
+    case IMJ_WRITE: __imj_assert(false, "paths can only be read"); return false;
+    }
+
+    char *current = imj->current;
+    size_t indent_lvl = imj->indent_lvl;
+
+    imj->current = (char*)imj->src.data;
+    imj->indent_lvl = 0;
+
+    bool found = true;
+    for (size_t i = 0; i < path->count && found; ++i) {
+        found = imj->encoding == IMJ_ENCODING_CBOR
+            ? __imjr_cbor_path_step(imj, path, &path->segments[i])
+            : __imjr_json_path_step(imj, path, &path->segments[i]);
+        ++imj->indent_lvl;
+    }
+
+    if (found && imj->encoding == IMJ_ENCODING_JSON) __imjr_skip_whitespace(imj);
+    found = found && !imj->had_error && __imjr_read_val(imj, val);
+
+    imj->current = current;
+    imj->indent_lvl = indent_lvl;
+
+    return found;
+}
+
+bool imj_path_valb(imj_t *imj, const imj_path_t *path, bool *value, bool default_) {
+    imj_val_t val;
+    bool success = __imjr_path_val(imj, path, &val) && val.kind == IMJ_BOOL;
+    *value = success ? val.b : default_;
+    return success;
+}
+
+bool imj_path_vali64(imj_t *imj, const imj_path_t *path, int64_t *value, int64_t default_) {
+    imj_val_t val;
+    int64_t num = 0;
+    bool success = __imjr_path_val(imj, path, &val) && val.kind == IMJ_NUMBER && __imjr_num_i64(imj, &val, &num);
+    *value = success ? num : default_;
+    return success;
+}
+
+bool imj_path_valu64(imj_t *imj, const imj_path_t *path, uint64_t *value, uint64_t default_) {
+    imj_val_t val;
+    uint64_t num = 0;
+    bool success = __imjr_path_val(imj, path, &val) && val.kind == IMJ_NUMBER && __imjr_num_u64(imj, &val, &num);
+    *value = success ? num : default_;
+    return success;
+}
+
+bool imj_path_vald(imj_t *imj, const imj_path_t *path, double *value, double default_) {
+    imj_val_t val;
+    bool success = __imjr_path_val(imj, path, &val) && val.kind == IMJ_NUMBER;
+    *value = success ? __imjr_num_double(imj, &val) : default_;
+    return success;
+}
+
+bool imj_path_valrawsv(imj_t *imj, const imj_path_t *path, imj_sv_t *value, const char *default_) {
+    imj_val_t val;
+    bool success = __imjr_path_val(imj, path, &val) && val.kind == IMJ_STRING;
+    *value = success ? val.sv : imj_cstr2sv(default_);
+    return success;
+}
+
+bool imj_query_valb(imj_t *imj, const char *pointer, bool *value, bool default_) {
+    imj_path_t path;
+    if (!imj_path_compile(&path, pointer)) {
+        *value = default_;
+        return false;
+    }
+    return imj_path_valb(imj, &path, value, default_);
+}
+
+bool imj_query_vali64(imj_t *imj, const char *pointer, int64_t *value, int64_t default_) {
+    imj_path_t path;
+    if (!imj_path_compile(&path, pointer)) {
+        *value = default_;
+        return false;
+    }
+    return imj_path_vali64(imj, &path, value, default_);
+}
+
+bool imj_query_valu64(imj_t *imj, const char *pointer, uint64_t *value, uint64_t default_) {
+    imj_path_t path;
+    if (!imj_path_compile(&path, pointer)) {
+        *value = default_;
+        return false;
+    }
+    return imj_path_valu64(imj, &path, value, default_);
+}
+
+bool imj_query_vald(imj_t *imj, const char *pointer, double *value, double default_) {
+    imj_path_t path;
+    if (!imj_path_compile(&path, pointer)) {
+        *value = default_;
+        return false;
+    }
+    return imj_path_vald(imj, &path, value, default_);
+}
+
+bool imj_query_valrawsv(imj_t *imj, const char *pointer, imj_sv_t *value, const char *default_) {
+    imj_path_t path;
+    if (!imj_path_compile(&path, pointer)) {
+        *value = imj_cstr2sv(default_);
+        return false;
+    }
+    return imj_path_valrawsv(imj, &path, value, default_);
+}
+
+static imj_column_t *__imjr_find_column(imj_column_t *columns, size_t column_count, imj_sv_t key) {
+    for (size_t i = 0; i < column_count; ++i) {
+        if (strncmp(columns[i].key, key.data, key.length) == 0 && columns[i].key[key.length] == '\0') {
+            return &columns[i];
+        }
+    }
+    return NULL;
+}
+
+static void __imjr_column_val(imj_t *imj, imj_column_t *column, size_t row) {
+    imj_val_t val;
+    if (!__imjr_read_val(imj, &val)) return;
+
+    bool present = false;
+    int64_t i;
+    uint64_t u;
+    switch (column->type) {
+    case IMJ_COLUMN_BOOL: {
+        present = val.kind == IMJ_BOOL;
+        if (present) ((bool*)column->out)[row] = val.b;
+        break;
+    }
+
+    case IMJ_COLUMN_I32: {
+        present = val.kind == IMJ_NUMBER && __imjr_num_i64(imj, &val, &i) && i >= INT32_MIN && i <= INT32_MAX;
+        if (present) ((int32_t*)column->out)[row] = (int32_t)i;
+        break;
+    }
+
+    case IMJ_COLUMN_I64: {
+        present = val.kind == IMJ_NUMBER && __imjr_num_i64(imj, &val, &i);
+        if (present) ((int64_t*)column->out)[row] = i;
+        break;
+    }
+
+    case IMJ_COLUMN_U64: {
+        present = val.kind == IMJ_NUMBER && __imjr_num_u64(imj, &val, &u);
+        if (present) ((uint64_t*)column->out)[row] = u;
+        break;
+    }
+
+    case IMJ_COLUMN_FLOAT: {
+        present = val.kind == IMJ_NUMBER;
+        if (present) ((float*)column->out)[row] = (float)__imjr_num_double(imj, &val);
+        break;
+    }
+
+    case IMJ_COLUMN_DOUBLE: {
+        present = val.kind == IMJ_NUMBER;
+        if (present) ((double*)column->out)[row] = __imjr_num_double(imj, &val);
+        break;
+    }
+
+    case IMJ_COLUMN_RAWSV: {
+        present = val.kind == IMJ_STRING;
+        if (present) ((imj_sv_t*)column->out)[row] = val.sv;
+        break;
+    }
+    }
+
+    if (column->present) column->present[row] = present;
+}
+
+// false when the value isn't an array, it's skipped like any value of the wrong kind
+static bool __imjr_json_columns(imj_t *imj, imj_column_t *columns, size_t column_count, size_t cap, size_t *count) {
+    __imjr_skip_whitespace(imj);
+    if (!__imjr_match(imj, '[')) {
+        __imjr_skip_value(imj);
+        return false;
+    }
+
+    __imjr_skip_whitespace(imj);
+    if (__imjr_match(imj, ']')) return true;
+
+    while (!imj->had_error) {
+        __imjr_skip_whitespace(imj);
+
+        size_t row = *count;
+        if (row < cap) {
+            for (size_t i = 0; i < column_count; ++i) {
+                if (columns[i].present) columns[i].present[row] = false;
+            }
+        }
+
+        if (row < cap && __imjr_match(imj, '{')) {
+            __imjr_skip_whitespace(imj);
+            bool more = !__imjr_match(imj, '}');
+            while (more && !imj->had_error) {
+                imj_sv_t key;
+                __imjr_skip_whitespace(imj);
+                if (!__imjr_consume(imj, '"')) {
+                    __imjr_parse_error(imj, "expected key");
+                    return false;
+                }
+                if (!__imjr_read_str(imj, &key)) return false;
+
+                __imjr_skip_whitespace(imj);
+                if (!__imjr_consume(imj, ':')) {
+                    __imjr_parse_error(imj, "expected ':' after key");
+                    return false;
+                }
+                __imjr_skip_whitespace(imj);
+
+                imj_column_t *column = __imjr_find_column(columns, column_count, key);
+                if (column) {
+                    __imjr_column_val(imj, column, row);
+                } else {
+                    __imjr_skip_value(imj);
+                }
+
+                __imjr_skip_whitespace(imj);
+                if (__imjr_match(imj, '}')) {
+                    more = false;
+                } else if (!__imjr_consume(imj, ',')) {
+                    __imjr_parse_error(imj, "expected ',' or '}'");
+                    return false;
+                }
+            }
+        } else {
+            __imjr_skip_value(imj);
+        }
+
+        ++*count;
+
+        __imjr_skip_whitespace(imj);
+        if (__imjr_match(imj, ']')) return true;
+        if (!__imjr_consume(imj, ',')) {
+            __imjr_parse_error(imj, "expected ',' or ']'");
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static bool __imjr_cbor_columns(imj_t *imj, imj_column_t *columns, size_t column_count, size_t cap, size_t *count) {
+    char *start = imj->current;
+    uint8_t ib;
+    uint64_t length;
+    if (!__imjr_cbor_head(imj, &ib, &length)) return false;
+
+    if ((ib >> 5) != __IMJ_CBOR_ARRAY) {
+        imj->current = start;
+        __imjr_cbor_skip(imj);
+        return false;
+    }
+
+    for (uint64_t row = 0; row < length && !imj->had_error; ++row) {
+        if (row < cap) {
+            for (size_t i = 0; i < column_count; ++i) {
+                if (columns[i].present) columns[i].present[row] = false;
+            }
+        }
+
+        char *element = imj->current;
+        uint64_t pairs;
+        if (!__imjr_cbor_head(imj, &ib, &pairs)) return false;
+
+        if (row >= cap || (ib >> 5) != __IMJ_CBOR_MAP) {
+            imj->current = element;
+            __imjr_cbor_skip(imj);
+            ++*count;
+            continue;
+        }
+
+        for (uint64_t i = 0; i < pairs && !imj->had_error; ++i) {
+            imj_val_t key;
+            if (!__imjr_cbor_read_val(imj, &key)) return false;
+
+            imj_column_t *column = key.kind == IMJ_STRING ? __imjr_find_column(columns, column_count, key.sv) : NULL;
+            if (column) {
+                __imjr_column_val(imj, column, (size_t)row);
+            } else {
+                __imjr_cbor_skip(imj);
+            }
+        }
+
+        ++*count;
+    }
+
+    return !imj->had_error;
+}
+
+static bool __imjr_arr_columns(imj_t *imj, imj_column_t *columns, size_t column_count, size_t cap, size_t *count) {
+    *count = 0;
+    if (imj->had_error) return false;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
+        return false;
+    }
+
+    // the array and its objects count toward the depth limit of anything skipped inside them
+    imj->indent_lvl += 2;
+    bool success = imj->encoding == IMJ_ENCODING_CBOR
+        ? __imjr_cbor_columns(imj, columns, column_count, cap, count)
+        : __imjr_json_columns(imj, columns, column_count, cap, count);
+    imj->indent_lvl -= 2;
+
+    __imjr_update_array_if_necessary(imj);
+
+    return success && !imj->had_error;
+}
+
+bool imj_arr_columns(imj_t *imj, imj_column_t *columns, size_t column_count, size_t cap, size_t *count) {
+    size_t ignored;
+    if (!count) count = &ignored;
+
+    bool success = false;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: success = __imjr_arr_columns(imj, columns, column_count, cap, count); break;
+    case IMJ_WRITE: __imj_assert(false, "columns can only be read"); break;
+    case IMJ_PATCH: success = !imj->is_rendering && __imjr_arr_columns(imj, columns, column_count, cap, count); break;
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+bool imj_arr_column(imj_t *imj, const char *key, imj_column_type_t type, void *out, size_t cap, size_t *count) {
+    imj_column_t column = { .key = key, .type = type, .out = out };
+    return imj_arr_columns(imj, &column, 1, cap, count);
+}
+
+static uint64_t __imj_hash(const char *data, size_t n) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static const char *__imj_strings_add(imj_strings_t *strings, imj_sv_t sv, bool escaped) {
+    // grown first so the string stays the last allocation and can be given back when it's a duplicate
+    if (strings->intern && (strings->count + 1)*4 > strings->slot_capacity*3) {
+        size_t capacity = strings->slot_capacity == 0 ? 64 : strings->slot_capacity*2;
+        imj_str_slot_t *slots = __imj_arena_alloc(&strings->arena, sizeof(imj_str_slot_t)*capacity);
+        memset(slots, 0, sizeof(imj_str_slot_t)*capacity);
+
+        for (size_t i = 0; i < strings->slot_capacity; ++i) {
+            imj_str_slot_t slot = strings->slots[i];
+            if (slot.str == NULL) continue;
+
+            size_t at = slot.hash & (capacity - 1);
+            while (slots[at].str) at = (at + 1) & (capacity - 1);
+            slots[at] = slot;
+        }
+
+        strings->slots = slots;
+        strings->slot_capacity = capacity;
+    }
+
+    char *str = __imj_arena_alloc(&strings->arena, sv.length + 1);
+    size_t length = sv.length;
+    if (escaped) {
+        __imj_unescape(sv, str, sv.length, &length);
+    } else {
+        memcpy(str, sv.data, sv.length);
+    }
+    str[length] = '\0';
+
+    if (strings->intern) {
+        uint64_t hash = __imj_hash(str, length);
+        size_t at = hash & (strings->slot_capacity - 1);
+
+        while (strings->slots[at].str) {
+            imj_str_slot_t slot = strings->slots[at];
+            if (slot.hash == hash && slot.length == length && memcmp(slot.str, str, length) == 0) {
+                __imj_arena_pop(&strings->arena, sv.length + 1);
+                return slot.str;
+            }
+
+            at = (at + 1) & (strings->slot_capacity - 1);
+        }
+
+        strings->slots[at] = (imj_str_slot_t){ .hash = hash, .str = str, .length = length };
+    }
+
+    ++strings->count;
+    strings->bytes += length + 1;
+    return str;
+}
+
+static bool __imjr_valcstr(imj_t *imj, const char **value, const char *default_, imj_alloc alloc, void *allocator) {
+    imj_sv_t sv;
+    bool success = imj_valrawsv(imj, &sv, default_);
+
+    if (alloc == NULL) {
+        imj_strings_t *strings = allocator ? allocator : imj->strings;
+        __imj_assert(strings, "needs an allocator or a string store");
+        *value = __imj_strings_add(strings, sv, success && imj->encoding == IMJ_ENCODING_JSON);
+        return success;
+    }
+
+    char *new_val = alloc(allocator, sv.length+1);
+    size_t length = sv.length;
+    if (success && imj->encoding == IMJ_ENCODING_JSON) {
+        __imj_unescape(sv, new_val, sv.length, &length);
+    } else {
+        memcpy(new_val, sv.data, sv.length);
+    }
+    new_val[length] = '\0';
+
+    *value = new_val;
+
+    return success;
+}
+
+static void __imjw_valcstr(imj_t *imj, const char **value, const char *default_) {
+    if (imj->had_error) return;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+
+    __imjw_add_comma_and_ws_if_necessary(imj);
+
+    const char *val = value ? *value : default_;
+    __imjw_put_str(imj, val, strlen(val));
+
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+
+bool imj_valcstr(imj_t *imj, const char **value, const char *default_, imj_alloc alloc, void *allocator) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valcstr(imj, value, default_, alloc, allocator);
+        break;
+    }
+
+    case IMJ_WRITE: {
+        __imjw_valcstr(imj, value, default_);
+        break;
+    }
+
+    case IMJ_PATCH: {
+        __imjp_valcstr(imj, value, default_);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
+
+// the value as base64 text, or as raw bytes when cbor has it as a byte string
+static bool __imjr_bytes(imj_t *imj, imj_sv_t *data, bool *raw) {
+    *data = (imj_sv_t){0};
+    *raw = false;
+    if (imj->had_error) return false;
+
+    __imj_assert(!imj->done, "already finished processing");
+    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
 
-    imj_lvl_t *obj = __imj_dive_into_obj(imj);
+    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) return false;
 
-    bool incorrect_pending_value = imj->value_pending && *imj->current != '{';
-    bool is_at_root = imj->lvl_or_null->prev == NULL;
-    if (incorrect_pending_value || (!is_at_root && !imj->value_pending)) {
-        obj->left_off_or_null = NULL;
-        return false;
+    char *start = imj->current;
+    bool success = false;
+    bool done = false;
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        uint8_t ib;
+        uint64_t arg;
+        done = __imjr_cbor_head(imj, &ib, &arg) && (ib >> 5) == __IMJ_CBOR_BYTES;
+        if (done) {
+            data->data = imj->current;
+            data->length = (size_t)arg;
+            *raw = true;
+            success = __imjr_cbor_payload(imj, arg);
+        }
+    } else if (__imjr_peek(imj) == '"') {
+        // base64 has no quotes, so the first one ends the string unless it's escaped
+        char *quote = memchr(start + 1, '"', __imjr_end(imj) - start - 1);
+        done = quote && quote[-1] != '\\';
+        if (done) {
+            data->data = start + 1;
+            data->length = quote - start - 1;
+            imj->current = quote + 1;
+            success = true;
+        }
     }
 
-    __imjr_skip_whitespace(imj);
-
+    if (!done && !imj->had_error) {
+        imj->current = start;
 
-    if (!__imjr_consume(imj, '{')) {
-        __imjr_parse_error(imj, "expected '{' for object");
+        imj_val_t val;
+        success = __imjr_read_val(imj, &val) && val.kind == IMJ_STRING;
+        if (success) *data = val.sv;
     }
 
-    __imjr_skip_whitespace(imj);
+    __imjr_update_array_if_necessary(imj);
 
-    obj->left_off_or_null = imj->current;
+    return success;
+}
 
-    return true;
+static bool __imjr_valbytes(imj_t *imj, void *buf, size_t *len, size_t cap) {
+    imj_sv_t data;
+    bool raw;
+    bool success = __imjr_bytes(imj, &data, &raw);
+    *len = 0;
+    if (!success) return false;
+
+    if (raw) {
+        if (data.length <= cap) {
+            if (data.length > 0) memcpy(buf, data.data, data.length);
+            *len = data.length;
+            return true;
+        }
+
+        *len = data.length;
+        return false;
+    }
+
+    if (__imj_base64_decode(data.data, data.length, buf, cap, len)) return true;
+
+    size_t need = __imj_base64_decoded_length(data.data, data.length);
+    *len = need > cap ? need : 0;
+    return false;
 }
 
-static void __imjw_begin_obj(imj_t *imj) {
+static void __imjw_valbytes(imj_t *imj, const void *data, size_t n) {
+    if (imj->had_error) return;
+
     __imj_assert(!imj->done, "already finished processing");
     __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
 
     __imjw_add_comma_and_ws_if_necessary(imj);
+    __imjw_put_bytes(imj, data, n);
+    __imjw_pop_necessary_lvls_after_val(imj);
+}
+
+bool imj_valbytes(imj_t *imj, void *buf, size_t *len, size_t cap) {
+    bool success = true;
+    switch (__imj_io_mode(imj)) {
+    case IMJ_READ: {
+        success = __imjr_valbytes(imj, buf, len, cap);
+        break;
+    }
 
-    __imjw_update_aggregate_count_if_necessary(imj);
+    case IMJ_WRITE: {
+        __imjw_valbytes(imj, buf, len ? *len : 0);
+        break;
+    }
 
-    __imj_dive_into_obj(imj);
+    case IMJ_PATCH: {
+        __imjp_valbytes(imj, buf, len ? *len : 0);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
+    }
+
+    return success;
+}
 
-    __imjw_sb_add_str(&imj->sb, "{", 1, &imj->arena);
+static bool __imjr_valbytes_alloc(imj_t *imj, void **buf, size_t *len, imj_alloc alloc, void *allocator) {
+    imj_sv_t data;
+    bool raw;
+    bool success = __imjr_bytes(imj, &data, &raw);
+    *buf = NULL;
+    *len = 0;
+    if (!success) return false;
+
+    size_t need = raw ? data.length : __imj_base64_decoded_length(data.data, data.length);
+    uint8_t *p = NULL;
+    if (need > 0 && alloc == NULL) {
+        imj_strings_t *strings = allocator ? allocator : imj->strings;
+        __imj_assert(strings, "needs an allocator or a string store");
+        p = __imj_arena_alloc(&strings->arena, need);
+        strings->bytes += need;
+    } else if (need > 0) {
+        p = alloc(allocator, need);
+    }
+    if (need > 0 && p == NULL) return false;
+
+    if (raw) {
+        if (need > 0) memcpy(p, data.data, need);
+        *len = need;
+    } else if (!__imj_base64_decode(data.data, data.length, p, need, len)) {
+        success = false;
+    }
+
+    *buf = p;
+    return success;
 }
 
-bool imj_begin_obj(imj_t *imj) {
+bool imj_valbytes_alloc(imj_t *imj, void **buf, size_t *len, imj_alloc alloc, void *allocator) {
     bool success = true;
-    switch (imj->io_mode) {
+    switch (__imj_io_mode(imj)) {
     case IMJ_READ: {
-        success = __imjr_begin_obj(imj);
+        success = __imjr_valbytes_alloc(imj, buf, len, alloc, allocator);
         break;
     }
+
     case IMJ_WRITE: {
-        __imjw_begin_obj(imj);
+        __imjw_valbytes(imj, buf ? *buf : NULL, len ? *len : 0);
         break;
     }
+
+    case IMJ_PATCH: {
+        __imjp_valbytes(imj, buf ? *buf : NULL, len ? *len : 0);
+        __imjp_update(imj);
+        break;
+    }
+    }
+
+    if (imj->lvl_or_null == NULL) {
+        imj->done = true;
     }
 
     return success;
 }
 
-static void __imjr_end_obj(imj_t *imj) {
-    if (imj->had_error) return;
+bool imj_key_valnull(imj_t *imj, const char *key) {
+    bool found = imj_key(imj, key);
+    found &= imj_valnull(imj);
+    return found;
+}
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "cannot end object without being inside an object");
+bool imj_key_valb(imj_t *imj, const char *key, bool *value, bool default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valb(imj, value, default_);
+    return found;
+}
 
-    if (imj->lvl_or_null->left_off_or_null) {
-        imj->current = imj->lvl_or_null->left_off_or_null;
-        __imjr_skip_obj(imj);
+bool imj_key_vali(imj_t *imj, const char *key, int *value, int default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vali(imj, value, default_);
+    return found;
+}
+
+bool imj_key_vals(imj_t *imj, const char *key, size_t *value, size_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vals(imj, value, default_);
+    return found;
+}
+
+bool imj_key_vali64(imj_t *imj, const char *key, int64_t *value, int64_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vali64(imj, value, default_);
+    return found;
+}
+
+bool imj_key_valu64(imj_t *imj, const char *key, uint64_t *value, uint64_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valu64(imj, value, default_);
+    return found;
+}
+
+bool imj_key_vali32(imj_t *imj, const char *key, int32_t *value, int32_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vali32(imj, value, default_);
+    return found;
+}
+
+bool imj_key_valu32(imj_t *imj, const char *key, uint32_t *value, uint32_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valu32(imj, value, default_);
+    return found;
+}
+
+bool imj_key_vali16(imj_t *imj, const char *key, int16_t *value, int16_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vali16(imj, value, default_);
+    return found;
+}
+
+bool imj_key_valu16(imj_t *imj, const char *key, uint16_t *value, uint16_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valu16(imj, value, default_);
+    return found;
+}
+
+bool imj_key_vali8(imj_t *imj, const char *key, int8_t *value, int8_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vali8(imj, value, default_);
+    return found;
+}
+
+bool imj_key_valu8(imj_t *imj, const char *key, uint8_t *value, uint8_t default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valu8(imj, value, default_);
+    return found;
+}
+
+bool imj_key_valf(imj_t *imj, const char *key, float *value, float default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valf(imj, value, default_);
+    return found;
+}
+
+bool imj_key_vald(imj_t *imj, const char *key, double *value, double default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_vald(imj, value, default_);
+    return found;
+}
+
+bool imj_key_valcstr(imj_t *imj, const char *key, const char **value, const char *default_, imj_alloc alloc, void *allocator) {
+    bool found = imj_key(imj, key);
+    found &= imj_valcstr(imj, value, default_, alloc, allocator);
+    return found;
+}
+
+bool imj_key_valbytes(imj_t *imj, const char *key, void *buf, size_t *len, size_t cap) {
+    bool found = imj_key(imj, key);
+    found &= imj_valbytes(imj, buf, len, cap);
+    return found;
+}
+
+bool imj_key_valbytes_alloc(imj_t *imj, const char *key, void **buf, size_t *len, imj_alloc alloc, void *allocator) {
+    bool found = imj_key(imj, key);
+    found &= imj_valbytes_alloc(imj, buf, len, alloc, allocator);
+    return found;
+}
+
+bool imj_key_valrawsv(imj_t *imj, const char *key, imj_sv_t *value, const char *default_) {
+    bool found = imj_key(imj, key);
+    found &= imj_valrawsv(imj, value, default_);
+    return found;
+}
+
+void imjw_valb(imj_t *imj, bool value) {
+    __imjw_valb(imj, NULL, value);
+}
+
+void imjw_vali(imj_t *imj, int value) {
+    __imjw_vali(imj, NULL, value);
+}
+
+void imjw_vals(imj_t *imj, size_t value) {
+    __imjw_vals(imj, NULL, value);
+}
+
+void imjw_valf(imj_t *imj, float value) {
+    __imjw_valf(imj, NULL, value);
+}
+
+void imjw_vald(imj_t *imj, double value) {
+    __imjw_vald(imj, NULL, value);
+}
+
+void imjw_valcstr(imj_t *imj, const char *value) {
+    __imjw_valcstr(imj, NULL, value);
+}
+
+static void __imjw_put_double_exact(imj_t *imj, double val, bool single) {
+    if (imj->encoding == IMJ_ENCODING_CBOR) {
+        if (single) __imjw_put_float(imj, (float)val);
+        else __imjw_put_double(imj, val);
+        return;
     }
 
-    __imj_pop_lvl(imj);
+    if (!isfinite(val)) {
+        __imjw_put_null(imj);
+        return;
+    }
 
-    if (imj->lvl_or_null) {
-        if (imj->lvl_or_null->type == IMJ_KEY_VALUE) {
-            __imj_pop_lvl(imj);
+    // shortest text that reads back as the same value
+    char buffer[32];
+    int len = 0;
+    for (int precision = single ? 6 : 15; precision <= (single ? 9 : 17); ++precision) {
+        len = snprintf(buffer, sizeof(buffer), "%.*g", precision, val);
+        if (single ? strtof(buffer, NULL) == (float)val : strtod(buffer, NULL) == val) break;
+    }
+
+    __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+}
+
+static void __imj_transcode_json_scalar(imj_t *from, imj_t *to) {
+    char *start = from->current;
+
+    imj_val_t val;
+    if (!__imjr_read_val(from, &val)) return;
+
+    __imjw_add_comma_and_ws_if_necessary(to);
+
+    switch (val.kind) {
+    case IMJ_NULL: __imjw_put_null(to); break;
+    case IMJ_BOOL: __imjw_put_bool(to, val.b); break;
+    case IMJ_STRING: __imjw_put_rawstr(to, val.sv); break;
+    case IMJ_NUMBER: {
+        imj_sv_t num = {
+            .data = start,
+            .length = from->current - start,
+        };
+
+        if (to->encoding == IMJ_ENCODING_JSON) {
+            __imjw_sb_add_str(&to->sb, num.data, num.length, &to->arena);
+            break;
         }
 
-        __imjr_update_array_if_necessary(imj);
+        // -0 stays a double, as an integer it would lose its sign
+        int64_t i;
+        if (val.integral && num.data[0] != '-') {
+            __imjw_put_uint(to, val.s);
+        } else if (val.integral && val.s != 0 && __imjr_num_i64(from, &val, &i)) {
+            __imjw_put_int(to, i);
+        } else {
+            __imjw_put_double(to, __imjr_num_double(from, &val));
+        }
+        break;
     }
+    default: __imjw_put_null(to); break;
+    }
+
+    __imjw_pop_necessary_lvls_after_val(to);
 }
 
-static void __imjw_end_obj(imj_t *imj) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null->type == IMJ_OBJECT, "must be inside array to exit");
+static void __imj_transcode_json(imj_t *from, imj_t *to) {
+    size_t depth = 0;
+    bool item_done = false;
+    bool after_comma = false;
 
-    size_t key_value_count = imj->lvl_or_null->count;
-    __imj_pop_lvl(imj);
-    --imj->indent_lvl;
+    while (!from->had_error) {
+        __imjr_skip_whitespace(from);
 
-    __imjw_pop_necessary_lvls_after_val(imj);
+        if (item_done) {
+            if (depth == 0) return;
 
-    if (key_value_count > 0) {
-        switch (imj->render_style) {
-        case IMJ_STYLE_MIN: break;
-        case IMJ_STYLE_SINGLE_LINE: {
-            __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
+            if (__imjr_match(from, ',')) {
+                item_done = false;
+                after_comma = true;
+                continue;
+            }
+        }
+
+        imj_val_kind_t top = depth > 0 ? to->lvl_or_null->type : IMJ_NONE;
+        char close = top == IMJ_OBJECT ? '}' : top == IMJ_ARRAY ? ']' : '\0';
+        if (close != '\0' && __imjr_match(from, close)) {
+            if (after_comma) {
+                __imjr_parse_error(from, "cannot have ',' before closing an aggregate");
+                return;
+            }
+
+            if (top == IMJ_OBJECT) __imjw_end_obj(to);
+            else __imjw_end_arr(to);
+
+            --depth;
+            item_done = true;
+            continue;
+        }
+
+        if (item_done) {
+            __imjr_parse_error(from, "expected ',' between values");
+            return;
+        }
+
+        after_comma = false;
+
+        if (top == IMJ_OBJECT) {
+            imj_sv_t key;
+            if (!__imjr_match(from, '"')) {
+                __imjr_parse_error(from, "expected key");
+                return;
+            }
+
+            if (!__imjr_read_str(from, &key)) return;
+
+            __imjr_skip_whitespace(from);
+            if (!__imjr_consume(from, ':')) {
+                __imjr_parse_error(from, "expected ':' after key");
+                return;
+            }
+
+            __imjw_keyn(to, key.data, key.length, true);
+            continue;
+        }
+
+        switch (__imjr_peek(from)) {
+        case '{': {
+            ++from->current;
+            __imjw_begin_obj(to);
+            ++depth;
             break;
         }
-        case IMJ_STYLE_PRETTY: {
-            __imjw_sb_add_str(&imj->sb, "\n", 1, &imj->arena);
-            __imjw_sb_add_indent(imj);
+
+        case '[': {
+            ++from->current;
+            __imjw_begin_arr(to);
+            ++depth;
+            break;
+        }
+
+        case '\0': {
+            __imjr_parse_error(from, "expected value before end of file");
+            return;
+        }
+
+        default: {
+            __imj_transcode_json_scalar(from, to);
+            item_done = true;
             break;
         }
         }
     }
-
-    __imjw_sb_add_str(&imj->sb, "}", 1, &imj->arena);
 }
 
-void imj_end_obj(imj_t *imj) {
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        __imjr_end_obj(imj);
-        break;
-    }
-    case IMJ_WRITE: {
-        __imjw_end_obj(imj);
-        break;
-    }
-    }
+static void __imj_transcode_cbor(imj_t *from, imj_t *to) {
+    struct {
+        size_t *items;
+        size_t count;
+        size_t capacity;
+    } left = {0};
+
+    bool started = false;
+    while (!from->had_error) {
+        if (started && left.count == 0) return;
+        started = true;
+
+        if (left.count > 0) {
+            if (left.items[left.count-1] == 0) {
+                if (to->lvl_or_null->type == IMJ_OBJECT) __imjw_end_obj(to);
+                else __imjw_end_arr(to);
+                --left.count;
+                continue;
+            }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
-    }
-}
+            --left.items[left.count-1];
 
-static void __imj_dive_into_key(imj_t *imj, bool value_pending) {
-    imj_lvl_t *lvl = __imj_arena_alloc(&imj->arena, sizeof(imj_lvl_t));
-    *lvl = (imj_lvl_t){0};
-    lvl->type = IMJ_KEY_VALUE;
-    lvl->prev = imj->lvl_or_null;
-    imj->lvl_or_null = lvl;
-    imj->value_pending = value_pending;
-}
+            if (to->lvl_or_null->type == IMJ_OBJECT) {
+                imj_val_t key;
+                if (!__imjr_cbor_read_val(from, &key)) return;
+                if (key.kind != IMJ_STRING) {
+                    __imjr_parse_error(from, "only text keys are supported");
+                    return;
+                }
 
-static bool __imjr_key(imj_t *imj, const char *key) {
+                __imjw_keyn(to, key.sv.data, key.sv.length, false);
+            }
+        }
 
-    imj->value_pending = false;
+        char *start = from->current;
+        uint8_t ib;
+        uint64_t arg;
+        if (!__imjr_cbor_head(from, &ib, &arg)) return;
 
-    if (imj->had_error) return false;
+        switch (ib >> 5) {
+        case __IMJ_CBOR_ARRAY: {
+            __imjw_begin_arr(to);
+            __imj_da_push(&left, (size_t)arg, &from->arena);
+            continue;
+        }
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "keys can only reside inside objects");
+        case __IMJ_CBOR_MAP: {
+            __imjw_begin_obj(to);
+            __imj_da_push(&left, (size_t)arg, &from->arena);
+            continue;
+        }
 
-    imj_lvl_t *obj = imj->lvl_or_null;
+        case __IMJ_CBOR_BYTES: {
+            const char *data = from->current;
+            if (!__imjr_cbor_payload(from, arg)) return;
 
-    if (imj->lvl_or_null->left_off_or_null == NULL) {
-        __imj_dive_into_key(imj, false);
-        return false;
-    }
+            __imjw_add_comma_and_ws_if_necessary(to);
+            __imjw_put_bytes(to, data, (size_t)arg);
+            __imjw_pop_necessary_lvls_after_val(to);
+            continue;
+        }
 
-    char *left_off = obj->left_off_or_null;
+        default: break;
+        }
 
-    for (size_t i = 0; i < obj->keys.count; ++i) {
-        imj_key_t k = obj->keys.items[i];
-        if (imj_sv_cstr_eq(k.name, key)) {
-            imj->current = k.loc;
-            __imj_dive_into_key(imj, true);
-            return true;
+        from->current = start;
+
+        imj_val_t val;
+        if (!__imjr_cbor_read_val(from, &val)) return;
+
+        __imjw_add_comma_and_ws_if_necessary(to);
+
+        switch (val.kind) {
+        case IMJ_BOOL: __imjw_put_bool(to, val.b); break;
+        case IMJ_STRING: __imjw_put_str(to, val.sv.data, val.sv.length); break;
+        case IMJ_NUMBER: {
+            switch (ib >> 5) {
+            case __IMJ_CBOR_UINT: __imjw_put_uint(to, arg); break;
+            case __IMJ_CBOR_NEGINT: {
+                if (arg <= (uint64_t)LLONG_MAX) __imjw_put_int(to, (long long)~arg);
+                else __imjw_put_double_exact(to, val.d, false);
+                break;
+            }
+            default: __imjw_put_double_exact(to, val.d, (ib & 0x1f) != 27); break;
+            }
+            break;
         }
+        default: __imjw_put_null(to); break;
+        }
+
+        __imjw_pop_necessary_lvls_after_val(to);
     }
+}
 
-    imj->current = left_off;
+bool imj_transcode(imj_t *from, imj_t *to) {
+    __imj_assert(from->io_mode == IMJ_READ, "can only transcode from a reader");
+    __imj_assert(to->io_mode == IMJ_WRITE, "can only transcode into a writer");
+    __imj_assert(!from->done, "already finished processing");
+    __imj_assert(from->lvl_or_null == NULL || from->lvl_or_null->type == IMJ_KEY_VALUE || from->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
 
-    while (true) {
-        if (*imj->current == '\0') {
-            __imjr_parse_error(imj, "object needs '}' to close");
-            return false;
+    if (from->had_error || __imjr_use_default_value_and_pop_lvl_if_possible(from)) {
+        __imjw_valnull(to);
+    } else {
+        switch (from->encoding) {
+        case IMJ_ENCODING_JSON: __imj_transcode_json(from, to); break;
+        case IMJ_ENCODING_CBOR: __imj_transcode_cbor(from, to); break;
         }
 
-        if (__imjr_match(imj, '\"')) {
-            imj_sv_t key_name;
-            if (!__imjr_read_str(imj, &key_name)) return false;
+        __imjr_update_array_if_necessary(from);
+    }
 
-            __imjr_skip_whitespace(imj);
+    if (from->lvl_or_null == NULL) {
+        from->done = true;
+    }
 
-            if (!__imjr_consume(imj, ':')) {
-                __imjr_parse_error(imj, "expected ':' after key");
-                return false;
-            }
+    if (to->lvl_or_null == NULL) {
+        to->done = true;
+    }
 
-            __imjr_skip_whitespace(imj);
+    return !from->had_error;
+}
 
-            imj_key_t imj_key = {
-                .name = key_name,
-                .loc = imj->current,
-            };
+// 'p' is just after the opening quote, returns just after the closing one or null
+// these return where they stopped, which is where the error is when they set 'message'
+static const char *__imjv_skip_str(const char *p, const char *end, const char **message) {
+    while (true) {
+#ifdef __IMJ_SSE2
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+            __m128i quote = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'));
+            __m128i backslash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+            __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0x1f)), _mm_set1_epi8(0x1f));
+
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, backslash), control));
+            if (mask) {
+                p += __imj_ctz(mask);
+                break;
+            }
+            p += 16;
+        }
+#endif
 
-            __imj_da_push(&obj->keys, imj_key, &imj->arena);
+        if (p >= end) {
+            *message = "found end of data before end of string";
+            return p;
+        }
 
-            if (imj_sv_cstr_eq(key_name, key)) {
-                __imj_dive_into_key(imj, true);
-                return true;
-            }
+        unsigned char c = (unsigned char)*p;
+        if (c == '"') return p + 1;
 
+        if (c < 0x20) {
+            *message = "control characters must be escaped in strings";
+            return p;
+        }
 
-            __imjr_skip_value(imj);
+        ++p;
+        if (c != '\\') continue;
 
-            __imjr_skip_whitespace(imj);
+        if (p >= end) {
+            *message = "found end of data before end of string";
+            return p;
+        }
 
-            if (__imjr_match(imj, ',')) {
-                __imjr_skip_whitespace(imj);
-                if (*imj->current == '}') {
-                    __imjr_parse_error(imj, "cannot end object with ','");
-                    return false;
+        switch (*p) {
+        case '"': case '\\': case '/':
+        case 'b': case 'f': case 'n':
+        case 'r': case 't': ++p; break;
+
+        case 'u': {
+            ++p;
+            for (size_t i = 0; i < 4; ++i, ++p) {
+                if (p >= end || !isxdigit((unsigned char)*p)) {
+                    *message = "invalid hex digit";
+                    return p;
                 }
             }
+            break;
+        }
 
-            obj->left_off_or_null = imj->current;
-        } else {
-            // no value consumed, we haven't found the key
-            // but user expects value to be pending.
-            if (__imjr_consume(imj, '}')) {
-                __imj_dive_into_key(imj, false);
-                return false;
-            }
-
-            __imjr_parse_error(imj, "unexpected character.");
-            return false;
+        default: {
+            *message = "invalid escape sequence";
+            return p;
+        }
         }
     }
 }
 
-static void __imjw_key(imj_t *imj, const char *key) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null && imj->lvl_or_null->type == IMJ_OBJECT, "keys can only reside inside objects");
+static const char *__imjv_skip_digits(const char *p, const char *end, const char **message) {
+    if (p >= end || !__imjr_is_digit(*p)) {
+        *message = "expected digit";
+        return p;
+    }
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+#ifdef __IMJ_SSE2
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
 
-    __imj_dive_into_key(imj, false);
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8(digits) & 0xffff;
+        if (mask) return p + __imj_ctz(mask);
+        p += 16;
+    }
+#endif
 
-    __imjw_sb_add_str_as_jsonstr(&imj->sb, key, strlen(key), &imj->arena);
+    while (p < end && __imjr_is_digit(*p)) ++p;
+    return p;
+}
 
-    __imjw_sb_add_str(&imj->sb, ":", 1, &imj->arena);
+static const char *__imjv_skip_num(const char *p, const char *end, const char **message) {
+    if (*p == '-') ++p;
 
-    switch (imj->render_style) {
-    case IMJ_STYLE_MIN: break;
-    case IMJ_STYLE_SINGLE_LINE:
-    case IMJ_STYLE_PRETTY: {
-        __imjw_sb_add_str(&imj->sb, " ", 1, &imj->arena);
-        break;
-    }
+    if (p < end && *p == '0') {
+        ++p;
+    } else {
+        p = __imjv_skip_digits(p, end, message);
+        if (*message) return p;
     }
-}
 
-bool imj_key(imj_t *imj, const char *key) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_key(imj, key);
-        break;
+    if (p < end && *p == '.') {
+        p = __imjv_skip_digits(p + 1, end, message);
+        if (*message) return p;
     }
 
-    case IMJ_WRITE: {
-        __imjw_key(imj, key);
-        break;
-    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        p = __imjv_skip_digits(p, end, message);
     }
 
-    return success;
+    return p;
 }
 
-static bool __imjr_is_digit(char c) {
-    switch (c) {
-    case '0': case __imj_cases_non_zero: return true;
+static const char *__imjv_skip_literal(const char *p, const char *end, const char **message) {
+    static const char *literals[] = { "true", "false", "null" };
+
+    for (size_t i = 0; i < 3; ++i) {
+        size_t n = strlen(literals[i]);
+        if ((size_t)(end - p) >= n && memcmp(p, literals[i], n) == 0) return p + n;
     }
-    return false;
+
+    *message = "unexpected value";
+    return p;
 }
 
-static bool __imj_read_num(imj_t *imj, imj_val_t *ret) {
-    *ret = __imj_val_error;
-    bool is_negative = __imjr_match(imj, '-');
+enum __imjv_state_t {
+    __IMJV_VALUE,
+    __IMJV_KEY,
+    __IMJV_AFTER_VALUE,
+};
 
-    size_t nat = 0;
-    double mag = 10;
-    double dec = 0;
+static const char *__imjv_skip_counted_whitespace(const char *p, const char *end, size_t *count) {
+    const char *next = __imjv_skip_whitespace(p, end);
+    *count += (size_t)(next - p);
+    return next;
+}
 
-    bool has_exp = false;
-    bool exp_neg = false;
-    size_t exp = 0;
+static void __imjv_count_str(size_t *count, size_t *bytes, size_t *longest, size_t length) {
+    ++*count;
+    *bytes += length;
+    if (length > *longest) *longest = length;
+}
 
+bool imj_stats(const char *data, size_t n, imj_stats_t *stats, imj_error_t *error) {
+    // one bit per open aggregate, set for objects
+    uint64_t stack[(IMJ_MAX_DEPTH + 63)/64];
+    size_t depth = 0;
+    imj_stats_t counted = {0};
 
-    switch (*imj->current) {
-    case '0': {
-        ++imj->current;
-        break;
-    }
+    const char *end = data + n;
+    const char *p = __imjv_skip_counted_whitespace(data, end, &counted.whitespace_bytes);
+    const char *message = NULL;
+    enum __imjv_state_t state = __IMJV_VALUE;
 
-    case __imj_cases_non_zero: {
-        nat = *imj->current - '0';
-        ++imj->current;
-        while (__imjr_is_digit(*imj->current)) {
-            size_t digit = *imj->current - '0';
-            nat *= 10;
-            nat += digit;
-            ++imj->current;
+    while (message == NULL) {
+        if (state != __IMJV_AFTER_VALUE && p >= end) {
+            message = state == __IMJV_KEY ? "expected key" : "expected value";
+            break;
         }
-        break;
-    }
 
-    default: {
-        __imjr_parse_error(imj, "expected digit");
-        return false;
-    }
-    }
+        switch (state) {
+        case __IMJV_VALUE: {
+            switch (*p) {
+            case '{':
+            case '[': {
+                if (depth >= IMJ_MAX_DEPTH) {
+                    message = "nested too deeply";
+                    break;
+                }
 
-    if (__imjr_match(imj, '.')) {
-        if (!__imjr_is_digit(*imj->current)) {
-            __imjr_parse_error(imj, "expected digit");
-            return false;
+                bool is_obj = *p == '{';
+                if (is_obj) stack[depth/64] |= (uint64_t)1 << (depth%64);
+                else stack[depth/64] &= ~((uint64_t)1 << (depth%64));
+                ++depth;
+                if (is_obj) ++counted.objects;
+                else ++counted.arrays;
+                if (depth > counted.max_depth) counted.max_depth = depth;
+
+                p = __imjv_skip_counted_whitespace(p + 1, end, &counted.whitespace_bytes);
+                if (p < end && *p == (is_obj ? '}' : ']')) {
+                    --depth;
+                    ++p;
+                    state = __IMJV_AFTER_VALUE;
+                } else {
+                    state = is_obj ? __IMJV_KEY : __IMJV_VALUE;
+                }
+                break;
+            }
+
+            case '"': {
+                const char *str = p + 1;
+                p = __imjv_skip_str(str, end, &message);
+                if (message == NULL) __imjv_count_str(&counted.strings, &counted.string_bytes, &counted.longest_string, (size_t)(p - 1 - str));
+                state = __IMJV_AFTER_VALUE;
+                break;
+            }
+
+            case '-': case '0': case __imj_cases_non_zero: {
+                p = __imjv_skip_num(p, end, &message);
+                ++counted.numbers;
+                state = __IMJV_AFTER_VALUE;
+                break;
+            }
+
+            default: {
+                bool is_null = *p == 'n';
+                p = __imjv_skip_literal(p, end, &message);
+                if (message == NULL && is_null) ++counted.nulls;
+                else if (message == NULL) ++counted.bools;
+                state = __IMJV_AFTER_VALUE;
+                break;
+            }
+            }
+            break;
         }
 
-        while (__imjr_is_digit(*imj->current)) {
-            double d = (double)(*imj->current - '0');
-            dec += d/mag;
-            mag *= 10;
+        case __IMJV_KEY: {
+            if (*p != '"') {
+                message = "expected key";
+                break;
+            }
+
+            const char *key = p + 1;
+            p = __imjv_skip_str(key, end, &message);
+            if (message) break;
+            __imjv_count_str(&counted.keys, &counted.key_bytes, &counted.longest_string, (size_t)(p - 1 - key));
 
-            ++imj->current;
+            p = __imjv_skip_counted_whitespace(p, end, &counted.whitespace_bytes);
+            if (p >= end || *p != ':') {
+                message = "expected ':' after key";
+                break;
+            }
+
+            p = __imjv_skip_counted_whitespace(p + 1, end, &counted.whitespace_bytes);
+            state = __IMJV_VALUE;
+            break;
         }
-    }
 
-    if (__imjr_match(imj, 'e') || __imjr_match(imj, 'E')) {
-        has_exp = true;
+        case __IMJV_AFTER_VALUE: {
+            p = __imjv_skip_counted_whitespace(p, end, &counted.whitespace_bytes);
 
-        if (__imjr_match(imj, '-')) {
-            exp_neg = true;
-        } else __imjr_match(imj, '+');
+            bool is_obj = (stack[(depth-1)/64] >> ((depth-1)%64)) & 1;
+            char close = is_obj ? '}' : ']';
 
-        if (!__imjr_is_digit(*imj->current)) {
-            __imjr_parse_error(imj, "expected digit");
-            return false;
+            if (p < end && *p == ',') {
+                p = __imjv_skip_counted_whitespace(p + 1, end, &counted.whitespace_bytes);
+                if (p < end && *p == close) {
+                    message = is_obj ? "cannot end object with ','" : "cannot have ',' before ending an array";
+                    break;
+                }
+                state = is_obj ? __IMJV_KEY : __IMJV_VALUE;
+            } else if (p < end && *p == close) {
+                ++p;
+                --depth;
+            } else {
+                message = is_obj ? "expected ',' or '}' after value" : "expected ',' or ']' after value";
+            }
+            break;
+        }
         }
 
-        while (__imjr_is_digit(*imj->current)) {
-            exp *= 10;
-            exp += (*imj->current - '0');
-            ++imj->current;
+        if (state == __IMJV_AFTER_VALUE && depth == 0 && message == NULL) {
+            // a single value is the whole document
+            p = __imjv_skip_counted_whitespace(p, end, &counted.whitespace_bytes);
+            if (p < end) message = "unexpected data after value";
+            break;
         }
     }
 
-    double num = (double)nat + dec;
-    if (has_exp) {
-        num *= pow(10.0, (exp_neg ? -1.0 : 1.0)*exp);
-    }
+    if (stats) *stats = counted;
+    if (message == NULL) return true;
 
-    if (is_negative) {
-        num = -num;
-    }
+    if (error) {
+        *error = (imj_error_t){
+            .message = message,
+            .offset = p - data,
+            .line = 1,
+            .column = 1,
+        };
 
-    ret->kind = IMJ_NUMBER;
-    ret->s = has_exp ? (size_t)num : nat;
-    ret->i = has_exp ? (size_t)num : (long)nat * (is_negative ? -1 : 1);
-    ret->d = num;
-    ret->b = num != 0;
+        for (const char *c = data; c < p; ++c) {
+            if (*c == '\n') {
+                ++error->line;
+                error->column = 1;
+            } else {
+                ++error->column;
+            }
+        }
+    }
 
-    return true;
+    return false;
 }
 
-static bool __imjr_read_val(imj_t *imj, imj_val_t *ret) {
-    switch (*imj->current) {
-    case '{': {
-        ++imj->current;
-        __imjr_skip_obj(imj);
-        ret->kind = IMJ_OBJECT;
-        break;
-    }
-
-    case '[': {
-        ++imj->current;
-        __imjr_skip_arr(imj);
-        ret->kind = IMJ_ARRAY;
-        break;
-    }
+bool imj_validate(const char *data, size_t n, imj_error_t *error) {
+    return imj_stats(data, n, NULL, error);
+}
 
-    case '0': case '-': case __imj_cases_non_zero: {
-        *ret = (imj_val_t){0};
-        if (!__imj_read_num(imj, ret)) return false;
-        break;
-    }
+// the end of the json value at 'p', null when it's cut off or malformed
+static const char *__imjj_skip_value(const char *p, const char *end) {
+    const char *message = NULL;
+    size_t depth = 0;
+    do {
+        p = __imjv_skip_whitespace(p, end);
+        if (p >= end) return NULL;
+
+        switch (*p) {
+        case '{': case '[': ++depth; ++p; break;
+        case '}': case ']': {
+            if (depth == 0) return NULL;
+            --depth;
+            ++p;
+            break;
+        }
+        case ',': case ':': ++p; break;
+        case '"': p = __imjv_skip_str(p + 1, end, &message); break;
+        case '-': case '0': case __imj_cases_non_zero: p = __imjv_skip_num(p, end, &message); break;
+        default: p = __imjv_skip_literal(p, end, &message); break;
+        }
 
-    case '"': {
-        imj_sv_t sv;
-        ++imj->current;
-        if (!__imjr_read_str(imj, &sv)) return false;
-        *ret = (imj_val_t){0};
-        ret->kind = IMJ_STRING;
-        ret->sv = sv;
-        break;
-    }
+        if (message) return NULL;
+    } while (depth > 0);
 
-    default: {
-        char *start = imj->current;
-        __imjr_skip_until_whitespace_or_comma(imj);
-        imj_sv_t sv = {
-            .data = start,
-            .length = imj->current-start,
-        };
+    return p;
+}
 
-        if (imj_sv_cstr_eq(sv, "true")) {
-            *ret = (imj_val_t){0};
-            ret->kind = IMJ_BOOL;
-            ret->b = true;
-            ret->s = (size_t)true;
-            ret->i = (long)true;
-            ret->d = (double)true;
-        } else if (imj_sv_cstr_eq(sv, "false") || imj_sv_cstr_eq(sv, "null")) {
-            *ret = (imj_val_t){0};
-            ret->kind = sv.data[0] == 'n' ? IMJ_NULL : IMJ_BOOL;
-            ret->b = false;
-            ret->s = (size_t)false;
-            ret->i = (long)false;
-            ret->d = (double)false;
-        } else {
-            __imjr_parse_error(imj, "unexpected value");
-            return false;
-        }
-        break;
-    }
-    }
+static imj_sv_t __imjj_value(const char *data, size_t n) {
+    const char *end = data + n;
+    const char *start = __imjv_skip_whitespace(data, end);
+    const char *value_end = __imjj_skip_value(start, end);
+    return (imj_sv_t){ .data = start, .length = value_end ? (size_t)(value_end - start) : 0 };
+}
 
+typedef struct __imjj_iter_t __imjj_iter_t;
+struct __imjj_iter_t {
+    const char *p;
+    const char *end;
+    char close;
+};
+
+// false when 'val' isn't an object or array
+static bool __imjj_iter_begin(__imjj_iter_t *it, imj_sv_t val) {
+    if (val.length == 0 || (val.data[0] != '{' && val.data[0] != '[')) return false;
+
+    it->p = val.data + 1;
+    it->end = val.data + val.length;
+    it->close = val.data[0] == '{' ? '}' : ']';
     return true;
 }
 
-static bool __imjr_use_default_value_and_pop_lvl_if_possible(imj_t *imj) {
-    bool value_pending = imj->value_pending;
-    imj->value_pending = false;
+// the next member of an object or element of an array, 'key' is escaped and left alone in arrays
+static bool __imjj_iter_next(__imjj_iter_t *it, imj_sv_t *key, imj_sv_t *val) {
+    const char *p = __imjv_skip_whitespace(it->p, it->end);
+    if (p < it->end && *p == ',') p = __imjv_skip_whitespace(p + 1, it->end);
+    if (p >= it->end || *p == it->close) return false;
 
-    if (imj->lvl_or_null) {
-        switch (imj->lvl_or_null->type) {
-        case IMJ_OBJECT: {
-            __imjr_parse_error(imj, "cannot have objects directly inside objects");
-            return true;
-        }
+    if (it->close == '}') {
+        const char *message = NULL;
+        const char *key_end = __imjv_skip_str(p + 1, it->end, &message);
+        if (message) return false;
 
-        case IMJ_KEY_VALUE: {
-            __imj_pop_lvl(imj);
-            break;
+        *key = (imj_sv_t){ .data = p + 1, .length = key_end - p - 2 };
+        p = __imjv_skip_whitespace(key_end, it->end);
+        if (p >= it->end || *p != ':') return false;
+        p = __imjv_skip_whitespace(p + 1, it->end);
+    }
+
+    const char *val_end = __imjj_skip_value(p, it->end);
+    if (val_end == NULL) return false;
+
+    *val = (imj_sv_t){ .data = p, .length = val_end - p };
+    it->p = val_end;
+    return true;
+}
+
+// copies a value without the whitespace between tokens so it fits on one line
+static void __imjj_add_min(imj_sb_t *sb, imj_sv_t val, imj_arena_t *arena) {
+    const char *p = val.data;
+    const char *end = val.data + val.length;
+    while (p < end) {
+        const char *run = p;
+        while (p < end && *p != '"' && !__imjr_is_whitespace(*p)) ++p;
+        __imjw_sb_add_str(sb, run, p - run, arena);
+        if (p >= end) break;
+
+        if (*p == '"') {
+            const char *message = NULL;
+            const char *str_end = __imjv_skip_str(p + 1, end, &message);
+            __imjw_sb_add_str(sb, p, str_end - p, arena);
+            p = str_end;
+        } else {
+            p = __imjv_skip_whitespace(p, end);
         }
+    }
+}
 
-        case IMJ_ARRAY: break;
+typedef struct __imjj_diff_t __imjj_diff_t;
+struct __imjj_diff_t {
+    imj_arena_t arena;
+    imj_sb_t path; // the unescaped json pointer of what's being compared
+    imj_sb_t line;
+    size_t ops;
+};
 
-        default: assert(false); break;
+static void __imjj_path_add_key(__imjj_diff_t *diff, imj_sv_t key) {
+    size_t length = key.length;
+    char *unescaped = (char*)key.data;
+    if (memchr(key.data, '\\', key.length)) {
+        unescaped = __imj_arena_alloc(&diff->arena, key.length + 1);
+        __imj_unescape(key, unescaped, key.length, &length);
     }
+
+    __imjw_sb_add_str(&diff->path, "/", 1, &diff->arena);
+    for (size_t i = 0; i < length; ++i) {
+        switch (unescaped[i]) {
+        case '~': __imjw_sb_add_str(&diff->path, "~0", 2, &diff->arena); break;
+        case '/': __imjw_sb_add_str(&diff->path, "~1", 2, &diff->arena); break;
+        default: __imjw_sb_add_str(&diff->path, &unescaped[i], 1, &diff->arena); break;
+        }
     }
+}
 
-    return !value_pending;
+static void __imjj_path_add_index(__imjj_diff_t *diff, size_t index) {
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "/%zu", index);
+    __imjw_sb_add_str(&diff->path, buffer, length, &diff->arena);
 }
 
-static bool __imjr_valnull(imj_t *imj) {
-    if (imj->had_error) {
-        return false;
+// escapes every control byte, one left raw would make the line invalid json and replay would stop at it
+static void __imjj_add_escaped(imj_sb_t *sb, const char *data, size_t length, imj_arena_t *arena) {
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+        const char *escaped = c == '"' ? "\\\"" : c == '\\' ? "\\\\" : c == '\b' ? "\\b" : c == '\f' ? "\\f"
+            : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\t' ? "\\t" : NULL;
+        if (escaped) {
+            __imjw_sb_add_str(sb, escaped, 2, arena);
+        } else if ((unsigned char)c < 0x20) {
+            char code[7];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+            __imjw_sb_add_str(sb, code, 6, arena);
+        } else {
+            __imjw_sb_add_str(sb, &c, 1, arena);
+        }
     }
+}
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+static void __imjj_put_op(__imjj_diff_t *diff, const char *op, const imj_sv_t *val_or_null) {
+    __imjw_sb_add_str(&diff->line, diff->ops == 0 ? "[{\"op\": \"" : ", {\"op\": \"", diff->ops == 0 ? 9 : 10, &diff->arena);
+    __imjw_sb_add_str(&diff->line, op, strlen(op), &diff->arena);
+    __imjw_sb_add_str(&diff->line, "\", \"path\": \"", 12, &diff->arena);
+    // unlike other strings '/' isn't escaped, so paths read the way they're written
+    __imjj_add_escaped(&diff->line, diff->path.items, diff->path.count, &diff->arena);
+    __imjw_sb_add_str(&diff->line, "\"", 1, &diff->arena);
+    if (val_or_null) {
+        __imjw_sb_add_str(&diff->line, ", \"value\": ", 11, &diff->arena);
+        __imjj_add_min(&diff->line, *val_or_null, &diff->arena);
+    }
+    __imjw_sb_add_str(&diff->line, "}", 1, &diff->arena);
+    ++diff->ops;
+}
 
+typedef struct __imjj_member_t __imjj_member_t;
+struct __imjj_member_t {
+    imj_sv_t key;
+    imj_sv_t val;
+    bool seen;
+};
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        return false;
-    }
+typedef struct __imjj_members_t __imjj_members_t;
+struct __imjj_members_t {
+    __imjj_member_t *items;
+    size_t count;
+    size_t capacity;
+};
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
+static void __imjj_diff(__imjj_diff_t *diff, imj_sv_t old, imj_sv_t new_) {
+    // unchanged parts were rendered by the same writer, so they're the same text
+    if (old.length == new_.length && memcmp(old.data, new_.data, old.length) == 0) return;
 
-    __imjr_update_array_if_necessary(imj);
+    size_t mark = diff->path.count;
+    __imjj_iter_t old_it, new_it;
+    imj_sv_t key, val;
 
-    return success && val.kind == IMJ_NULL;
-}
+    if (!__imjj_iter_begin(&old_it, old) || !__imjj_iter_begin(&new_it, new_) || old_it.close != new_it.close) {
+        __imjj_put_op(diff, "replace", &new_);
+        return;
+    }
 
-static void __imjw_valnull(imj_t *imj) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    if (old.data[0] == '{') {
+        __imjj_members_t members = {0};
+        while (__imjj_iter_next(&old_it, &key, &val)) {
+            __imjj_member_t member = { .key = key, .val = val };
+            __imj_da_push(&members, member, &diff->arena);
+        }
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+        // keys usually keep their order, so the search starts after the last match
+        size_t hint = 0;
+        while (__imjj_iter_next(&new_it, &key, &val)) {
+            size_t found = members.count;
+            for (size_t i = 0; i < members.count && found == members.count; ++i) {
+                __imjj_member_t *member = &members.items[(hint + i) % members.count];
+                if (!member->seen && __imj_key_eq(member->key, key.data, key.length)) found = (hint + i) % members.count;
+            }
 
-    __imjw_sb_add_str(&imj->sb, "null", 4, &imj->arena);
+            __imjj_path_add_key(diff, key);
+            if (found < members.count) {
+                members.items[found].seen = true;
+                hint = found + 1;
+                __imjj_diff(diff, members.items[found].val, val);
+            } else {
+                __imjj_put_op(diff, "add", &val);
+            }
+            diff->path.count = mark;
+        }
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
-}
+        for (size_t i = 0; i < members.count; ++i) {
+            if (members.items[i].seen) continue;
+            __imjj_path_add_key(diff, members.items[i].key);
+            __imjj_put_op(diff, "remove", NULL);
+            diff->path.count = mark;
+        }
+        return;
+    }
 
-bool imj_valnull(imj_t *imj) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_valnull(imj);
-        break;
+    size_t index = 0;
+    imj_sv_t old_val;
+    bool has_old = __imjj_iter_next(&old_it, &key, &old_val);
+    bool has_new = __imjj_iter_next(&new_it, &key, &val);
+    for (; has_old && has_new; ++index) {
+        __imjj_path_add_index(diff, index);
+        __imjj_diff(diff, old_val, val);
+        diff->path.count = mark;
+
+        has_old = __imjj_iter_next(&old_it, &key, &old_val);
+        has_new = __imjj_iter_next(&new_it, &key, &val);
     }
 
-    case IMJ_WRITE: {
-        __imjw_valnull(imj);
-        break;
+    for (; has_new; has_new = __imjj_iter_next(&new_it, &key, &val)) {
+        __imjw_sb_add_str(&diff->path, "/-", 2, &diff->arena);
+        __imjj_put_op(diff, "add", &val);
+        diff->path.count = mark;
     }
+
+    // removed from the back so the indices before them stay put
+    size_t old_count = index;
+    for (; has_old; has_old = __imjj_iter_next(&old_it, &key, &old_val)) ++old_count;
+    while (old_count > index) {
+        __imjj_path_add_index(diff, --old_count);
+        __imjj_put_op(diff, "remove", NULL);
+        diff->path.count = mark;
     }
+}
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
+// aggregates are only split into children once a path goes through them
+typedef struct __imjj_node_t __imjj_node_t;
+struct __imjj_node_t {
+    imj_sv_t key;
+    bool key_escaped; // keys from the text are, keys from paths aren't
+    imj_sv_t text;
+    char kind; // '{' or '[' once split, 0 while it's text
+    struct {
+        __imjj_node_t **items;
+        size_t count;
+        size_t capacity;
+    } children;
+};
+
+static bool __imjj_node_split(__imjj_node_t *node, imj_arena_t *arena) {
+    if (node->kind) return true;
+
+    __imjj_iter_t it;
+    if (!__imjj_iter_begin(&it, node->text)) return false;
+    node->kind = node->text.data[0];
+
+    imj_sv_t key = {0}, val;
+    while (__imjj_iter_next(&it, &key, &val)) {
+        __imjj_node_t *child = __imj_arena_alloc(arena, sizeof(__imjj_node_t));
+        *child = (__imjj_node_t){ .key = key, .key_escaped = true, .text = val };
+        __imj_da_push(&node->children, child, arena);
     }
+    return true;
+}
 
-    return success;
+static bool __imjj_node_key_eq(__imjj_node_t *node, imj_sv_t name, imj_arena_t *arena) {
+    imj_sv_t key = node->key;
+    if (node->key_escaped && memchr(key.data, '\\', key.length)) {
+        char *unescaped = __imj_arena_alloc(arena, key.length + 1);
+        __imj_unescape(key, unescaped, key.length, &key.length);
+        key.data = unescaped;
+    }
+    return __imj_key_eq(key, name.data, name.length);
 }
 
-static bool __imjr_valb(imj_t *imj, bool *value, bool default_) {
-    if (imj->had_error) {
-        *value = default_;
-        return false;
+// the index of the child 'segment' names, 'count' when there's none and SIZE_MAX when it can't name one
+static size_t __imjj_node_find(__imjj_node_t *node, imj_sv_t segment, imj_arena_t *arena) {
+    if (node->kind == '{') {
+        for (size_t i = 0; i < node->children.count; ++i) {
+            if (__imjj_node_key_eq(node->children.items[i], segment, arena)) return i;
+        }
+        return node->children.count;
     }
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    if (segment.length == 1 && segment.data[0] == '-') return node->children.count;
+    if (segment.length == 0 || segment.length > 19 || (segment.data[0] == '0' && segment.length > 1)) return SIZE_MAX;
 
+    size_t index = 0;
+    for (size_t i = 0; i < segment.length; ++i) {
+        if (!__imjr_is_digit(segment.data[i])) return SIZE_MAX;
+        index = index*10 + (size_t)(segment.data[i] - '0');
+    }
+    return index <= node->children.count ? index : SIZE_MAX;
+}
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        *value = default_;
-        return false;
+// the next segment of 'pointer' with ~0 and ~1 undone, it's copied only when it has them
+static imj_sv_t __imjj_next_segment(const char **pointer, const char *end, imj_arena_t *arena) {
+    const char *start = *pointer + 1;
+    const char *p = start;
+    while (p < end && *p != '/') ++p;
+    *pointer = p;
+
+    imj_sv_t segment = { .data = start, .length = p - start };
+    if (!memchr(start, '~', segment.length)) return segment;
+
+    char *copy = __imj_arena_alloc(arena, segment.length);
+    size_t length = 0;
+    for (const char *c = start; c < p; ++c) {
+        if (*c == '~' && c + 1 < p && (c[1] == '0' || c[1] == '1')) {
+            copy[length++] = *++c == '0' ? '~' : '/';
+        } else {
+            copy[length++] = *c;
+        }
     }
+    return (imj_sv_t){ .data = copy, .length = length };
+}
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
-    if (success && val.kind == IMJ_BOOL) {
-        *value = (bool)val.i;
-    } else {
-        *value = default_;
+// applies add, replace and remove in order, anything else fails
+static bool __imjj_apply(__imjj_node_t *root, imj_sv_t op, imj_sv_t raw_path, imj_sv_t val, imj_arena_t *arena) {
+    bool add = __imj_key_eq(op, "add", 3);
+    bool replace = __imj_key_eq(op, "replace", 7);
+    bool remove = __imj_key_eq(op, "remove", 6);
+    if (!add && !replace && !remove) return false;
+    if (!remove && val.length == 0) return false;
+
+    char *pointer = __imj_arena_alloc(arena, raw_path.length + 1);
+    size_t length;
+    if (!__imj_unescape(raw_path, pointer, raw_path.length, &length)) return false;
+    const char *p = pointer;
+    const char *end = pointer + length;
+
+    if (p == end) {
+        if (remove) return false;
+        *root = (__imjj_node_t){ .text = val };
+        return true;
     }
 
-    __imjr_update_array_if_necessary(imj);
+    __imjj_node_t *node = root;
+    while (true) {
+        if (*p != '/' || !__imjj_node_split(node, arena)) return false;
 
-    return success && val.kind == IMJ_BOOL;
-}
+        imj_sv_t segment = __imjj_next_segment(&p, end, arena);
+        size_t at = __imjj_node_find(node, segment, arena);
+        if (at == SIZE_MAX) return false;
 
-static void __imjw_valb(imj_t *imj, bool *value, bool default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+        if (p < end) {
+            if (at >= node->children.count) return false;
+            node = node->children.items[at];
+            continue;
+        }
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+        bool exists = at < node->children.count;
+        if ((remove || replace) && !exists) return false;
 
-    bool val = value ? *value : default_;
-    __imjw_sb_add_str(&imj->sb,
-        val ? "true" : "false",
-        val ? 4 : 5,
-        &imj->arena);
+        if (remove) {
+            memmove(&node->children.items[at], &node->children.items[at + 1], (node->children.count - at - 1)*sizeof(__imjj_node_t*));
+            --node->children.count;
+            return true;
+        }
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
-}
+        // adding to an object replaces a key it already has, adding to an array inserts
+        if (exists && (replace || node->kind == '{')) {
+            __imjj_node_t *child = node->children.items[at];
+            *child = (__imjj_node_t){ .key = child->key, .key_escaped = child->key_escaped, .text = val };
+            return true;
+        }
 
-bool imj_valb(imj_t *imj, bool *value, bool default_) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_valb(imj, value, default_);
-        break;
+        __imjj_node_t *child = __imj_arena_alloc(arena, sizeof(__imjj_node_t));
+        *child = (__imjj_node_t){ .key = segment, .text = val };
+        __imj_da_push(&node->children, child, arena);
+        memmove(&node->children.items[at + 1], &node->children.items[at], (node->children.count - at - 1)*sizeof(__imjj_node_t*));
+        node->children.items[at] = child;
+        return true;
     }
+}
 
-    case IMJ_WRITE: {
-        __imjw_valb(imj, value, default_);
-        break;
-    }
+static void __imjj_render(imj_sb_t *sb, __imjj_node_t *node, imj_arena_t *arena) {
+    if (node->kind == 0) {
+        __imjw_sb_add_str(sb, node->text.data, node->text.length, arena);
+        return;
     }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
-    }
+    __imjw_sb_add_str(sb, node->kind == '{' ? "{" : "[", 1, arena);
+    for (size_t i = 0; i < node->children.count; ++i) {
+        __imjj_node_t *child = node->children.items[i];
+        if (i > 0) __imjw_sb_add_str(sb, ", ", 2, arena);
 
-    return success;
+        if (node->kind == '{') {
+            if (child->key_escaped) {
+                __imjw_sb_add_str(sb, "\"", 1, arena);
+                __imjw_sb_add_str(sb, child->key.data, child->key.length, arena);
+                __imjw_sb_add_str(sb, "\"", 1, arena);
+            } else {
+                __imjw_sb_add_str(sb, "\"", 1, arena);
+                __imjj_add_escaped(sb, child->key.data, child->key.length, arena);
+                __imjw_sb_add_str(sb, "\"", 1, arena);
+            }
+            __imjw_sb_add_str(sb, ": ", 2, arena);
+        }
+
+        __imjj_render(sb, child, arena);
+    }
+    __imjw_sb_add_str(sb, node->kind == '{' ? "}" : "]", 1, arena);
 }
 
-static bool __imjr_vali(imj_t *imj, int *value, int default_) {
-    if (imj->had_error) {
-        *value = default_;
-        return false;
+// a line is a json patch array, each op an object with "op", "path" and "value"
+static bool __imjj_apply_line(__imjj_node_t *root, imj_sv_t line, imj_arena_t *arena) {
+    __imjj_iter_t ops;
+    imj_sv_t key, op_val;
+    if (!__imjj_iter_begin(&ops, __imjj_value(line.data, line.length)) || ops.close != ']') return false;
+
+    while (__imjj_iter_next(&ops, &key, &op_val)) {
+        __imjj_iter_t members;
+        if (!__imjj_iter_begin(&members, op_val) || members.close != '}') return false;
+
+        imj_sv_t op = {0}, path = {0}, val = {0}, member;
+        bool has_path = false;
+        while (__imjj_iter_next(&members, &key, &member)) {
+            if (member.data[0] == '"') {
+                imj_sv_t str = { .data = member.data + 1, .length = member.length - 2 };
+                if (__imj_key_eq(key, "op", 2)) op = str;
+                if (__imj_key_eq(key, "path", 4)) {
+                    path = str;
+                    has_path = true;
+                }
+            }
+            if (__imj_key_eq(key, "value", 5)) val = member;
+        }
+
+        if (!has_path || !__imjj_apply(root, op, path, val, arena)) return false;
     }
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    return true;
+}
 
+static char *__imjj_read_file(const char *filepath, size_t *size) {
+    FILE *file = fopen(filepath, "rb");
+    if (!file) return NULL;
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        *value = default_;
-        return false;
-    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
-    if (success && val.kind == IMJ_NUMBER) {
-        *value = (int)val.i;
-    } else {
-        *value = default_;
+    char *data = malloc(length > 0 ? (size_t)length : 1);
+    *size = length > 0 ? fread(data, 1, (size_t)length, file) : 0;
+    fclose(file);
+    return data;
+}
+
+static void __imjj_set_snapshot(imj_journal_t *journal, const char *data, size_t n) {
+    if (journal->snapshot.capacity < n + 1) {
+        free(journal->snapshot.items);
+        journal->snapshot.items = malloc(n + 1);
+        journal->snapshot.capacity = n + 1;
     }
 
-    __imjr_update_array_if_necessary(imj);
+    memcpy(journal->snapshot.items, data, n);
+    journal->snapshot.items[n] = '\0';
+    journal->snapshot.count = n;
+}
 
-    return success && val.kind == IMJ_NUMBER;
+static void __imjj_header(char buffer[64], uint64_t base_hash) {
+    snprintf(buffer, 64, "{\"base\": \"%016llx\"}\n", (unsigned long long)base_hash);
 }
 
-static void __imjw_vali(imj_t *imj, int *value, int default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+// the journal only applies to the base it was written against, a compaction cut short leaves one that doesn't
+static bool __imjj_replay(imj_journal_t *journal, imj_sv_t base) {
+    size_t size = 0;
+    char *data = __imjj_read_file(journal->journal_filepath, &size);
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+    char header[64];
+    __imjj_header(header, journal->base_hash);
+    size_t header_length = strlen(header);
 
-    int val = value ? *value : default_;
-    char buffer[12];
-    int len = sprintf(buffer, "%d", val);
-    __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+    if (data == NULL || size < header_length || memcmp(data, header, header_length) != 0) {
+        free(data);
+        __imjj_set_snapshot(journal, base.data, base.length);
+        return true;
+    }
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
-}
+    imj_arena_t arena = {0};
+    __imjj_node_t root = { .text = __imjj_value(base.data, base.length) };
 
-bool imj_vali(imj_t *imj, int *value, int default_) {
-    bool success = false;
+    // every commit ends its line, so only a last line without one was cut off by a crash
+    // a finished line that doesn't parse is damage rather than a torn write, dropping it would lose the commits after it
+    bool success = true;
+    size_t at = header_length;
+    while (at < size) {
+        const char *newline = memchr(data + at, '\n', size - at);
+        if (newline == NULL) break;
+        if (!imj_validate(data + at, newline - (data + at), NULL)) {
+            success = false;
+            break;
+        }
 
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_vali(imj, value, default_);
-        break;
+        imj_sv_t line = { .data = data + at, .length = newline - (data + at) };
+        success = __imjj_apply_line(&root, line, &arena);
+        if (!success) break;
+        at = newline - data + 1;
     }
 
-    case IMJ_WRITE: {
-        __imjw_vali(imj, value, default_);
-        break;
-    }
+    if (success && at < size) {
+        success = __imj_write_atomic(journal->journal_filepath, data, at, IMJ_CODEC_NONE);
     }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
+    if (success) {
+        imj_sb_t sb = {0};
+        __imjj_render(&sb, &root, &arena);
+        __imjj_set_snapshot(journal, sb.items, sb.count);
+        journal->journal_size = at;
     }
 
+    __imj_arena_free(&arena);
+    free(data);
     return success;
 }
 
-static bool __imjr_vals(imj_t *imj, size_t *value, size_t default_) {
-    if (imj->had_error) {
-        *value = default_;
-        return false;
-    }
+bool imj_journal_open(imj_journal_t *journal, const char *filepath) {
+    *journal = (imj_journal_t){0};
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    size_t length = strlen(filepath);
+    journal->filepath = malloc(length + 1);
+    memcpy(journal->filepath, filepath, length + 1);
+    journal->journal_filepath = malloc(length + sizeof(".journal"));
+    memcpy(journal->journal_filepath, filepath, length);
+    memcpy(journal->journal_filepath + length, ".journal", sizeof(".journal"));
 
+    imj_t base;
+    if (!imj_file(filepath, &base, IMJ_READ)) {
+        FILE *file = fopen(filepath, "rb");
+        if (file == NULL) return true;
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        *value = default_;
+        fclose(file);
+        imj_journal_free(journal);
         return false;
     }
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
-    if (success && val.kind == IMJ_NUMBER) {
-        *value = (size_t)val.s;
-    } else {
-        *value = (size_t)default_;
+    bool success = base.encoding == IMJ_ENCODING_JSON;
+    if (success) {
+        journal->base_size = base.src.length;
+        journal->base_hash = __imj_xxh64(base.src.data, base.src.length, 0);
+        success = __imjj_replay(journal, base.src);
     }
 
-    __imjr_update_array_if_necessary(imj);
-
-    return success && val.kind == IMJ_NUMBER;
+    imj_free(&base);
+    if (!success) imj_journal_free(journal);
+    return success;
 }
 
-static void __imjw_vals(imj_t *imj, size_t *value, size_t default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
-
-    __imjw_add_comma_and_ws_if_necessary(imj);
+bool imjr_journal(imj_journal_t *journal, imj_t *imj) {
+    *imj = (imj_t){0};
+    if (journal->snapshot.count == 0) return false;
 
-    size_t val = value ? *value : default_;
-    char buffer[32];
-    int len = sprintf(buffer, "%zu", val);
-    __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+    imjr_cstrn(journal->snapshot.items, journal->snapshot.count, imj);
+    imj->filepath = journal->filepath;
+    return true;
+}
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
+static bool __imjj_compact(imj_journal_t *journal, imj_t *imj) {
+    const char *filepath = imj->filepath;
+    imj->filepath = journal->filepath;
+    bool success = imjw_flush(imj);
+    imj->filepath = filepath;
+    if (!success) return false;
+
+    journal->base_size = imj->sb.count;
+    journal->base_hash = __imj_xxh64(imj->sb.items, imj->sb.count, 0);
+    journal->journal_size = 0;
+    remove(journal->journal_filepath);
+    return true;
 }
 
-bool imj_vals(imj_t *imj, size_t *value, size_t default_) {
+bool imj_journal_commit(imj_journal_t *journal, imj_t *imj) {
+    __imj_assert(imj->io_mode == IMJ_WRITE && imj->encoding == IMJ_ENCODING_JSON, "journals are committed from a json writer");
+    __imj_assert(imj->done, "must be finished to commit");
+    if (imj->had_error) return false;
+
     bool success = true;
-    switch(imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_vals(imj, value, default_);
-        break;
-    }
+    if (journal->snapshot.count == 0) {
+        success = __imjj_compact(journal, imj);
+    } else {
+        __imjj_diff_t diff = {0};
+        __imjj_diff(&diff, __imjj_value(journal->snapshot.items, journal->snapshot.count), __imjj_value(imj->sb.items, imj->sb.count));
 
-    case IMJ_WRITE: {
-        __imjw_vals(imj, value, default_);
-        break;
-    }
-    }
+        // nothing changed, nothing to write
+        if (diff.ops == 0) {
+            __imj_arena_free(&diff.arena);
+            return true;
+        }
+        __imjw_sb_add_str(&diff.line, "]\n", 2, &diff.arena);
+
+        double ratio = journal->compact_ratio > 0 ? journal->compact_ratio : IMJ_JOURNAL_COMPACT_RATIO;
+        if ((double)(journal->journal_size + diff.line.count) > ratio*(double)journal->base_size) {
+            success = __imjj_compact(journal, imj);
+        } else if (journal->journal_size == 0) {
+            // a new journal replaces whatever stale one is left
+            char header[64];
+            __imjj_header(header, journal->base_hash);
+            imj_sb_t first = {0};
+            __imjw_sb_add_str(&first, header, strlen(header), &diff.arena);
+            __imjw_sb_add_str(&first, diff.line.items, diff.line.count, &diff.arena);
+
+            success = __imj_write_atomic(journal->journal_filepath, first.items, first.count, IMJ_CODEC_NONE);
+            if (success) journal->journal_size = first.count;
+        } else {
+            success = __imj_write_file_synced(journal->journal_filepath, diff.line.items, diff.line.count, true);
+            if (success) journal->journal_size += diff.line.count;
+        }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
+        __imj_arena_free(&diff.arena);
     }
 
-    return success;
+    if (success) __imjj_set_snapshot(journal, imj->sb.items, imj->sb.count);
+    return success;
+}
+
+void imj_journal_free(imj_journal_t *journal) {
+    free(journal->filepath);
+    free(journal->journal_filepath);
+    free(journal->snapshot.items);
+    *journal = (imj_journal_t){0};
+}
+
+static int __imjp_edit_cmp(const void *a, const void *b) {
+    const imj_edit_t *x = a;
+    const imj_edit_t *y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
 }
 
-static bool __imjr_valf(imj_t *imj, float *value, float default_) {
-    if (imj->had_error) {
-        *value = default_;
-        return false;
+static const char *__imjp_trim_back(imj_t *imj, const char *p) {
+    while (p > imj->src.data && __imjr_is_whitespace(p[-1])) --p;
+    return p;
+}
+
+// 'insert_into' is the aggregate the rendered value is appended to, otherwise it replaces start to end
+static void __imjp_begin_render(imj_t *imj, const char *start, const char *end, imj_lvl_t *insert_into) {
+    if (!insert_into && (!imj->lvl_or_null || imj->lvl_or_null->type != IMJ_KEY_VALUE)) {
+        // stand-in so the writer doesn't put a separator before the replacement
+        bool value_pending = imj->value_pending;
+        __imj_dive_into_key(imj, false);
+        imj->value_pending = value_pending;
     }
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    imj->render_value_pending = imj->value_pending;
+    imj->render_base = insert_into ? insert_into : imj->lvl_or_null->prev;
+    imj->rendering = (imj_edit_t){
+        .start = start,
+        .end = end,
+        .lvl_or_null = insert_into,
+        .at = imj->sb.count,
+    };
+    imj->is_rendering = true;
+}
 
+// true when there's a source value to compare with, otherwise the value is rendered by the writer
+static bool __imjp_source_val(imj_t *imj, const char **start, const char **end) {
+    if (imj->is_rendering) return false;
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        *value = default_;
+    if (!imj->value_pending) {
+        if (imj->lvl_or_null) {
+            __imjp_begin_render(imj, NULL, NULL, imj->lvl_or_null);
+        } else {
+            __imjp_begin_render(imj, imj->current, imj->src.data + imj->src.length, NULL);
+        }
         return false;
     }
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
-    if (success && val.kind == IMJ_NUMBER) {
-        *value = (float)val.d;
-    } else {
-        *value = (float)default_;
-    }
-
-    __imjr_update_array_if_necessary(imj);
-
-    return success && val.kind == IMJ_NUMBER;
+    *start = imj->current;
+    __imjr_skip_value(imj);
+    *end = imj->current;
+    imj->current = (char*)*start;
+    return true;
 }
 
-static void __imjw_valf(imj_t *imj, float *value, float default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+static void __imjp_update(imj_t *imj) {
+    if (imj->is_rendering && imj->lvl_or_null == imj->render_base) {
+        imj->rendering.length = imj->sb.count - imj->rendering.at;
+        imj->rendering.order = imj->edits.count;
+        __imj_da_push(&imj->edits, imj->rendering, &imj->arena);
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+        imj->is_rendering = false;
+        imj->value_pending = imj->render_value_pending;
+    }
 
-	float val = value ? *value : default_;
-	char buffer[32];
-	int len = sprintf(buffer, "%g", val);
-    __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+    if (imj->lvl_or_null || imj->done || imj->had_error) return;
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
-}
+    // the output is the source with every edit spliced in, sb only held the rendered pieces until now
+    // with no edits both are still empty and the output is a plain copy of the source
+    if (imj->edits.count > 1) qsort(imj->edits.items, imj->edits.count, sizeof(imj_edit_t), __imjp_edit_cmp);
 
-bool imj_valf(imj_t *imj, float *value, float default_) {
-    bool success = true;
-    switch(imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_valf(imj, value, default_);
-        break;
+    size_t length = imj->src.length;
+    for (size_t i = 0; i < imj->edits.count; ++i) {
+        imj_edit_t edit = imj->edits.items[i];
+        length += edit.length;
+        length -= edit.end - edit.start;
     }
 
-    case IMJ_WRITE: {
-        __imjw_valf(imj, value, default_);
-        break;
-    }
+    char *out = __imj_arena_alloc(&imj->arena, length + 1);
+    const char *copied = imj->src.data;
+    size_t n = 0;
+    for (size_t i = 0; i < imj->edits.count; ++i) {
+        imj_edit_t edit = imj->edits.items[i];
+        if (edit.start > copied) memcpy(out + n, copied, edit.start - copied);
+        n += edit.start - copied;
+        if (edit.length > 0) memcpy(out + n, imj->sb.items + edit.at, edit.length);
+        n += edit.length;
+        copied = edit.end;
     }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
-    }
+    if (n < length) memcpy(out + n, copied, length - n);
+    out[length] = '\0';
 
-    return success;
+    imj->sb = (imj_sb_t){
+        .items = out,
+        .count = length,
+        .capacity = length,
+    };
 }
 
-static bool __imjr_vald(imj_t *imj, double *value, double default_) {
-    if (imj->had_error) {
-        *value = default_;
-        return false;
-    }
+static void __imjp_close(imj_t *imj, const char *unvisited_or_null) {
+    imj_lvl_t *lvl = imj->lvl_or_null;
+    if (imj->had_error) return;
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    const char *close = __imjp_trim_back(imj, imj->current - 1);
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        *value = default_;
-        return false;
-    }
+    if (unvisited_or_null) {
+        // fewer values were written than the source has
+        const char *from = __imjp_trim_back(imj, unvisited_or_null);
+        if (from[-1] == ',') from = __imjp_trim_back(imj, from - 1);
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
-    if (success && val.kind == IMJ_NUMBER) {
-        *value = val.d;
-    } else {
-        *value = default_;
+        imj_edit_t edit = {
+            .start = from,
+            .end = close,
+            .order = imj->edits.count,
+        };
+        __imj_da_push(&imj->edits, edit, &imj->arena);
     }
 
-    __imjr_update_array_if_necessary(imj);
+    for (size_t i = lvl->first_edit; i < imj->edits.count; ++i) {
+        imj_edit_t *edit = &imj->edits.items[i];
+        if (edit->lvl_or_null != lvl) continue;
 
-    return success && val.kind == IMJ_NUMBER;
+        edit->start = close;
+        edit->end = close;
+        edit->lvl_or_null = NULL;
+    }
 }
 
-static void __imjw_vald(imj_t *imj, double *value, double default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
-
-    __imjw_add_comma_and_ws_if_necessary(imj);
-
-	double val = value ? *value : default_;
-    char buffer[32];
-    int len = sprintf(buffer, "%g", val);
-    __imjw_sb_add_str(&imj->sb, buffer, len, &imj->arena);
+static bool __imjp_begin_agg(imj_t *imj, imj_val_kind_t kind) {
+    if (imj->had_error) return false;
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
-}
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        if (*start == (kind == IMJ_OBJECT ? '{' : '[')) {
+            bool entered = kind == IMJ_OBJECT ? __imjr_begin_obj(imj) : __imjr_begin_arr(imj);
 
-bool imj_vald(imj_t *imj, double *value, double default_) {
-    bool success = true;
-    switch(imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_vald(imj, value, default_);
-        break;
-    }
+            imj_lvl_t *lvl = imj->lvl_or_null;
+            lvl->first_edit = imj->edits.count;
+            if (kind == IMJ_OBJECT) lvl->count = __imjr_peek(imj) != '}';
+            return entered;
+        }
 
-    case IMJ_WRITE: {
-        __imjw_vald(imj, value, default_);
-        break;
-    }
+        imj->current = (char*)end;
+        imj->value_pending = false;
+        __imjr_update_array_if_necessary(imj);
+        __imjp_begin_render(imj, start, end, NULL);
     }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
+    if (kind == IMJ_OBJECT) {
+        __imjw_begin_obj(imj);
+    } else {
+        __imjw_begin_arr(imj);
     }
 
-    return success;
+    return true;
 }
 
-static bool __imjr_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
-    if (imj->had_error) {
-        *value = imj_cstr2sv(default_);
-        return false;
+static void __imjp_end_agg(imj_t *imj, imj_val_kind_t kind) {
+    if (imj->had_error) return;
+
+    if (imj->is_rendering) {
+        if (kind == IMJ_OBJECT) __imjw_end_obj(imj);
+        else __imjw_end_arr(imj);
+        return;
     }
 
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+    if (kind == IMJ_OBJECT) __imjr_end_obj(imj);
+    else __imjr_end_arr(imj);
+}
 
-    if (__imjr_use_default_value_and_pop_lvl_if_possible(imj)) {
-        *value = imj_cstr2sv(default_);
-        return false;
-    }
+static bool __imjp_keyn(imj_t *imj, const char *key, size_t key_length) {
+    if (imj->had_error) return false;
 
-    imj_val_t val;
-    bool success = __imjr_read_val(imj, &val);
-    if (success && val.kind == IMJ_STRING) {
-        *value = val.sv;
-    } else {
-        *value = imj_cstr2sv(default_);
+    if (imj->is_rendering) {
+        __imjw_keyn(imj, key, key_length, false);
+        return false;
     }
 
-    __imjr_update_array_if_necessary(imj);
+    if (__imjr_keyn(imj, key, key_length)) return true;
+    if (imj->had_error) return false;
 
-    return success && val.kind == IMJ_STRING;
+    // new keys go after the last one in the source
+    __imj_pop_lvl(imj);
+    __imjp_begin_render(imj, NULL, NULL, imj->lvl_or_null);
+    __imjw_keyn(imj, key, key_length, false);
+    return false;
 }
 
-static void __imjw_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
+static bool __imjp_str_eq(imj_t *imj, imj_sv_t raw, const char *s, size_t n) {
+    size_t length = 0;
+    __imj_unescape(raw, NULL, 0, &length);
+    if (length != n) return false;
 
-    __imjw_add_comma_and_ws_if_necessary(imj);
+    char *unescaped = __imjw_sb_extend(&imj->sb, length, &imj->arena);
+    __imj_unescape(raw, unescaped, length, NULL);
+    bool eq = memcmp(unescaped, s, n) == 0;
+    imj->sb.count -= length;
+    return eq;
+}
+
+static void __imjp_valnull(imj_t *imj) {
+    if (imj->had_error) return;
 
-    const char *val = value ? value->data : default_;
-    __imjw_sb_add_str_as_jsonstr(&imj->sb, val, value->length, &imj->arena);
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        if (__imjr_valnull(imj)) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
+    __imjw_valnull(imj);
 }
 
-bool imj_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_valrawsv(imj, value, default_);
-        break;
-    }
+static void __imjp_valb(imj_t *imj, bool *value, bool default_) {
+    if (imj->had_error) return;
 
-    case IMJ_WRITE: {
-        __imjw_valrawsv(imj, value, default_);
-        break;
-    }
+    bool val = value ? *value : default_;
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        bool old;
+        if (__imjr_valb(imj, &old, false) && old == val) return;
+        __imjp_begin_render(imj, start, end, NULL);
     }
 
-    if (imj->lvl_or_null == NULL) {
-        imj->done = true;
+    __imjw_valb(imj, &val, default_);
+}
+
+static void __imjp_vali(imj_t *imj, int *value, int default_) {
+    if (imj->had_error) return;
+
+    int val = value ? *value : default_;
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        int old;
+        if (__imjr_vali(imj, &old, 0) && old == val) return;
+        __imjp_begin_render(imj, start, end, NULL);
     }
 
-    return success;
+    __imjw_vali(imj, &val, default_);
 }
 
-static bool __imjr_valcstr(imj_t *imj, const char **value, const char *default_, imj_alloc alloc, void *allocator) {
-    imj_sv_t sv;
-    bool success = imj_valrawsv(imj, &sv, default_);
-
-    char *new_val = alloc(allocator, sv.length+1);
-    imj_rawsv_to_cstrn(sv, new_val, sv.length);
-    new_val[sv.length] = '\0';
+static void __imjp_vals(imj_t *imj, size_t *value, size_t default_) {
+    if (imj->had_error) return;
 
-    *value = new_val;
+    size_t val = value ? *value : default_;
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        size_t old;
+        if (__imjr_vals(imj, &old, 0) && old == val) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
 
-    return success;
+    __imjw_vals(imj, &val, default_);
 }
 
-static void __imjw_valcstr(imj_t *imj, const char **value, const char *default_) {
-    __imj_assert(!imj->done, "already finished processing");
-    __imj_assert(imj->lvl_or_null == NULL || imj->lvl_or_null->type == IMJ_KEY_VALUE || imj->lvl_or_null->type == IMJ_ARRAY, "cannot put values directly inside objects");
-
-    __imjw_add_comma_and_ws_if_necessary(imj);
+static void __imjp_valint(imj_t *imj, int64_t value, int64_t min, int64_t max) {
+    if (imj->had_error) return;
 
-    const char *val = value ? *value : default_;
-    __imjw_sb_add_str_as_jsonstr(&imj->sb, val, strlen(val), &imj->arena);
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        int64_t old;
+        if (__imjr_valint(imj, &old, 0, min, max) && old == value) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
 
-    __imjw_pop_necessary_lvls_after_val(imj);
-    __imjw_update_aggregate_count_if_necessary(imj);
+    __imjw_valint(imj, value);
 }
 
+static void __imjp_valuint(imj_t *imj, uint64_t value, uint64_t max) {
+    if (imj->had_error) return;
 
-bool imj_valcstr(imj_t *imj, const char **value, const char *default_, imj_alloc alloc, void *allocator) {
-    bool success = true;
-    switch (imj->io_mode) {
-    case IMJ_READ: {
-        success = __imjr_valcstr(imj, value, default_, alloc, allocator);
-        break;
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        uint64_t old;
+        if (__imjr_valuint(imj, &old, 0, max) && old == value) return;
+        __imjp_begin_render(imj, start, end, NULL);
     }
 
-    case IMJ_WRITE: {
-        __imjw_valcstr(imj, value, default_);
-        break;
-    }
-    }
-    
-    return success;
+    __imjw_valuint(imj, value);
 }
 
-bool imj_key_valnull(imj_t *imj, const char *key) {
-    bool found = imj_key(imj, key);
-    found &= imj_valnull(imj);
-    return found;
-}
+static void __imjp_valf(imj_t *imj, float *value, float default_) {
+    if (imj->had_error) return;
 
-bool imj_key_valb(imj_t *imj, const char *key, bool *value, bool default_) {
-    bool found = imj_key(imj, key);
-    found &= imj_valb(imj, value, default_);
-    return found;
-}
+    float val = value ? *value : default_;
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        float old;
+        if (__imjr_valf(imj, &old, 0) && old == val) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
 
-bool imj_key_vali(imj_t *imj, const char *key, int *value, int default_) {
-    bool found = imj_key(imj, key);
-    found &= imj_vali(imj, value, default_);
-    return found;
+    __imjw_valf(imj, &val, default_);
 }
 
-bool imj_key_vals(imj_t *imj, const char *key, size_t *value, size_t default_) {
-    bool found = imj_key(imj, key);
-    found &= imj_vals(imj, value, default_);
-    return found;
-}
+static void __imjp_vald(imj_t *imj, double *value, double default_) {
+    if (imj->had_error) return;
 
-bool imj_key_valf(imj_t *imj, const char *key, float *value, float default_) {
-    bool found = imj_key(imj, key);
-    found &= imj_valf(imj, value, default_);
-    return found;
-}
+    double val = value ? *value : default_;
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        double old;
+        if (__imjr_vald(imj, &old, 0) && old == val) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
 
-bool imj_key_vald(imj_t *imj, const char *key, double *value, double default_) {
-    bool found = imj_key(imj, key);
-    found &= imj_vald(imj, value, default_);
-    return found;
+    __imjw_vald(imj, &val, default_);
 }
 
-bool imj_key_valcstr(imj_t *imj, const char *key, const char **value, const char *default_, imj_alloc alloc, void *allocator) {
-    bool found = imj_key(imj, key);
-    found &= imj_valcstr(imj, value, default_, alloc, allocator);
-    return found;
-}
+static void __imjp_valrawsv(imj_t *imj, imj_sv_t *value, const char *default_) {
+    if (imj->had_error) return;
 
-bool imj_key_valrawsv(imj_t *imj, const char *key, imj_sv_t *value, const char *default_) {
-    bool found = imj_key(imj, key);
-    found &= imj_valrawsv(imj, value, default_);
-    return found;
-}
+    imj_sv_t val = value ? *value : imj_cstr2sv(default_);
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        imj_sv_t old;
+        if (__imjr_valrawsv(imj, &old, "") && __imjp_str_eq(imj, old, val.data, val.length)) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
 
-void imjw_valb(imj_t *imj, bool value) {
-    __imjw_valb(imj, NULL, value);
+    __imjw_valrawsv(imj, &val, default_);
 }
 
-void imjw_vali(imj_t *imj, int value) {
-    __imjw_vali(imj, NULL, value);
+static void __imjp_valcstr(imj_t *imj, const char **value, const char *default_) {
+    const char *val = value ? *value : default_;
+    imj_sv_t sv = imj_cstr2sv(val);
+    __imjp_valrawsv(imj, &sv, val);
 }
 
-void imjw_vals(imj_t *imj, size_t value) {
-    __imjw_vals(imj, NULL, value);
-}
+static bool __imjp_bytes_eq(imj_t *imj, imj_sv_t old, bool raw, const void *data, size_t n) {
+    if (raw) return old.length == n && memcmp(old.data, data, n) == 0;
+    if (old.length != __imj_base64_length(n)) return false;
 
-void imjw_valf(imj_t *imj, float value) {
-    __imjw_valf(imj, NULL, value);
+    char *encoded = __imjw_sb_extend(&imj->sb, old.length, &imj->arena);
+    bool eq = encoded != NULL;
+    if (eq) {
+        __imj_base64_encode(data, n, encoded);
+        eq = memcmp(encoded, old.data, old.length) == 0;
+    }
+    imj->sb.count -= old.length;
+    return eq;
 }
 
-void imjw_vald(imj_t *imj, double value) {
-    __imjw_vald(imj, NULL, value);
-}
+static void __imjp_valbytes(imj_t *imj, const void *data, size_t n) {
+    if (imj->had_error) return;
 
-void imjw_valcstr(imj_t *imj, const char *value) {
-    __imjw_valcstr(imj, NULL, value);
+    const char *start, *end;
+    if (__imjp_source_val(imj, &start, &end)) {
+        imj_sv_t old;
+        bool raw;
+        if (__imjr_bytes(imj, &old, &raw) && __imjp_bytes_eq(imj, old, raw, data, n)) return;
+        __imjp_begin_render(imj, start, end, NULL);
+    }
+
+    __imjw_valbytes(imj, data, n);
 }
 
 #endif
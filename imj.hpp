@@ -0,0 +1,277 @@
+#ifndef IMJ_HPP_
+#define IMJ_HPP_
+
+// c++ front-end: describe a struct once with IMJ_FIELDS and imj::io reads, writes and patches it
+// the implementation is still compiled as c, define IMJ_IMPLEMENTATION in one .c file
+
+#include "imj.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define __IMJ_HAS_SPAN
+#endif
+
+// declares the fields of 'T' for imj::io, at namespace scope next to 'T'
+//
+//     struct weapon_t { int id; bool acquired; };
+//     IMJ_FIELDS(weapon_t, id, acquired)
+//
+// keys are the member names, their lengths are compile-time constants and each field is
+// a direct call to the matching imj_val* function
+#define IMJ_FIELDS(T, ...) \
+    inline bool imj_fields(imj_t *imj, T &obj) { \
+        bool found = true; \
+        __IMJ_EXPAND(__IMJ_CAT(__IMJ_FIELD_, __IMJ_COUNT(__VA_ARGS__))(__IMJ_FIELD, __VA_ARGS__)) \
+        return found; \
+    }
+
+#define __IMJ_FIELD(name) found &= ::imj::field(imj, #name, sizeof(#name) - 1, obj.name);
+
+#define __IMJ_COUNT_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, _33, _34, _35, _36, _37, _38, _39, _40, _41, _42, _43, _44, _45, _46, _47, _48, _49, _50, _51, _52, _53, _54, _55, _56, _57, _58, _59, _60, _61, _62, _63, _64, N, ...) N
+#define __IMJ_COUNT(...) __IMJ_EXPAND(__IMJ_COUNT_N(__VA_ARGS__, 64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define __IMJ_EXPAND(x) x
+#define __IMJ_CAT_(a, b) a##b
+#define __IMJ_CAT(a, b) __IMJ_CAT_(a, b)
+
+#define __IMJ_FIELD_1(f, x) f(x)
+#define __IMJ_FIELD_2(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_1(f, __VA_ARGS__))
+#define __IMJ_FIELD_3(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_2(f, __VA_ARGS__))
+#define __IMJ_FIELD_4(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_3(f, __VA_ARGS__))
+#define __IMJ_FIELD_5(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_4(f, __VA_ARGS__))
+#define __IMJ_FIELD_6(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_5(f, __VA_ARGS__))
+#define __IMJ_FIELD_7(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_6(f, __VA_ARGS__))
+#define __IMJ_FIELD_8(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_7(f, __VA_ARGS__))
+#define __IMJ_FIELD_9(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_8(f, __VA_ARGS__))
+#define __IMJ_FIELD_10(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_9(f, __VA_ARGS__))
+#define __IMJ_FIELD_11(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_10(f, __VA_ARGS__))
+#define __IMJ_FIELD_12(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_11(f, __VA_ARGS__))
+#define __IMJ_FIELD_13(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_12(f, __VA_ARGS__))
+#define __IMJ_FIELD_14(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_13(f, __VA_ARGS__))
+#define __IMJ_FIELD_15(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_14(f, __VA_ARGS__))
+#define __IMJ_FIELD_16(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_15(f, __VA_ARGS__))
+#define __IMJ_FIELD_17(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_16(f, __VA_ARGS__))
+#define __IMJ_FIELD_18(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_17(f, __VA_ARGS__))
+#define __IMJ_FIELD_19(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_18(f, __VA_ARGS__))
+#define __IMJ_FIELD_20(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_19(f, __VA_ARGS__))
+#define __IMJ_FIELD_21(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_20(f, __VA_ARGS__))
+#define __IMJ_FIELD_22(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_21(f, __VA_ARGS__))
+#define __IMJ_FIELD_23(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_22(f, __VA_ARGS__))
+#define __IMJ_FIELD_24(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_23(f, __VA_ARGS__))
+#define __IMJ_FIELD_25(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_24(f, __VA_ARGS__))
+#define __IMJ_FIELD_26(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_25(f, __VA_ARGS__))
+#define __IMJ_FIELD_27(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_26(f, __VA_ARGS__))
+#define __IMJ_FIELD_28(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_27(f, __VA_ARGS__))
+#define __IMJ_FIELD_29(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_28(f, __VA_ARGS__))
+#define __IMJ_FIELD_30(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_29(f, __VA_ARGS__))
+#define __IMJ_FIELD_31(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_30(f, __VA_ARGS__))
+#define __IMJ_FIELD_32(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_31(f, __VA_ARGS__))
+#define __IMJ_FIELD_33(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_32(f, __VA_ARGS__))
+#define __IMJ_FIELD_34(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_33(f, __VA_ARGS__))
+#define __IMJ_FIELD_35(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_34(f, __VA_ARGS__))
+#define __IMJ_FIELD_36(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_35(f, __VA_ARGS__))
+#define __IMJ_FIELD_37(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_36(f, __VA_ARGS__))
+#define __IMJ_FIELD_38(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_37(f, __VA_ARGS__))
+#define __IMJ_FIELD_39(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_38(f, __VA_ARGS__))
+#define __IMJ_FIELD_40(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_39(f, __VA_ARGS__))
+#define __IMJ_FIELD_41(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_40(f, __VA_ARGS__))
+#define __IMJ_FIELD_42(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_41(f, __VA_ARGS__))
+#define __IMJ_FIELD_43(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_42(f, __VA_ARGS__))
+#define __IMJ_FIELD_44(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_43(f, __VA_ARGS__))
+#define __IMJ_FIELD_45(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_44(f, __VA_ARGS__))
+#define __IMJ_FIELD_46(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_45(f, __VA_ARGS__))
+#define __IMJ_FIELD_47(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_46(f, __VA_ARGS__))
+#define __IMJ_FIELD_48(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_47(f, __VA_ARGS__))
+#define __IMJ_FIELD_49(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_48(f, __VA_ARGS__))
+#define __IMJ_FIELD_50(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_49(f, __VA_ARGS__))
+#define __IMJ_FIELD_51(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_50(f, __VA_ARGS__))
+#define __IMJ_FIELD_52(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_51(f, __VA_ARGS__))
+#define __IMJ_FIELD_53(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_52(f, __VA_ARGS__))
+#define __IMJ_FIELD_54(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_53(f, __VA_ARGS__))
+#define __IMJ_FIELD_55(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_54(f, __VA_ARGS__))
+#define __IMJ_FIELD_56(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_55(f, __VA_ARGS__))
+#define __IMJ_FIELD_57(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_56(f, __VA_ARGS__))
+#define __IMJ_FIELD_58(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_57(f, __VA_ARGS__))
+#define __IMJ_FIELD_59(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_58(f, __VA_ARGS__))
+#define __IMJ_FIELD_60(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_59(f, __VA_ARGS__))
+#define __IMJ_FIELD_61(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_60(f, __VA_ARGS__))
+#define __IMJ_FIELD_62(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_61(f, __VA_ARGS__))
+#define __IMJ_FIELD_63(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_62(f, __VA_ARGS__))
+#define __IMJ_FIELD_64(f, x, ...) f(x) __IMJ_EXPAND(__IMJ_FIELD_63(f, __VA_ARGS__))
+
+namespace imj {
+
+template <typename T> bool io(imj_t *imj, T &value);
+template <typename T, size_t N> bool io(imj_t *imj, T (&value)[N]);
+template <typename T, typename A> bool io(imj_t *imj, std::vector<T, A> &value);
+template <typename Tr, typename A> bool io(imj_t *imj, std::basic_string<char, Tr, A> &value);
+inline bool io(imj_t *imj, std::string_view &value);
+#ifdef __IMJ_HAS_SPAN
+template <typename T, size_t E> bool io(imj_t *imj, std::span<T, E> &value);
+#endif
+
+namespace detail {
+
+template <typename T, typename = void>
+struct has_fields : std::false_type {};
+
+template <typename T>
+struct has_fields<T, std::void_t<decltype(imj_fields(std::declval<imj_t *>(), std::declval<T &>()))>> : std::true_type {};
+
+template <typename T>
+struct always_false : std::false_type {};
+
+// goes through the exact width the c api has, a no-op conversion when the types already match
+template <typename W, typename T>
+inline bool integer(imj_t *imj, T &value, bool (*fn)(imj_t *, W *, W)) {
+    W wide = (W)value;
+    bool success = fn(imj, &wide, wide);
+    value = (T)wide;
+    return success;
+}
+
+} // namespace detail
+
+// missing values keep what 'value' already holds, so defaults are whatever the object was initialized with
+template <typename T>
+inline bool io(imj_t *imj, T &value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        return imj_valb(imj, &value, value);
+    } else if constexpr (std::is_enum_v<T>) {
+        std::underlying_type_t<T> underlying = (std::underlying_type_t<T>)value;
+        bool success = io(imj, underlying);
+        value = (T)underlying;
+        return success;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        if constexpr (sizeof(T) == 1) return detail::integer<int8_t>(imj, value, imj_vali8);
+        else if constexpr (sizeof(T) == 2) return detail::integer<int16_t>(imj, value, imj_vali16);
+        else if constexpr (sizeof(T) == 4) return detail::integer<int32_t>(imj, value, imj_vali32);
+        else return detail::integer<int64_t>(imj, value, imj_vali64);
+    } else if constexpr (std::is_integral_v<T>) {
+        if constexpr (sizeof(T) == 1) return detail::integer<uint8_t>(imj, value, imj_valu8);
+        else if constexpr (sizeof(T) == 2) return detail::integer<uint16_t>(imj, value, imj_valu16);
+        else if constexpr (sizeof(T) == 4) return detail::integer<uint32_t>(imj, value, imj_valu32);
+        else return detail::integer<uint64_t>(imj, value, imj_valu64);
+    } else if constexpr (std::is_same_v<T, float>) {
+        return imj_valf(imj, &value, value);
+    } else if constexpr (std::is_same_v<T, double>) {
+        return imj_vald(imj, &value, value);
+    } else if constexpr (detail::has_fields<T>::value) {
+        bool found = imj_begin_obj(imj);
+        imj_fields(imj, value);
+        imj_end_obj(imj);
+        return found;
+    } else {
+        static_assert(detail::always_false<T>::value, "no imj::io for this type, declare its fields with IMJ_FIELDS");
+        return false;
+    }
+}
+
+// read: elements past the end of the source array keep their values
+template <typename T, size_t N>
+inline bool io(imj_t *imj, T (&value)[N]) {
+    bool found = imj_begin_arr(imj);
+    for (size_t i = 0; i < N; ++i) {
+        io(imj, value[i]);
+    }
+    imj_end_arr(imj);
+    return found;
+}
+
+// read: sized once from the source count, elements are constructed in place with the vector's
+// allocator, so std::pmr containers and their strings land in the vector's memory resource
+template <typename T, typename A>
+inline bool io(imj_t *imj, std::vector<T, A> &value) {
+    if (imj->io_mode != IMJ_READ) {
+        bool found = imj_begin_arr(imj);
+        for (size_t i = 0; i < value.size(); ++i) {
+            if constexpr (std::is_same_v<T, bool>) {
+                bool item = value[i];
+                io(imj, item);
+            } else {
+                io(imj, value[i]);
+            }
+        }
+        imj_end_arr(imj);
+        return found;
+    }
+
+    size_t count = 0;
+    bool found = imj_begin_arr_ex(imj, &count);
+    if (found) {
+        value.clear();
+        value.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            if constexpr (std::is_same_v<T, bool>) {
+                bool item = false;
+                io(imj, item);
+                value.push_back(item);
+            } else {
+                io(imj, value.emplace_back());
+            }
+        }
+    }
+    imj_end_arr(imj);
+    return found;
+}
+
+// read: unescaped straight into the string's own buffer
+template <typename Tr, typename A>
+inline bool io(imj_t *imj, std::basic_string<char, Tr, A> &value) {
+    imj_sv_t sv = { value.data(), value.size() };
+    if (imj->io_mode != IMJ_READ) return imj_valrawsv(imj, &sv, "");
+    if (!imj_valrawsv(imj, &sv, "")) return false;
+
+    if (imj->encoding != IMJ_ENCODING_JSON) {
+        value.assign(sv.data, sv.length);
+        return true;
+    }
+
+    size_t length = 0;
+    value.resize(sv.length);
+    if (!imj_rawsv_unescape(sv, value.data(), sv.length, &length)) {
+        value.assign(sv.data, sv.length);
+        return false;
+    }
+    value.resize(length);
+    return true;
+}
+
+// read: points into the source, so it lives as long as the source does and json text is still escaped
+inline bool io(imj_t *imj, std::string_view &value) {
+    imj_sv_t sv = { value.empty() ? "" : value.data(), value.size() };
+    bool success = imj_valrawsv(imj, &sv, "");
+    if (imj->io_mode == IMJ_READ && success) value = std::string_view(sv.data, sv.length);
+    return success;
+}
+
+#ifdef __IMJ_HAS_SPAN
+// the span is not resized, like fixed arrays
+template <typename T, size_t E>
+inline bool io(imj_t *imj, std::span<T, E> &value) {
+    bool found = imj_begin_arr(imj);
+    for (T &item : value) {
+        io(imj, item);
+    }
+    imj_end_arr(imj);
+    return found;
+}
+#endif
+
+template <typename T>
+inline bool field(imj_t *imj, const char *key, size_t n, T &value) {
+    bool found = imj_keyn(imj, key, n);
+    found &= io(imj, value);
+    return found;
+}
+
+} // namespace imj
+
+#endif
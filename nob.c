@@ -12,7 +12,7 @@ int main(int argc, char **argv) {
 
     cmd_append(&cmd, "-O0", "-g", "-ggdb");
 
-    cmd_append(&cmd, "-o", "example");
+    cmd_append(&cmd, "-o", "example", "-lm", "-pthread");
 
     if (!cmd_run_sync_and_reset(&cmd)) {
         nob_log(NOB_ERROR, "unable to compile example program");
@@ -21,12 +21,61 @@ int main(int argc, char **argv) {
 
     cmd_append(&cmd, "gcc", "tester.c", "-Wall", "-Wextra", "-Wpedantic");
     cmd_append(&cmd, "-O0", "-g", "-ggdb");
-    cmd_append(&cmd, "-o", "tester");
+    cmd_append(&cmd, "-o", "tester", "-lm", "-pthread");
 
     if (!cmd_run_sync_and_reset(&cmd)) {
         nob_log(NOB_ERROR, "unable to compile test program");
         return 1;
     }
 
+    // the profiler hooks change every io function, so they're tested in a separate program
+    cmd_append(&cmd, "gcc", "tester_profile.c", "-Wall", "-Wextra", "-Wpedantic");
+    cmd_append(&cmd, "-O0", "-g", "-ggdb");
+    cmd_append(&cmd, "-o", "tester_profile", "-lm", "-pthread");
+
+    if (!cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_ERROR, "unable to compile profiler test program");
+        return 1;
+    }
+
+    // the c++ front-end links against the implementation compiled as c
+    cmd_append(&cmd, "gcc", "-x", "c", "-DIMJ_IMPLEMENTATION", "-c", "imj.h");
+    cmd_append(&cmd, "-O0", "-g", "-ggdb");
+    cmd_append(&cmd, "-o", "imj.o");
+
+    if (!cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_ERROR, "unable to compile imj.o");
+        return 1;
+    }
+
+    cmd_append(&cmd, "g++", "-std=c++17", "tester.cpp", "imj.o", "-Wall", "-Wextra", "-Wpedantic");
+    cmd_append(&cmd, "-O0", "-g", "-ggdb");
+    cmd_append(&cmd, "-o", "tester_cpp", "-lm", "-pthread");
+
+    if (!cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_ERROR, "unable to compile c++ test program");
+        return 1;
+    }
+
+    // the std::span adapter needs c++20, the rest of the front-end is tested as c++17 above
+    cmd_append(&cmd, "g++", "-std=c++20", "tester.cpp", "imj.o", "-Wall", "-Wextra", "-Wpedantic");
+    cmd_append(&cmd, "-O0", "-g", "-ggdb");
+    cmd_append(&cmd, "-o", "tester_cpp20", "-lm", "-pthread");
+
+    if (!cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_ERROR, "unable to compile c++20 test program");
+        return 1;
+    }
+
+    // the command line tool is only useful fast, so it's always optimized
+    cmd_append(&cmd, "gcc", "cli.c", "-Wall", "-Wextra", "-Wpedantic");
+    cmd_append(&cmd, "-O2", "-march=native", "-g");
+    cmd_append(&cmd, "-o", "imj", "-lm", "-pthread");
+
+    if (!cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_ERROR, "unable to compile imj command line tool");
+        return 1;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -400,6 +400,1584 @@ bool array_reading_test(const char *path) {
     return !failed;
 }
 
+bool cbor_roundtrip_test(void) {
+    game_t game = dgame;
+
+    imj_t w = {0};
+    imjw_init_ex(&w, IMJ_ENCODING_CBOR);
+    game_io(&game, &w);
+
+    imj_t r = {0};
+    imjr_cstrn(w.sb.items, w.sb.count, &r);
+    if (r.encoding != IMJ_ENCODING_CBOR) return false;
+
+    game_t read = {0};
+    game_io(&read, &r);
+
+    bool passed = !r.had_error && compare_games(&read, &dgame);
+
+    imj_free(&w);
+    imj_free(&r);
+    return passed;
+}
+
+bool transcode_test(const char *path) {
+    imj_t json = {0};
+    bool success = imj_file(path, &json, IMJ_READ);
+    assert(success);
+
+    imj_t cbor = {0};
+    imjw_init_ex(&cbor, IMJ_ENCODING_CBOR);
+    if (!imj_transcode(&json, &cbor) || !cbor.done) return false;
+
+    imj_t cbor_reader = {0};
+    imjr_cstrn(cbor.sb.items, cbor.sb.count, &cbor_reader);
+
+    imj_t back = {0};
+    imjw_init(&back);
+    back.render_style = IMJ_STYLE_PRETTY;
+    if (!imj_transcode(&cbor_reader, &back) || !back.done) return false;
+
+    game_t game = {0};
+    imj_t back_reader = {0};
+    imjr_cstrn(back.sb.items, back.sb.count, &back_reader);
+    game_io(&game, &back_reader);
+
+    bool passed = !back_reader.had_error && compare_games(&game, &dgame);
+
+    imj_free(&json);
+    imj_free(&cbor);
+    imj_free(&cbor_reader);
+    imj_free(&back);
+    imj_free(&back_reader);
+    return passed;
+}
+
+bool shape_cache_test(void) {
+    const char *src = "[{\"a\": 1, \"b\": 2}, {\"a\": 3, \"b\": 4}, {\"b\": 6, \"a\": 5}]";
+
+    bool passed = true;
+    imj_shapes_t shapes = {0};
+
+    for (int doc = 0; doc < 2; ++doc) {
+        imj_t imj = {0};
+        imjr_cstrn(src, strlen(src), &imj);
+        imj.shapes = &shapes;
+
+        imj_begin_arr(&imj);
+        for (int i = 0; i < 3; ++i) {
+            int a, b;
+            imj_begin_obj(&imj);
+                imj_key_vali(&imj, "b", &b, 0);
+                imj_key_vali(&imj, "a", &a, 0);
+            imj_end_obj(&imj);
+
+            if (a != 2*i + 1 || b != 2*i + 2) passed = false;
+        }
+        imj_end_arr(&imj);
+
+        if (imj.had_error || !imj.done) passed = false;
+        imj_free(&imj);
+    }
+
+    if (shapes.hits == 0) passed = false;
+
+    imj_shapes_free(&shapes);
+    return passed;
+}
+
+bool patch_test(void) {
+    const char *src = "{\n  \"a\": 1.50,  \"keep\": [1,2,3],\n  \"b\": \"x\",\n  \"arr\": [1, 2, 3]\n}\n";
+    const char *expected = "{\n  \"a\": 1.50,  \"keep\": [1,2,3],\n  \"b\": \"y\",\n  \"arr\": [1, 5], \"new\": { \"x\": 7 }\n}\n";
+
+    imj_t imj = {0};
+    imjp_cstrn(src, strlen(src), &imj);
+    imj.render_style = IMJ_STYLE_SINGLE_LINE;
+
+    double a = 1.5;
+    const char *b = "y";
+    int arr[] = {1, 5};
+    int x = 7;
+
+    imj_begin_obj(&imj);
+        imj_key_vald(&imj, "a", &a, 0);
+        imj_key_valcstr(&imj, "b", &b, "", tester_alloc, NULL);
+
+        imj_key(&imj, "arr");
+        imj_begin_arr(&imj);
+            imj_vali(&imj, &arr[0], 0);
+            imj_vali(&imj, &arr[1], 0);
+        imj_end_arr(&imj);
+
+        imj_key(&imj, "new");
+        imj_begin_obj(&imj);
+            imj_key_vali(&imj, "x", &x, 0);
+        imj_end_obj(&imj);
+    imj_end_obj(&imj);
+
+    bool passed = imj.done && !imj.had_error && strcmp(imj.sb.items, expected) == 0;
+    imj_free(&imj);
+
+    // values that are already there leave nothing to splice in, the output is the source
+    const char *same = "{\"x\": 7, \"arr\": [1, 5]}";
+    imjp_cstrn(same, strlen(same), &imj);
+    imj_begin_obj(&imj);
+        imj_key_vali(&imj, "x", &x, 0);
+        imj_key(&imj, "arr");
+        imj_begin_arr(&imj);
+            imj_vali(&imj, &arr[0], 0);
+            imj_vali(&imj, &arr[1], 0);
+        imj_end_arr(&imj);
+    imj_end_obj(&imj);
+
+    passed = passed && imj.done && !imj.had_error && imj.edits.count == 0 && strcmp(imj.sb.items, same) == 0;
+    imj_free(&imj);
+    return passed;
+}
+
+bool async_flush_test(void) {
+    const char *path = "tester_flush.json";
+
+    game_t game = dgame;
+    game.level = 7;
+
+    imj_t imj = {0};
+    imj_file(path, &imj, IMJ_WRITE);
+    game_io(&game, &imj);
+    bool passed = imjw_flush(&imj);
+    imj_free(&imj);
+
+#ifndef _WIN32
+    // a replaced file keeps its permissions, even ones the umask would have taken away
+    chmod(path, 0664);
+#endif
+
+    // overlapping flushes of the same file each go through their own temporary file
+    imj_flush_t *flushes[8];
+    for (int i = 0; i < 8; ++i) {
+        imj_file(path, &imj, IMJ_WRITE);
+        game_io(&game, &imj);
+        flushes[i] = imjw_flush_async(&imj);
+        imj_free(&imj);
+    }
+
+    for (int i = 0; i < 8; ++i) passed = imjw_flush_wait(flushes[i]) && passed;
+
+    Nob_File_Paths children = {0};
+    passed = passed && nob_read_entire_dir(".", &children);
+    for (size_t i = 0; i < children.count; ++i) {
+        if (strncmp(children.items[i], "tester_flush.json.", 18) == 0) passed = false;
+    }
+    nob_da_free(children);
+
+#ifndef _WIN32
+    struct stat st;
+    passed = passed && stat(path, &st) == 0 && (st.st_mode & 0777) == 0664;
+#endif
+
+    imj_t reader = {0};
+    if (!imj_file(path, &reader, IMJ_READ)) return false;
+
+    game_t read = {0};
+    game_io(&read, &reader);
+    passed = passed && !reader.had_error && read.level == 7;
+
+    imj_free(&reader);
+    remove(path);
+    return passed;
+}
+
+bool compression_test(void) {
+    const char *path = "tester_compressed.json";
+
+    imj_t imj = {0};
+    imj_file(path, &imj, IMJ_WRITE);
+    imj.codec = IMJ_CODEC_LZ;
+
+    game_t games[64];
+    imj_begin_arr(&imj);
+    for (size_t i = 0; i < 64; ++i) {
+        games[i] = dgame;
+        games[i].level = (int)i;
+        game_io(&games[i], &imj);
+    }
+    imj_end_arr(&imj);
+
+    size_t raw_size = imj.sb.count;
+    if (!imjw_flush(&imj)) return false;
+    imj_free(&imj);
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    char magic[4] = {0};
+    fread(magic, 1, 4, file);
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fclose(file);
+
+    imj_t reader = {0};
+    if (!imj_file(path, &reader, IMJ_READ)) return false;
+
+    bool passed = memcmp(magic, "IMJZ", 4) == 0 && size*4 < raw_size && reader.codec == IMJ_CODEC_LZ;
+
+    imj_begin_arr(&reader);
+    for (size_t i = 0; i < 64; ++i) {
+        game_t game = {0};
+        game_io(&game, &reader);
+        if (game.level != (int)i || !compare_games(&game, &games[i])) passed = false;
+    }
+    imj_end_arr(&reader);
+
+    passed = passed && !reader.had_error && reader.done;
+    imj_free(&reader);
+
+    // a header claiming more than its blocks can hold, or sizes that wrap, fails instead of trusting it
+    const uint64_t totals[] = { SIZE_MAX - 1, UINT64_MAX, 10 << 20, 65537 };
+    static uint8_t data[16 + 8 + 65536];
+    for (size_t i = 0; i < sizeof(totals)/sizeof(totals[0]) && passed; ++i) {
+        memset(data, 'x', sizeof(data));
+        memcpy(data, "IMJZ", 4);
+        for (size_t b = 0; b < 4; ++b) data[4 + b] = (uint8_t)(IMJ_CODEC_LZ >> (b*8));
+        for (size_t b = 0; b < 8; ++b) data[8 + b] = (uint8_t)(totals[i] >> (b*8));
+
+        // one block stored as is, both sizes 65536
+        uint8_t sizes[8] = { 0, 0, 1, 0, 0, 0, 1, 0 };
+        memcpy(data + 16, sizes, 8);
+
+        file = fopen(path, "wb");
+        if (!file) return false;
+        fwrite(data, 1, sizeof(data), file);
+        fclose(file);
+
+        passed = !imj_file(path, &reader, IMJ_READ);
+    }
+
+    remove(path);
+    return passed;
+}
+
+bool validate_test(void) {
+    const char *valid[] = {
+        "{}", " [ ] ", "0", "-1.5e+3", "\"a\\u00e9\\n\"", "[1, {\"a\": [true, false, null]}, \"x\"]",
+        "{\"long string that goes past a vector width\": \"and another that does too, with \\\" in it\"}",
+    };
+
+    for (size_t i = 0; i < sizeof(valid)/sizeof(valid[0]); ++i) {
+        if (!imj_validate(valid[i], strlen(valid[i]), NULL)) return false;
+    }
+
+    const char *invalid[] = {
+        "", "[1, 2,]", "{\"a\": 1,}", "{\"a\" 1}", "[1 2]", "01", "[tru]", "\"abc", "{} {}", "[\"\\x\"]", "[\"\t\"]", "{1: 2}",
+    };
+
+    for (size_t i = 0; i < sizeof(invalid)/sizeof(invalid[0]); ++i) {
+        if (imj_validate(invalid[i], strlen(invalid[i]), NULL)) return false;
+    }
+
+    imj_error_t error;
+    const char *src = "{\n  \"a\": [1, 2,\n  ]\n}";
+    if (imj_validate(src, strlen(src), &error)) return false;
+
+    return error.offset == 18 && error.line == 3 && error.column == 3;
+}
+
+bool skip_depth_test(void) {
+    bool passed = true;
+
+    // skipping a value nested this deep used to take one C stack frame per level
+    size_t deep = 100000;
+    char *src = malloc(2*deep + 32);
+    size_t n = 0;
+    n += sprintf(src + n, "{\"a\": ");
+    for (size_t i = 0; i < deep; ++i) src[n++] = '[';
+    for (size_t i = 0; i < deep; ++i) src[n++] = ']';
+    n += sprintf(src + n, ", \"b\": \"\\\\\"}");
+
+    imj_t imj = {0};
+    imjr_cstrn(src, n, &imj);
+    imj.log_errors = false;
+    imj_begin_obj(&imj);
+        imj_key_valnull(&imj, "b");
+    imj_end_obj(&imj);
+    if (!imj.had_error) passed = false;
+    imj_free(&imj);
+    free(src);
+
+    const char *nested = "{\"a\": [[1]], \"b\": \"\\\\\"}";
+    for (size_t max_depth = 2; max_depth <= 3; ++max_depth) {
+        imjr_cstrn(nested, strlen(nested), &imj);
+        imj.log_errors = false;
+        imj.max_depth = max_depth;
+
+        const char *b = NULL;
+        imj_begin_obj(&imj);
+            imj_key_valcstr(&imj, "b", &b, "", tester_alloc, NULL);
+        imj_end_obj(&imj);
+
+        bool ok = !imj.had_error && strcmp(b, "\\") == 0;
+        if (ok != (max_depth == 3)) passed = false;
+
+        free((void*)b);
+        imj_free(&imj);
+    }
+
+    // a max_depth above IMJ_MAX_DEPTH lets levels that are read through go deeper, skipping stays bounded
+    size_t levels = IMJ_MAX_DEPTH + 100;
+    src = malloc(2*levels + 1);
+    for (size_t i = 0; i < levels; ++i) {
+        src[i] = '[';
+        src[2*levels - 1 - i] = ']';
+    }
+
+    imjr_cstrn(src, 2*levels, &imj);
+    imj.max_depth = levels;
+    for (size_t i = 0; i < levels; ++i) imj_begin_arr(&imj);
+    for (size_t i = 0; i < levels; ++i) imj_end_arr(&imj);
+    passed = passed && imj.done && !imj.had_error;
+    imj_free(&imj);
+
+    imjr_cstrn(src, 2*levels, &imj);
+    imj.log_errors = false;
+    imj.max_depth = levels;
+    imj_begin_arr(&imj);
+    imj_end_arr(&imj);
+    passed = passed && imj.had_error;
+    imj_free(&imj);
+    free(src);
+
+    return passed;
+}
+
+bool key_iteration_test(void) {
+    const char *src = "{\"b\\\"\": {\"x\": 1}, \"a\": [1, 2], \"c\": 3, \"d\": \"skipped\"}";
+
+    imj_t imj = {0};
+    imjr_cstrn(src, strlen(src), &imj);
+
+    size_t count;
+    imj_begin_obj_ex(&imj, &count);
+    bool passed = count == 4;
+
+    const char *expected[] = { "b\\\"", "a", "c", "d" };
+    size_t i = 0;
+    int sum = 0;
+
+    imj_sv_t key;
+    while (imj_next_key(&imj, &key)) {
+        if (i >= count || !imj_sv_cstr_eq(key, expected[i])) passed = false;
+
+        int val;
+        if (i == 0) {
+            imj_begin_obj(&imj);
+                imj_key_vali(&imj, "x", &val, 0);
+            imj_end_obj(&imj);
+            sum += val;
+        } else if (i == 1) {
+            imj_begin_arr(&imj);
+                imj_vali(&imj, &val, 0);
+                sum += val;
+            imj_end_arr(&imj);
+        } else if (i == 2) {
+            imj_vali(&imj, &val, 0);
+            sum += val;
+        }
+
+        ++i;
+    }
+
+    int c;
+    imj_key_vali(&imj, "c", &c, 0);
+    imj_end_obj(&imj);
+
+    passed = passed && i == 4 && sum == 5 && c == 3 && imj.done && !imj.had_error;
+
+    imj_free(&imj);
+    return passed;
+}
+
+typedef struct doc_reader_t doc_reader_t;
+struct doc_reader_t {
+    imj_doc_t *doc;
+    game_t *games;
+    size_t read_count;
+    bool passed;
+};
+
+#ifdef _WIN32
+DWORD WINAPI doc_reader(LPVOID arg) {
+#else
+void *doc_reader(void *arg) {
+#endif
+    doc_reader_t *reader = arg;
+
+    imj_t imj;
+    imjr_doc(reader->doc, &imj);
+
+    size_t count;
+    imj_begin_arr_ex(&imj, &count);
+    reader->passed = count == 64;
+
+    // the unread games are skipped through the index
+    for (size_t i = 0; i < reader->read_count; ++i) {
+        game_t game = {0};
+        game_io(&game, &imj);
+        if (!compare_games(&game, &reader->games[i])) reader->passed = false;
+    }
+    imj_end_arr(&imj);
+
+    reader->passed = reader->passed && imj.done && !imj.had_error;
+    imj_free(&imj);
+    return 0;
+}
+
+bool shared_doc_test(void) {
+    imj_t imj = {0};
+    imjw_init(&imj);
+
+    game_t games[64];
+    imj_begin_arr(&imj);
+    for (size_t i = 0; i < 64; ++i) {
+        games[i] = dgame;
+        games[i].level = (int)i;
+        game_io(&games[i], &imj);
+    }
+    imj_end_arr(&imj);
+
+    imj_doc_t *doc = imj_doc_cstrn(imj.sb.items, imj.sb.count);
+    imj_free(&imj);
+
+    bool passed = imj_doc_index(doc);
+
+    doc_reader_t readers[4];
+    for (size_t i = 0; i < 4; ++i) {
+        readers[i] = (doc_reader_t){ .doc = doc, .games = games, .read_count = 16*(i + 1) - 3 };
+    }
+
+#ifdef _WIN32
+    HANDLE threads[4];
+    for (size_t i = 0; i < 4; ++i) threads[i] = CreateThread(NULL, 0, doc_reader, &readers[i], 0, NULL);
+    WaitForMultipleObjects(4, threads, TRUE, INFINITE);
+    for (size_t i = 0; i < 4; ++i) CloseHandle(threads[i]);
+#else
+    pthread_t threads[4];
+    for (size_t i = 0; i < 4; ++i) pthread_create(&threads[i], NULL, doc_reader, &readers[i]);
+    for (size_t i = 0; i < 4; ++i) pthread_join(threads[i], NULL);
+#endif
+
+    for (size_t i = 0; i < 4; ++i) passed = passed && readers[i].passed;
+
+    // the cursor keeps the document alive after the last outside reference is gone
+    imj_t cursor;
+    imjr_doc(doc, &cursor);
+    imj_doc_release(doc);
+
+    size_t count;
+    imj_begin_arr(&cursor);
+    imj_begin_obj_ex(&cursor, &count);
+
+    int level = -1;
+    imj_key_vali(&cursor, "level", &level, -1);
+
+    size_t seen = 0;
+    imj_sv_t key;
+    while (imj_next_key(&cursor, &key)) ++seen;
+
+    int missing;
+    imj_key_vali(&cursor, "missing", &missing, 42);
+    imj_end_obj(&cursor);
+    imj_end_arr(&cursor);
+
+    passed = passed && count > 0 && seen == count && level == 0 && missing == 42 && cursor.done && !cursor.had_error;
+
+    imj_free(&cursor);
+    return passed;
+}
+
+bool doc_cache_test(void) {
+    const char *path = "tester_cached.json";
+    imj_doc_cache_clear();
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    fputs("{\"level\": 1, \"name\": \"first\"}", file);
+    fclose(file);
+
+    imj_doc_t *first = imj_doc_cached(path);
+    imj_doc_t *second = imj_doc_cached(path);
+    imj_doc_cache_stats_t stats = imj_doc_cache_stats();
+
+    bool passed = first && first == second && stats.hits == 1 && stats.misses == 1 && stats.count == 1;
+    imj_doc_release(first);
+    imj_doc_release(second);
+
+    // a different size means the file changed
+    file = fopen(path, "wb");
+    if (!file) return false;
+    fputs("{\"level\": 22, \"name\": \"second\"}", file);
+    fclose(file);
+
+    imj_t imj;
+    passed = passed && imj_file_cached(path, &imj);
+
+    int level;
+    imj_begin_obj(&imj);
+    imj_key_vali(&imj, "level", &level, 0);
+    imj_end_obj(&imj);
+
+    stats = imj_doc_cache_stats();
+    passed = passed && level == 22 && !imj.had_error && stats.misses == 2 && stats.count == 1;
+
+    // the cursor keeps its document after it is evicted
+    imj_doc_cache_budget(0);
+    stats = imj_doc_cache_stats();
+    passed = passed && stats.count == 0 && stats.bytes == 0 && stats.evictions == 1;
+
+    imj_free(&imj);
+
+    imj_doc_cache_budget(IMJ_DOC_CACHE_BUDGET);
+    imj_doc_cache_clear();
+    remove(path);
+    return passed;
+}
+
+bool string_store_test(void) {
+    const char *src = "[\"sword\", \"bow\", \"sword\", \"tab\\there\", \"bow\", \"sword\"]";
+
+    imj_strings_t interned = { .intern = true };
+    imj_strings_t bumped = {0};
+
+    imj_t imj = {0};
+    imjr_cstrn(src, strlen(src), &imj);
+    imj.strings = &interned;
+
+    const char *names[7];
+    imj_begin_arr(&imj);
+    for (size_t i = 0; i < 6; ++i) {
+        imj_valcstr(&imj, &names[i], "", NULL, NULL);
+    }
+    imj_end_arr(&imj);
+
+    bool passed = !imj.had_error && interned.count == 3
+        && names[0] == names[2] && names[2] == names[5] && names[1] == names[4] && names[0] != names[1]
+        && strcmp(names[0], "sword") == 0 && strcmp(names[3], "tab\there") == 0;
+    imj_free(&imj);
+
+    // per call, overriding the store on the imj_t
+    imjr_cstrn(src, strlen(src), &imj);
+    imj.strings = &interned;
+
+    imj_begin_arr(&imj);
+    imj_valcstr(&imj, &names[0], "", NULL, &bumped);
+    imj_valcstr(&imj, &names[1], "", NULL, &bumped);
+    imj_valcstr(&imj, &names[2], "", NULL, &bumped);
+    imj_end_arr(&imj);
+
+    passed = passed && bumped.count == 3 && interned.count == 3 && names[0] != names[2] && strcmp(names[2], "sword") == 0;
+    imj_free(&imj);
+
+    // a missing value stores its default
+    imjr_cstrn("{}", 2, &imj);
+    imj_begin_obj(&imj);
+    imj_key_valcstr(&imj, "name", &names[6], "bow", NULL, &interned);
+    imj_end_obj(&imj);
+
+    passed = passed && strcmp(names[6], "bow") == 0 && interned.count == 3;
+    imj_free(&imj);
+
+    imj_strings_free(&interned);
+    imj_strings_free(&bumped);
+    return passed && interned.intern && interned.count == 0;
+}
+
+bool fixed_buffers_test(void) {
+    game_t games[32];
+    for (size_t i = 0; i < 32; ++i) {
+        games[i] = dgame;
+        games[i].level = (int)i;
+    }
+
+    imj_t heap = {0};
+    imjw_init(&heap);
+    imj_begin_arr(&heap);
+    for (size_t i = 0; i < 32; ++i) game_io(&games[i], &heap);
+    imj_end_arr(&heap);
+
+    // the output only fits on the second try
+    uintptr_t scratch[512];
+    char small[64];
+    size_t scratch_size = 0, out_size = 0;
+
+    imj_t imj;
+    imjw_init_fixed(&imj, IMJ_ENCODING_JSON, scratch, sizeof(scratch), small, sizeof(small));
+    imj_begin_arr(&imj);
+    for (size_t i = 0; i < 32; ++i) game_io(&games[i], &imj);
+    imj_end_arr(&imj);
+
+    bool passed = imj.done && imj_required(&imj, &scratch_size, &out_size) && out_size == heap.sb.count;
+
+    char *out = malloc(out_size);
+    imjw_init_fixed(&imj, IMJ_ENCODING_JSON, scratch, sizeof(scratch), out, out_size);
+    imj_begin_arr(&imj);
+    for (size_t i = 0; i < 32; ++i) game_io(&games[i], &imj);
+    imj_end_arr(&imj);
+
+    passed = passed && imj.done && !imj_required(&imj, NULL, NULL) && imj.sb.count == heap.sb.count && memcmp(out, heap.sb.items, out_size) == 0;
+
+    // levels and key caches are given back as objects end, so reading doesn't grow with the document
+    imjr_cstrn_fixed(out, out_size, &imj, scratch, sizeof(scratch));
+    imj.log_errors = false;
+    imj_begin_arr(&imj);
+    for (size_t i = 0; i < 32; ++i) {
+        game_t game = {0};
+        game_io(&game, &imj);
+        if (!compare_games(&game, &games[i])) passed = false;
+    }
+    imj_end_arr(&imj);
+
+    passed = passed && imj.done && !imj.had_error && !imj_required(&imj, &scratch_size, NULL) && scratch_size <= sizeof(scratch);
+
+    // too little scratch is an error that reports what was needed
+    uintptr_t tiny[8];
+    imjr_cstrn_fixed(out, out_size, &imj, tiny, sizeof(tiny));
+    imj.log_errors = false;
+    imj_begin_arr(&imj);
+    game_t game = {0};
+    game_io(&game, &imj);
+    imj_end_arr(&imj);
+
+    passed = passed && imj.had_error && imj_required(&imj, &scratch_size, NULL) && scratch_size > sizeof(tiny);
+
+    free(out);
+    imj_free(&imj);
+    imj_free(&heap);
+    return passed;
+}
+
+bool integers_test(void) {
+    int64_t lo = INT64_MIN;
+    uint64_t hi = UINT64_MAX;
+    uint64_t id = 1234567890123456789ULL;
+
+    bool passed = true;
+    for (int encoding = IMJ_ENCODING_JSON; encoding <= IMJ_ENCODING_CBOR; ++encoding) {
+        imj_t w = {0};
+        imjw_init_ex(&w, (imj_encoding_t)encoding);
+        imj_begin_obj(&w);
+        imj_key_vali64(&w, "lo", &lo, 0);
+        imj_key_valu64(&w, "hi", &hi, 0);
+        imj_key_valu64(&w, "id", &id, 0);
+        imj_end_obj(&w);
+
+        int64_t rlo = 0;
+        uint64_t rhi = 0, rid = 0;
+        imj_t r = {0};
+        imjr_cstrn(w.sb.items, w.sb.count, &r);
+        imj_begin_obj(&r);
+        passed = passed && imj_key_vali64(&r, "lo", &rlo, 0) && imj_key_valu64(&r, "hi", &rhi, 0) && imj_key_valu64(&r, "id", &rid, 0);
+        imj_end_obj(&r);
+
+        passed = passed && !r.had_error && rlo == lo && rhi == hi && rid == id;
+        imj_free(&w);
+        imj_free(&r);
+    }
+
+    // out of range values fail with the default, whole numbers with exponents still read
+    const char *src = "[300, -1, 2.5e2, 1.9, 18446744073709551616, 4294967296]";
+    uint8_t small = 0, negative = 0;
+    int32_t exp = 0, frac = 0;
+    uint64_t big = 0;
+    int i = 0;
+
+    imj_t r = {0};
+    imjr_cstrn(src, strlen(src), &r);
+    imj_begin_arr(&r);
+    passed = passed && !imj_valu8(&r, &small, 7) && small == 7;
+    passed = passed && !imj_valu8(&r, &negative, 7) && negative == 7;
+    passed = passed && imj_vali32(&r, &exp, 0) && exp == 250;
+    passed = passed && imj_vali32(&r, &frac, 0) && frac == 1;
+    passed = passed && !imj_valu64(&r, &big, 0) && big == 0;
+    passed = passed && !imj_vali(&r, &i, -1) && i == -1;
+    imj_end_arr(&r);
+
+    passed = passed && r.done && !r.had_error;
+    imj_free(&r);
+
+    // tagged cbor integers stay exact, bignums read when they fit and fail with the default when they don't
+    const char cbor[] = "\xd9\xd9\xf7\x86"
+        "\xc1\x1b\x11\x22\x10\xf4\x7d\xe9\x81\x15"
+        "\xc2\x48\xff\xff\xff\xff\xff\xff\xff\xff"
+        "\xc2\x4a\x00\x00\x11\x22\x10\xf4\x7d\xe9\x81\x15"
+        "\xc3\x48\x11\x22\x10\xf4\x7d\xe9\x81\x14"
+        "\xc2\x49\x01\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\xc3\x48\x80\x00\x00\x00\x00\x00\x00\x00";
+    uint64_t tagged = 0, max = 0, padded = 0, over = 0;
+    int64_t negated = 0, under = 0;
+
+    imjr_cstrn(cbor, sizeof(cbor) - 1, &r);
+    imj_begin_arr(&r);
+    passed = passed && imj_valu64(&r, &tagged, 0) && tagged == id;
+    passed = passed && imj_valu64(&r, &max, 0) && max == UINT64_MAX;
+    passed = passed && imj_valu64(&r, &padded, 0) && padded == id;
+    passed = passed && imj_vali64(&r, &negated, 0) && negated == -(int64_t)id;
+    passed = passed && !imj_valu64(&r, &over, 7) && over == 7;
+    passed = passed && !imj_vali64(&r, &under, 7) && under == 7;
+    imj_end_arr(&r);
+
+    passed = passed && r.done && !r.had_error;
+    imj_free(&r);
+
+    return passed;
+}
+
+bool doubles_test(void) {
+    // 17 digit mantissas, powers past 1e22, the smallest normal and subnormals all need the slow path to round once
+    const char *texts[] = {
+        "0.1", "1e22", "1e23", "-1e23", "9007199254740993", "0.30000000000000004", "1.7976931348623157e308",
+        "2.2250738585072014e-308", "2.2250738585072009e-308", "4.9406564584124654e-324", "5e-324", "1e-400", "1e400",
+        "8.9255e-18", "123456789012345678901234567890", "1.00000000000000011102230246251565404236316680908203125",
+        "0.000000000000000000000000000000000000000000000000000000000000000000000000000000000001",
+    };
+    size_t count = sizeof(texts)/sizeof(texts[0]);
+
+    bool passed = true;
+    for (size_t i = 0; i < count + 2000 && passed; ++i) {
+        char text[128];
+        if (i < count) {
+            snprintf(text, sizeof(text), "%s", texts[i]);
+        } else {
+            // random finite bit patterns printed the shortest way that always reads back exactly
+            static uint64_t state = 0x9e3779b97f4a7c15ull;
+            state = state*6364136223846793005ull + 1442695040888963407ull;
+            uint64_t bits = state ^ (state >> 29);
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            if (d != d || d - d != 0) continue;
+            snprintf(text, sizeof(text), "%.17g", d);
+        }
+
+        double expected = strtod(text, NULL);
+        double got = 0, got_key = 0;
+
+        char src[320];
+        snprintf(src, sizeof(src), "{\"a\": [%s], \"b\": %s}", text, text);
+        imj_t r = {0};
+        imjr_cstrn(src, strlen(src), &r);
+        imj_begin_obj(&r);
+        imj_key(&r, "a");
+        imj_begin_arr(&r);
+        imj_vald(&r, &got, 0);
+        imj_end_arr(&r);
+        imj_key_vald(&r, "b", &got_key, 0);
+        imj_end_obj(&r);
+
+        passed = !r.had_error && memcmp(&got, &expected, sizeof(double)) == 0 && memcmp(&got_key, &expected, sizeof(double)) == 0;
+        if (!passed) printf("%s read as %.17g, not %.17g\n", text, got, expected);
+        imj_free(&r);
+    }
+
+    // spans longer than any double needs still round once, a nonzero digit far past the halfway point rounds up
+    static char text[4096];
+    const char *halfway = "1.00000000000000011102230246251565404236316680908203125";
+    for (size_t i = 0; i < 4 && passed; ++i) {
+        size_t length = (size_t)snprintf(text, sizeof(text), "%s%s", i % 2 ? "-" : "", halfway);
+        memset(text + length, '0', 2000);
+        length += 2000;
+        if (i >= 2) text[length++] = '1';
+        length += (size_t)snprintf(text + length, sizeof(text) - length, "e-3");
+
+        double expected = strtod(text, NULL);
+        double got = 0;
+        imj_t r = {0};
+        imjr_cstrn(text, length, &r);
+        imj_vald(&r, &got, 0);
+        passed = r.done && !r.had_error && memcmp(&got, &expected, sizeof(double)) == 0;
+        imj_free(&r);
+
+        // the same in a fixed buffer, which never reaches for the heap
+        char buffer[1 << 12];
+        imjr_cstrn_fixed(text, length, &r, buffer, sizeof(buffer));
+        got = 0;
+        imj_vald(&r, &got, 0);
+        passed = passed && r.done && !r.had_error && memcmp(&got, &expected, sizeof(double)) == 0;
+        imj_free(&r);
+    }
+
+    return passed;
+}
+
+bool columns_test(void) {
+    const char *src = "{\"matches\": ["
+        "{\"id\": 9007199254740993, \"map\": \"dunes\", \"score\": 12.5, \"players\": [{\"name\": \"a\"}, {\"name\": \"b\"}]},"
+        "{\"score\": -3, \"extra\": {\"deep\": [1, 2, [3]]}, \"id\": 2},"
+        "null,"
+        "{\"id\": \"not a number\", \"map\": \"caves\"},"
+        "{\"id\": 5}"
+        "], \"after\": 7}";
+
+    imj_t json = {0};
+    imjr_cstrn(src, strlen(src), &json);
+
+    imj_t cbor = {0};
+    imjw_init_ex(&cbor, IMJ_ENCODING_CBOR);
+    if (!imj_transcode(&json, &cbor)) return false;
+    imj_free(&json);
+
+    bool passed = true;
+    for (int encoding = IMJ_ENCODING_JSON; encoding <= IMJ_ENCODING_CBOR; ++encoding) {
+        imj_t imj = {0};
+        if (encoding == IMJ_ENCODING_JSON) imjr_cstrn(src, strlen(src), &imj);
+        else imjr_cstrn(cbor.sb.items, cbor.sb.count, &imj);
+
+        uint64_t ids[4] = {0};
+        double scores[4] = {0};
+        imj_sv_t maps[4] = {0};
+        bool has_id[4], has_score[4], has_map[4];
+        imj_column_t columns[] = {
+            { .key = "id", .type = IMJ_COLUMN_U64, .out = ids, .present = has_id },
+            { .key = "score", .type = IMJ_COLUMN_DOUBLE, .out = scores, .present = has_score },
+            { .key = "map", .type = IMJ_COLUMN_RAWSV, .out = maps, .present = has_map },
+        };
+
+        size_t count = 0;
+        int after = 0;
+        imj_begin_obj(&imj);
+        passed = passed && imj_key(&imj, "matches") && imj_arr_columns(&imj, columns, 3, 4, &count);
+        imj_key_vali(&imj, "after", &after, 0);
+        imj_end_obj(&imj);
+
+        passed = passed && imj.done && !imj.had_error && count == 5 && after == 7
+            && has_id[0] && ids[0] == 9007199254740993ull && has_score[0] && scores[0] == 12.5 && has_map[0] && imj_sv_cstr_eq(maps[0], "dunes")
+            && has_id[1] && ids[1] == 2 && has_score[1] && scores[1] == -3 && !has_map[1]
+            && !has_id[2] && !has_score[2] && !has_map[2]
+            && !has_id[3] && ids[3] == 0 && has_map[3] && imj_sv_cstr_eq(maps[3], "caves");
+        imj_free(&imj);
+    }
+
+    // a value that isn't an array reads no rows
+    imj_t imj = {0};
+    imjr_cstrn("{\"a\": 1}", 8, &imj);
+    double scores[1];
+    size_t count = 1;
+    passed = passed && !imj_arr_column(&imj, "score", IMJ_COLUMN_DOUBLE, scores, 1, &count) && count == 0 && imj.done && !imj.had_error;
+    imj_free(&imj);
+    imj_free(&cbor);
+
+    return passed;
+}
+
+bool path_test(void) {
+    const char *src = "{\"version\": 3, \"player\": {\"name\": \"hero\", \"stats\": {\"hp\": 10},"
+        " \"items\": [{\"damage\": 1}, {\"damage\": 2.5, \"tags\": [\"x\"]}, {\"damage\": 9007199254740993}]},"
+        " \"a/b\": {\"m~n\": true}, \"tab\\tkey\": -4}";
+
+    imj_t cbor = {0};
+    imj_t json = {0};
+    imjr_cstrn(src, strlen(src), &json);
+    imjw_init_ex(&cbor, IMJ_ENCODING_CBOR);
+    if (!imj_transcode(&json, &cbor)) return false;
+    imj_free(&json);
+
+    imj_path_t damage;
+    bool passed = imj_path_compile(&damage, "/player/items/2/damage") && damage.count == 4 && damage.segments[2].index == 2;
+    passed = passed && !imj_path_compile(&damage, "player") && !imj_path_compile(&damage, "/a~2");
+    imj_path_compile(&damage, "/player/items/2/damage");
+
+    for (int encoding = IMJ_ENCODING_JSON; encoding <= IMJ_ENCODING_CBOR; ++encoding) {
+        imj_t imj = {0};
+        if (encoding == IMJ_ENCODING_JSON) imjr_cstrn(src, strlen(src), &imj);
+        else imjr_cstrn(cbor.sb.items, cbor.sb.count, &imj);
+
+        // queries leave the cursor alone
+        int version = 0;
+        imj_begin_obj(&imj);
+        imj_key_vali(&imj, "version", &version, 0);
+
+        uint64_t id = 0;
+        int64_t hp = 0, tab = 0;
+        double d = 0;
+        bool flag = false;
+        imj_sv_t name = {0}, missing = {0};
+        passed = passed && imj_path_valu64(&imj, &damage, &id, 0) && id == 9007199254740993ull;
+        passed = passed && imj_query_vald(&imj, "/player/items/1/damage", &d, 0) && d == 2.5;
+        passed = passed && imj_query_vali64(&imj, "/player/stats/hp", &hp, 0) && hp == 10;
+        passed = passed && imj_query_valrawsv(&imj, "/player/name", &name, "") && imj_sv_cstr_eq(name, "hero");
+        passed = passed && imj_query_valb(&imj, "/a~1b/m~0n", &flag, false) && flag;
+        passed = passed && imj_query_vali64(&imj, "/tab\tkey", &tab, 0) && tab == -4;
+        passed = passed && !imj_query_valrawsv(&imj, "/player/items/3/damage", &missing, "none") && imj_sv_cstr_eq(missing, "none");
+        passed = passed && !imj_query_vald(&imj, "/player/items/01/damage", &d, -1) && d == -1;
+        passed = passed && !imj_query_vald(&imj, "/player/name/0", &d, -1);
+
+        imj_sv_t again = {0};
+        imj_key_valrawsv(&imj, "player", &again, "");
+        imj_end_obj(&imj);
+
+        passed = passed && version == 3 && imj.done && !imj.had_error;
+        imj_free(&imj);
+    }
+
+    imj_free(&cbor);
+
+    // escaped keys longer than any path are compared whole, not cut short
+    char xs[301], query[256];
+    static char long_src[1024];
+    memset(xs, 'x', 300);
+    xs[300] = '\0';
+    snprintf(long_src, sizeof(long_src), "{\"\\t%s\": 1, \"\\t%.199sy\": 2, \"\\t%.199s\": 3}", xs, xs, xs);
+    snprintf(query, sizeof(query), "/\t%.199s", xs);
+
+    int64_t found = 0;
+    imj_t imj = {0};
+    imjr_cstrn(long_src, strlen(long_src), &imj);
+    passed = passed && imj_query_vali64(&imj, query, &found, 0) && found == 3 && !imj.had_error;
+    imj_free(&imj);
+
+    return passed;
+}
+
+typedef struct {
+    game_t games[16];
+} batch_games_t;
+
+static void batch_io(imj_t *imj, size_t index, void *user) {
+    batch_games_t *batch = user;
+    game_io(&batch->games[index], imj);
+}
+
+bool batch_test(void) {
+    char names[16][32];
+    const char *paths[17];
+    for (size_t i = 0; i < 16; ++i) {
+        snprintf(names[i], sizeof(names[i]), "tester_batch_%zu.json", i);
+        paths[i] = names[i];
+
+        game_t game = dgame;
+        game.level = (int)i*3;
+
+        imj_t imj = {0};
+        imj_file(paths[i], &imj, IMJ_WRITE);
+        game_io(&game, &imj);
+        if (!imjw_flush(&imj)) return false;
+        imj_free(&imj);
+    }
+    paths[16] = "tester_batch_missing.json";
+
+    batch_games_t batch = {0};
+    bool passed = imj_load_batch(paths, 16, batch_io, &batch, 4);
+    for (size_t i = 0; i < 16; ++i) {
+        passed = passed && batch.games[i].level == (int)i*3;
+    }
+
+    // one missing file fails the whole batch but the rest still load
+    batch_games_t again = {0};
+    passed = passed && !imj_load_batch(paths, 17, batch_io, &again, 0) && again.games[15].level == 45;
+    passed = passed && imj_load_batch(paths, 0, batch_io, &again, 0);
+
+    for (size_t i = 0; i < 16; ++i) remove(paths[i]);
+    return passed;
+}
+
+// 'src' is copied into a buffer of exactly 'n' bytes so reading past it trips the sanitizer
+static char *exact_copy(const char *src, size_t n) {
+    char *copy = malloc(n > 0 ? n : 1);
+    memcpy(copy, src, n);
+    return copy;
+}
+
+bool unterminated_test(void) {
+    const char *src = "{\"name\": \"a \\\"b\\\" \\/\", \"hp\": -12.5e1, \"id\": 12345678901234567890,"
+        " \"tags\": [true, false, null, [], {}], \"skip\": {\"deep\": [1, \"}\"]}}";
+    size_t length = strlen(src);
+
+    bool passed = true;
+    for (size_t n = 0; n <= length; ++n) {
+        char *copy = exact_copy(src, n);
+
+        imj_t imj;
+        imjr_cstrn(copy, n, &imj);
+        imj.log_errors = false;
+
+        imj_sv_t name;
+        double hp;
+        uint64_t id;
+        size_t count;
+        imj_begin_obj(&imj);
+        imj_key_valrawsv(&imj, "name", &name, "");
+        imj_key_vald(&imj, "hp", &hp, 0);
+        imj_key_valu64(&imj, "id", &id, 0);
+        imj_key(&imj, "tags");
+        imj_begin_arr_ex(&imj, &count);
+        imj_end_arr(&imj);
+        imj_end_obj(&imj);
+
+        // only the whole source reads cleanly, every cut ends in an error
+        bool whole = n == length;
+        passed = passed && imj.had_error != whole;
+        if (whole) passed = passed && hp == -125 && id == 12345678901234567890ull && count == 5;
+        imj_free(&imj);
+
+        imj_t cbor = {0};
+        imjr_cstrn(copy, n, &imj);
+        imj.log_errors = false;
+        imjw_init_ex(&cbor, IMJ_ENCODING_CBOR);
+        passed = passed && (n == 0 || imj_transcode(&imj, &cbor) == whole);
+        imj_free(&imj);
+        imj_free(&cbor);
+
+        free(copy);
+    }
+
+    // a nul is no longer the end of the source
+    const char nul[] = "{\"a\": 1, \"b\": \"x\0y\", \"c\": 2}";
+    char *copy = exact_copy(nul, sizeof(nul) - 1);
+    imj_t imj;
+    imjr_cstrn(copy, sizeof(nul) - 1, &imj);
+    imj.log_errors = false;
+
+    int64_t c = 0;
+    imj_begin_obj(&imj);
+    imj_key_vali64(&imj, "c", &c, 0);
+    imj_end_obj(&imj);
+    passed = passed && imj.had_error && c == 0;
+    imj_free(&imj);
+    free(copy);
+
+    return passed;
+}
+
+bool bytes_test(void) {
+    uint8_t blob[300];
+    for (size_t i = 0; i < sizeof(blob); ++i) blob[i] = (uint8_t)(i*7 + 3);
+
+    // every length through both encodings, long enough for the vector paths and every tail
+    bool passed = true;
+    for (int encoding = IMJ_ENCODING_JSON; encoding <= IMJ_ENCODING_CBOR; ++encoding) {
+        for (size_t n = 0; n <= sizeof(blob); ++n) {
+            imj_t w = {0};
+            imjw_init_ex(&w, encoding);
+            imj_begin_arr(&w);
+            imj_valbytes(&w, blob, &n, 0);
+            imj_valbytes_alloc(&w, &(void*){blob}, &n, NULL, NULL);
+            imj_end_arr(&w);
+
+            uint8_t read[300];
+            size_t length;
+            void *allocated = NULL;
+            size_t allocated_length;
+            imj_t r;
+            imjr_cstrn(w.sb.items, w.sb.count, &r);
+            imj_begin_arr(&r);
+            passed = passed && imj_valbytes(&r, read, &length, sizeof(read)) && length == n && memcmp(read, blob, n) == 0;
+            passed = passed && imj_valbytes_alloc(&r, &allocated, &allocated_length, tester_alloc, NULL)
+                && allocated_length == n && (n == 0 || memcmp(allocated, blob, n) == 0);
+            imj_end_arr(&r);
+            passed = passed && r.done && !r.had_error;
+
+            free(allocated);
+            imj_free(&w);
+            imj_free(&r);
+        }
+    }
+
+    // rfc 4648 vectors, unpadded and escaped text reads too
+    const char *src = "[\"\", \"Zg==\", \"Zm8=\", \"Zm9vYmFy\", \"Zm9vYg\", \"Pz\\/+\", \"Zm9v====\", \"Zm9vYmFy\", 3, \"Zm9v\"]";
+    imj_t r;
+    imjr_cstrn(src, strlen(src), &r);
+    r.log_errors = false;
+
+    char text[8];
+    size_t lengths[10];
+    bool results[10];
+    imj_begin_arr(&r);
+    results[0] = imj_valbytes(&r, text, &lengths[0], sizeof(text));
+    results[1] = imj_valbytes(&r, text, &lengths[1], sizeof(text)) && text[0] == 'f';
+    results[2] = imj_valbytes(&r, text, &lengths[2], sizeof(text)) && memcmp(text, "fo", 2) == 0;
+    results[3] = imj_valbytes(&r, text, &lengths[3], sizeof(text)) && memcmp(text, "foobar", 6) == 0;
+    results[4] = imj_valbytes(&r, text, &lengths[4], sizeof(text)) && memcmp(text, "foob", 4) == 0;
+    results[5] = imj_valbytes(&r, text, &lengths[5], sizeof(text)) && memcmp(text, "??\xfe", 3) == 0;
+    results[6] = imj_valbytes(&r, text, &lengths[6], sizeof(text));
+    results[7] = imj_valbytes(&r, text, &lengths[7], 4);
+    results[8] = imj_valbytes(&r, text, &lengths[8], sizeof(text));
+    imj_strings_t strings = {0};
+    void *stored;
+    results[9] = imj_valbytes_alloc(&r, &stored, &lengths[9], NULL, &strings) && memcmp(stored, "foo", 3) == 0;
+    imj_end_arr(&r);
+
+    passed = passed && r.done && !r.had_error
+        && results[0] && lengths[0] == 0 && results[1] && lengths[1] == 1 && results[2] && lengths[2] == 2
+        && results[3] && lengths[3] == 6 && results[4] && lengths[4] == 4 && results[5] && lengths[5] == 3
+        && !results[6] && lengths[6] == 0 // bad padding
+        && !results[7] && lengths[7] == 6 // too small says what it needs
+        && !results[8] && lengths[8] == 0 // not a string
+        && results[9] && lengths[9] == 3 && strings.bytes >= 3;
+    imj_strings_free(&strings);
+    imj_free(&r);
+
+    // cbor byte strings become base64 in json
+    imj_t cbor = {0};
+    imjw_init_ex(&cbor, IMJ_ENCODING_CBOR);
+    size_t n = 6;
+    imj_begin_obj(&cbor);
+    imj_key_valbytes(&cbor, "data", "foobar", &n, 0);
+    imj_end_obj(&cbor);
+
+    imj_t json = {0};
+    imjr_cstrn(cbor.sb.items, cbor.sb.count, &r);
+    imjw_init(&json);
+    passed = passed && imj_transcode(&r, &json) && strstr(json.sb.items, "\"Zm9vYmFy\"") != NULL;
+    imj_free(&r);
+    imj_free(&cbor);
+    imj_free(&json);
+
+    // patching leaves equal data alone
+    const char *saved = "{\"data\": \"Zm9vYmFy\", \"other\": \"Zm9v\"}";
+    imj_t patch = {0};
+    imjp_cstrn(saved, strlen(saved), &patch);
+    n = 3;
+    imj_begin_obj(&patch);
+    imj_key_valbytes(&patch, "data", "foobar", &(size_t){6}, 0);
+    imj_key_valbytes(&patch, "other", "bar", &n, 0);
+    imj_end_obj(&patch);
+    passed = passed && patch.done && !patch.had_error && strcmp(patch.sb.items, "{\"data\": \"Zm9vYmFy\", \"other\": \"YmFy\"}") == 0;
+    imj_free(&patch);
+
+    return passed;
+}
+
+static bool journal_commit_json(imj_journal_t *journal, const char *src) {
+    imj_t r, w = {0};
+    imjr_cstrn(src, strlen(src), &r);
+    imjw_init(&w);
+    bool success = imj_transcode(&r, &w) && imj_journal_commit(journal, &w);
+    imj_free(&r);
+    imj_free(&w);
+    return success;
+}
+
+// both rendered the same way so they compare as text
+static bool journal_reads_as(imj_journal_t *journal, const char *expected) {
+    imj_t r, w = {0}, er, ew = {0};
+    if (!imjr_journal(journal, &r)) return false;
+    imjw_init(&w);
+    imj_transcode(&r, &w);
+
+    imjr_cstrn(expected, strlen(expected), &er);
+    imjw_init(&ew);
+    imj_transcode(&er, &ew);
+
+    bool same = w.sb.count == ew.sb.count && memcmp(w.sb.items, ew.sb.items, w.sb.count) == 0;
+    imj_free(&r);
+    imj_free(&w);
+    imj_free(&er);
+    imj_free(&ew);
+    return same;
+}
+
+static size_t journal_file_size(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    size_t size = (size_t)ftell(file);
+    fclose(file);
+    return size;
+}
+
+bool journal_test(void) {
+    const char *path = "tester_journal.json";
+    const char *journal_path = "tester_journal.json.journal";
+    remove(path);
+    remove(journal_path);
+
+    // new keys go last, that's where adding puts them when replaying
+    const char *docs[] = {
+        "{\"a\": 1, \"b\": [1, 2, 3], \"c\": {\"d\": \"x\", \"e/f\": true}, \"g~\": null, \"pad\": \"0123456789012345678901234567890123456789\"}",
+        "{\"a\": 2, \"b\": [1, 5], \"c\": {\"d\": \"x\", \"e/f\": false, \"new\": [1]}, \"g~\": null, \"pad\": \"0123456789012345678901234567890123456789\", \"h\": \"s\"}",
+        "{\"a\": 2, \"b\": [1, 5, 7, [8]], \"c\": 3, \"pad\": \"0123456789012345678901234567890123456789\"}",
+        "{\"a\": 2, \"b\": [], \"c\": {\"x\": {\"y\": [true]}}, \"pad\": \"0123456789012345678901234567890123456789\"}",
+    };
+
+    // nothing is there yet, the first commit writes the base
+    imj_journal_t journal;
+    bool passed = imj_journal_open(&journal, path);
+    imj_t imj;
+    passed = passed && !imjr_journal(&journal, &imj);
+    passed = passed && journal_commit_json(&journal, docs[0]) && journal_file_size(path) > 0 && journal_file_size(journal_path) == 0;
+    size_t base_size = journal_file_size(path);
+
+    // later ones only append what changed, and reopening replays them
+    journal.compact_ratio = 100;
+    for (size_t i = 1; i < NOB_ARRAY_LEN(docs); ++i) {
+        size_t before = journal_file_size(journal_path);
+        passed = passed && journal_commit_json(&journal, docs[i]) && journal_reads_as(&journal, docs[i]);
+        passed = passed && journal_file_size(journal_path) > before && journal_file_size(path) == base_size;
+
+        imj_journal_t reopened;
+        passed = passed && imj_journal_open(&reopened, path) && journal_reads_as(&reopened, docs[i]);
+        imj_journal_free(&reopened);
+    }
+
+    size_t journal_size = journal_file_size(journal_path);
+    passed = passed && journal_commit_json(&journal, docs[3]) && journal_file_size(journal_path) == journal_size;
+
+    // a commit cut off by a crash is dropped, and cut from the file
+    FILE *file = fopen(journal_path, "ab");
+    fputs("[{\"op\": \"replace\", \"pa", file);
+    fclose(file);
+
+    imj_journal_free(&journal);
+    passed = passed && imj_journal_open(&journal, path) && journal_reads_as(&journal, docs[3]) && journal_file_size(journal_path) == journal_size;
+
+    // past the ratio the journal is folded back into the base
+    journal.compact_ratio = 0.01;
+    passed = passed && journal_commit_json(&journal, docs[0]) && journal_file_size(journal_path) == 0 && journal_reads_as(&journal, docs[0]);
+    imj_journal_free(&journal);
+    passed = passed && imj_journal_open(&journal, path) && journal_reads_as(&journal, docs[0]);
+
+    // game saves go through the usual io function
+    game_t game = dgame;
+    imj_t w = {0};
+    imjw_init(&w);
+    game_io(&game, &w);
+    journal.compact_ratio = 100;
+    passed = passed && imj_journal_commit(&journal, &w);
+    imj_free(&w);
+
+    game.level = 77;
+    imjw_init(&w);
+    game_io(&game, &w);
+    passed = passed && imj_journal_commit(&journal, &w);
+    imj_free(&w);
+    imj_journal_free(&journal);
+
+    game_t read = {0};
+    passed = passed && imj_journal_open(&journal, path) && imjr_journal(&journal, &imj);
+    game_io(&read, &imj);
+    passed = passed && !imj.had_error && read.level == 77 && journal_file_size(journal_path) > 0;
+    imj_free(&imj);
+    imj_journal_free(&journal);
+
+    remove(path);
+    remove(journal_path);
+
+    // control characters in keys are escaped in the journal's paths, every commit after them still replays
+    const char *keys[] = {
+        "{\"plain\": 1}",
+        "{\"plain\": 1, \"k\\bx\": 1, \"k\\u0001y\": 2}",
+        "{\"plain\": 5, \"k\\bx\": 1, \"k\\u0001y\": 2}",
+    };
+    passed = passed && imj_journal_open(&journal, path);
+    journal.compact_ratio = 100;
+    for (size_t i = 0; i < 3; ++i) passed = passed && journal_commit_json(&journal, keys[i]);
+    imj_journal_free(&journal);
+    passed = passed && imj_journal_open(&journal, path) && journal_reads_as(&journal, keys[2]);
+    imj_journal_free(&journal);
+
+    // a finished line that doesn't parse fails the open and leaves the journal as it was
+    size_t damaged_size = journal_file_size(journal_path) + 3;
+    file = fopen(journal_path, "ab");
+    fputs("[{\n", file);
+    fclose(file);
+    passed = passed && !imj_journal_open(&journal, path) && journal_file_size(journal_path) == damaged_size;
+
+    remove(path);
+    remove(journal_path);
+    return passed;
+}
+
+bool flush_if_changed_test(void) {
+    const char *path = "tester_changed.json";
+    remove(path);
+
+    game_t game = dgame;
+    imj_t imj = {0};
+    imj_file(path, &imj, IMJ_WRITE);
+    game_io(&game, &imj);
+
+    // nothing on disk yet, so it's written
+    uint64_t hash = 0;
+    bool passed = imjw_flush_if_changed(&imj, &hash) && hash == imj_content_hash(&imj);
+    size_t size = journal_file_size(path);
+    passed = passed && size == imj.sb.count;
+
+    // the same hash skips the write, even though the file was touched since
+    FILE *file = fopen(path, "ab");
+    fputs(" ", file);
+    fclose(file);
+    passed = passed && imjw_flush_if_changed(&imj, &hash) && journal_file_size(path) == size + 1;
+
+    // without one the file itself is compared
+    uint64_t unknown = 0;
+    passed = passed && imjw_flush_if_changed(&imj, &unknown) && unknown == hash && journal_file_size(path) == size;
+    passed = passed && imjw_flush_if_changed(&imj, NULL) && journal_file_size(path) == size;
+
+    // reading it back hashes to the same key
+    imj_t reader;
+    passed = passed && imj_file(path, &reader, IMJ_READ) && imj_content_hash(&reader) == hash;
+    imj_free(&reader);
+    imj_free(&imj);
+
+    // a different codec is a change, compressed files are compared by their contents
+    imj_file(path, &imj, IMJ_WRITE);
+    imj.codec = IMJ_CODEC_LZ;
+    game_io(&game, &imj);
+    unknown = 0;
+    passed = passed && imjw_flush_if_changed(&imj, &unknown) && unknown != hash && journal_file_size(path) != size;
+    size_t compressed_size = journal_file_size(path);
+    passed = passed && imjw_flush_if_changed(&imj, NULL) && journal_file_size(path) == compressed_size;
+    imj_free(&imj);
+
+    // the hash covers the codec too, so going back to plain output with the compressed hash still writes
+    uint64_t compressed_hash = unknown;
+    imj_file(path, &imj, IMJ_WRITE);
+    game_io(&game, &imj);
+    passed = passed && imjw_flush_if_changed(&imj, &unknown) && unknown == hash && journal_file_size(path) == size;
+    passed = passed && compressed_hash != hash;
+    imj_free(&imj);
+
+    game.level = 3;
+    imj_file(path, &imj, IMJ_WRITE);
+    game_io(&game, &imj);
+    passed = passed && imjw_flush_if_changed(&imj, &hash) && hash != unknown;
+    imj_free(&imj);
+
+    game_t read = {0};
+    passed = passed && imj_file(path, &reader, IMJ_READ);
+    game_io(&read, &reader);
+    passed = passed && !reader.had_error && read.level == 3;
+    imj_free(&reader);
+
+    remove(path);
+    return passed;
+}
+
+bool level_reuse_test(void) {
+    imj_t imj = {0};
+    imjw_init(&imj);
+
+    int a = 1, b = 2;
+    imj_begin_obj(&imj);
+    imj_key(&imj, "a");
+    imj_lvl_t *first = imj.lvl_or_null;
+    imj_vali(&imj, &a, 0);
+
+    // the finished key's level is handed to the next one instead of growing the arena
+    imj_key(&imj, "b");
+    bool passed = imj.lvl_or_null == first;
+    imj_vali(&imj, &b, 0);
+    imj_end_obj(&imj);
+
+    const char *expected = "{\"a\":1,\"b\":2}";
+    passed = passed && imj.done && imj.sb.count == strlen(expected) && memcmp(imj.sb.items, expected, imj.sb.count) == 0;
+    imj_free(&imj);
+    return passed;
+}
+
+bool scan_test(void) {
+    bool passed = true;
+
+    // quotes, escapes and the end of the string at every offset around the 16 byte chunks
+    for (size_t length = 0; length < 40 && passed; ++length) {
+        for (size_t at = 0; at <= length && passed; ++at) {
+            char str[64] = {0};
+            memset(str, 'x', length);
+            if (at + 1 < length) {
+                str[at] = '\\';
+                str[at + 1] = 'n';
+            }
+
+            char src[128];
+            snprintf(src, sizeof(src), "[\"%s\", 1]", str);
+
+            imj_t imj;
+            imjr_cstrn(src, strlen(src), &imj);
+            imj_sv_t sv;
+            int one = 0;
+            imj_begin_arr(&imj);
+            imj_valrawsv(&imj, &sv, "");
+            imj_vali(&imj, &one, 0);
+            imj_end_arr(&imj);
+            passed = !imj.had_error && sv.length == length && memcmp(sv.data, str, length) == 0 && one == 1;
+            imj_free(&imj);
+        }
+    }
+
+    // unterminated strings stop at the end of the source, not past it
+    for (size_t length = 1; length < 40 && passed; ++length) {
+        char *src = malloc(length);
+        memset(src, 'y', length);
+        src[0] = '"';
+
+        imj_t imj;
+        imjr_cstrn(src, length, &imj);
+        imj.log_errors = false;
+        imj_sv_t sv;
+        imj_valrawsv(&imj, &sv, "");
+        passed = imj.had_error;
+        imj_free(&imj);
+        free(src);
+    }
+
+    // long runs of whitespace, and indentation written back the same way
+    const char *spaced = "{\n\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\"a\"                                    :\r\n  [1,                    2]}";
+    imj_t r, w = {0};
+    imjr_cstrn(spaced, strlen(spaced), &r);
+    imjw_init(&w);
+    w.render_style = IMJ_STYLE_PRETTY;
+    w.indent_size = 3;
+    const char *expected = "{\n   \"a\": [\n      1,\n      2\n   ]\n}";
+    passed = passed && imj_transcode(&r, &w) && w.sb.count == strlen(expected) && memcmp(w.sb.items, expected, w.sb.count) == 0;
+    imj_free(&r);
+    imj_free(&w);
+
+    return passed;
+}
+
+typedef struct sink_out_t sink_out_t;
+struct sink_out_t {
+    char data[4096];
+    size_t count;
+    size_t calls;
+};
+
+static void sink_out(void *user, const char *data, size_t n) {
+    sink_out_t *out = user;
+    if (out->count + n <= sizeof(out->data)) memcpy(out->data + out->count, data, n);
+    out->count += n;
+    ++out->calls;
+}
+
+bool sink_test(void) {
+    game_t game = dgame;
+    imj_t whole = {0};
+    imjw_init(&whole);
+    whole.render_style = IMJ_STYLE_PRETTY;
+    game_io(&game, &whole);
+
+    // a buffer smaller than most values still hands over everything in order
+    static sink_out_t out;
+    out = (sink_out_t){0};
+    imj_t streamed = {0};
+    imjw_init(&streamed);
+    streamed.render_style = IMJ_STYLE_PRETTY;
+    imjw_sink(&streamed, sink_out, &out, 8);
+    game_io(&game, &streamed);
+    imjw_sink_flush(&streamed);
+
+    bool passed = streamed.done && out.calls > 1 && out.count == whole.sb.count && memcmp(out.data, whole.sb.items, out.count) == 0;
+
+    // fixed output drains into the sink instead of overflowing
+    out = (sink_out_t){0};
+    char scratch[4096];
+    char buffer[64];
+    imj_t fixed;
+    imjw_init_fixed(&fixed, IMJ_ENCODING_JSON, scratch, sizeof(scratch), buffer, sizeof(buffer));
+    fixed.render_style = IMJ_STYLE_PRETTY;
+    imjw_sink(&fixed, sink_out, &out, 0);
+    game_io(&game, &fixed);
+    imjw_sink_flush(&fixed);
+    passed = passed && !imj_required(&fixed, NULL, NULL) && out.count == whole.sb.count && memcmp(out.data, whole.sb.items, out.count) == 0;
+
+    imj_free(&whole);
+    imj_free(&streamed);
+    return passed;
+}
+
+bool stats_test(void) {
+    const char *src = "{\"a\": [1, 2.5, -3], \"bb\": {\"c\": null, \"d\": [true, false, \"xyz\"]}, \"e\": \"\\\"\"}\n";
+
+    imj_stats_t stats;
+    bool passed = imj_stats(src, strlen(src), &stats, NULL);
+    passed = passed && stats.max_depth == 3 && stats.objects == 2 && stats.arrays == 2 && stats.keys == 5;
+    passed = passed && stats.strings == 2 && stats.numbers == 3 && stats.bools == 2 && stats.nulls == 1;
+    passed = passed && stats.key_bytes == 6 && stats.string_bytes == 5 && stats.longest_string == 3 && stats.whitespace_bytes == 13;
+
+    // errors are still found, with what was counted before them
+    imj_error_t error;
+    const char *bad = "[1, 2, {\"a\": x}]";
+    passed = passed && !imj_stats(bad, strlen(bad), &stats, &error) && error.column == 14 && stats.numbers == 2 && stats.keys == 1;
+
+    return passed;
+}
+
+// the path 'imj fmt --cbor' and then 'imj fmt' on its output take
+static bool fmt_round_trip(const char *src, size_t n, imj_encoding_t encoding, imj_t *to, sink_out_t *out) {
+    imj_t from;
+    imjr_cstrn(src, n, &from);
+    imjw_init_ex(to, encoding);
+    to->render_style = IMJ_STYLE_PRETTY;
+    if (encoding == IMJ_ENCODING_JSON) imjw_sink(to, sink_out, out, 64);
+
+    bool success = from.value_pending && imj_transcode(&from, to);
+    if (encoding == IMJ_ENCODING_JSON) imjw_sink_flush(to);
+    imj_free(&from);
+    return success;
+}
+
+bool fmt_round_trip_test(void) {
+    const char *numbers[] = {
+        "0.1", "1e23", "-1e23", "0.30000000000000004", "2.2250738585072014e-308", "4.9406564584124654e-324",
+        "1.7976931348623157e308", "9007199254740993.5", "-0", "18446744073709551615", "-9223372036854775808", "42",
+    };
+    size_t count = sizeof(numbers)/sizeof(numbers[0]);
+    size_t total = count + 64;
+
+    static char src[4096];
+    static char texts[128][32];
+    size_t n = (size_t)snprintf(src, sizeof(src), "{\"s\": \"a\\\"b\\n\", \"flags\": [true, false, null], \"numbers\": [");
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (size_t i = 0; i < total; ++i) {
+        if (i < count) {
+            snprintf(texts[i], sizeof(texts[i]), "%s", numbers[i]);
+        } else {
+            double d;
+            do {
+                state = state*6364136223846793005ull + 1442695040888963407ull;
+                uint64_t bits = state ^ (state >> 31);
+                memcpy(&d, &bits, sizeof(d));
+            } while (d != d || d - d != 0);
+            snprintf(texts[i], sizeof(texts[i]), "%.17g", d);
+        }
+        n += (size_t)snprintf(src + n, sizeof(src) - n, "%s%s", i > 0 ? ", " : "", texts[i]);
+    }
+    n += (size_t)snprintf(src + n, sizeof(src) - n, "]}");
+
+    // json to cbor and back to json
+    imj_t cbor, json;
+    static sink_out_t out;
+    out = (sink_out_t){0};
+    bool passed = fmt_round_trip(src, n, IMJ_ENCODING_CBOR, &cbor, NULL);
+    passed = passed && fmt_round_trip(cbor.sb.items, cbor.sb.count, IMJ_ENCODING_JSON, &json, &out) && out.count <= sizeof(out.data);
+
+    // every number reads back from the json exactly as from its original text
+    imj_t r;
+    imjr_cstrn(out.data, out.count, &r);
+    imj_sv_t s = {0};
+    bool flags[2] = {0};
+    imj_begin_obj(&r);
+    imj_key_valrawsv(&r, "s", &s, "");
+    imj_key(&r, "flags");
+    imj_begin_arr(&r);
+    imj_valb(&r, &flags[0], false);
+    imj_valb(&r, &flags[1], true);
+    imj_end_arr(&r);
+    imj_key(&r, "numbers");
+    imj_begin_arr(&r);
+    for (size_t i = 0; i < total && passed; ++i) {
+        double expected = strtod(texts[i], NULL);
+        double got = 0;
+        imj_vald(&r, &got, 1);
+        passed = memcmp(&got, &expected, sizeof(double)) == 0;
+        if (!passed) printf("%s came back as %.17g\n", texts[i], got);
+    }
+    imj_end_arr(&r);
+    imj_end_obj(&r);
+    passed = passed && !r.had_error && s.length == 6 && memcmp(s.data, "a\\\"b\\n", 6) == 0 && flags[0] && !flags[1];
+
+    imj_free(&r);
+    imj_free(&cbor);
+    imj_free(&json);
+    return passed;
+}
+
 int main(void) {
     // basic reading string test
     {
@@ -588,4 +2166,112 @@ int main(void) {
     }
 
     nob_log(NOB_INFO, "%zu out of %zu read tests passed", read_tests_passed, read_test_count);
+
+    if (!cbor_roundtrip_test()) {
+        printf("failed cbor roundtrip test\n");
+    }
+
+    if (!transcode_test("test"FS"emag.json")) {
+        printf("failed transcode test\n");
+    }
+
+    if (!shape_cache_test()) {
+        printf("failed shape cache test\n");
+    }
+
+    if (!patch_test()) {
+        printf("failed patch test\n");
+    }
+
+    if (!async_flush_test()) {
+        printf("failed async flush test\n");
+    }
+
+    if (!compression_test()) {
+        printf("failed compression test\n");
+    }
+
+    if (!validate_test()) {
+        printf("failed validate test\n");
+    }
+
+    if (!skip_depth_test()) {
+        printf("failed skip depth test\n");
+    }
+
+    if (!key_iteration_test()) {
+        printf("failed key iteration test\n");
+    }
+
+    if (!shared_doc_test()) {
+        printf("failed shared doc test\n");
+    }
+
+    if (!doc_cache_test()) {
+        printf("failed doc cache test\n");
+    }
+
+    if (!string_store_test()) {
+        printf("failed string store test\n");
+    }
+
+    if (!fixed_buffers_test()) {
+        printf("failed fixed buffers test\n");
+    }
+
+    if (!integers_test()) {
+        printf("failed integers test\n");
+    }
+
+    if (!doubles_test()) {
+        printf("failed doubles test\n");
+    }
+
+    if (!columns_test()) {
+        printf("failed columns test\n");
+    }
+
+    if (!path_test()) {
+        printf("failed path test\n");
+    }
+
+    if (!batch_test()) {
+        printf("failed batch test\n");
+    }
+
+    if (!unterminated_test()) {
+        printf("failed unterminated test\n");
+    }
+
+    if (!bytes_test()) {
+        printf("failed bytes test\n");
+    }
+
+    if (!journal_test()) {
+        printf("failed journal test\n");
+    }
+
+    if (!flush_if_changed_test()) {
+        printf("failed flush if changed test\n");
+    }
+
+    if (!level_reuse_test()) {
+        printf("failed level reuse test\n");
+    }
+
+    if (!scan_test()) {
+        printf("failed scan test\n");
+    }
+
+    if (!sink_test()) {
+        printf("failed sink test\n");
+    }
+
+    if (!stats_test()) {
+        printf("failed stats test\n");
+    }
+
+    if (!fmt_round_trip_test()) {
+        printf("failed fmt round trip test\n");
+    }
 }
@@ -0,0 +1,191 @@
+// built against an imj.h compiled as c, see nob.c
+#include "imj.hpp"
+
+#include <memory_resource>
+#include <stdio.h>
+#include <string.h>
+
+enum class item_type_t : uint8_t {
+    BOW,
+    SWORD,
+    FISHING_LINE,
+};
+
+struct item_t {
+    item_type_t type = item_type_t::BOW;
+    uint16_t count = 0;
+    float weight = 0;
+};
+IMJ_FIELDS(item_t, type, count, weight)
+
+namespace game {
+
+struct player_t {
+    uint64_t id = 0;
+    int level = 1;
+    double health = 100;
+    bool alive = true;
+    size_t gold = 0;
+    int8_t luck = 0;
+    item_t items[3];
+    int position[2] = {0, 0};
+};
+IMJ_FIELDS(player_t, id, level, health, alive, gold, luck, items, position)
+
+} // namespace game
+
+static bool same(const game::player_t &a, const game::player_t &b) {
+    bool passed = a.id == b.id && a.level == b.level && a.health == b.health && a.alive == b.alive
+        && a.gold == b.gold && a.luck == b.luck && a.position[0] == b.position[0] && a.position[1] == b.position[1];
+    for (size_t i = 0; i < 3; ++i) {
+        passed = passed && a.items[i].type == b.items[i].type && a.items[i].count == b.items[i].count && a.items[i].weight == b.items[i].weight;
+    }
+    return passed;
+}
+
+bool fields_test(void) {
+    game::player_t player;
+    player.id = 18446744073709551557ull;
+    player.level = 42;
+    player.health = 87.5;
+    player.alive = false;
+    player.gold = 1234567;
+    player.luck = -3;
+    player.items[1] = { item_type_t::FISHING_LINE, 7, 1.25f };
+    player.position[0] = -10;
+    player.position[1] = 20;
+
+    bool passed = true;
+    for (int encoding = IMJ_ENCODING_JSON; encoding <= IMJ_ENCODING_CBOR; ++encoding) {
+        imj_t w = {};
+        imjw_init_ex(&w, (imj_encoding_t)encoding);
+        imj::io(&w, player);
+
+        game::player_t read;
+        imj_t r = {};
+        imjr_cstrn(w.sb.items, w.sb.count, &r);
+        passed = passed && imj::io(&r, read) && r.done && !r.had_error && same(read, player);
+
+        imj_free(&w);
+        imj_free(&r);
+    }
+
+    // missing keys keep the values the object started with
+    const char *src = "{\"level\": 3, \"items\": [{\"type\": 1}]}";
+    game::player_t partial;
+    imj_t r = {};
+    imjr_cstrn(src, strlen(src), &r);
+    r.log_errors = false;
+    imj::io(&r, partial);
+
+    passed = passed && !r.had_error && partial.level == 3 && partial.health == 100 && partial.alive
+        && partial.items[0].type == item_type_t::SWORD && partial.items[0].count == 0 && partial.items[1].type == item_type_t::BOW;
+    imj_free(&r);
+
+    return passed;
+}
+
+struct inventory_t {
+    std::pmr::vector<std::pmr::string> names;
+    std::pmr::vector<int> counts;
+    std::vector<bool> equipped;
+    std::string_view title;
+
+    explicit inventory_t(std::pmr::memory_resource *resource) : names(resource), counts(resource) {}
+};
+IMJ_FIELDS(inventory_t, names, counts, equipped, title)
+
+bool containers_test(void) {
+    const char *src = "{\"names\": [\"bow\", \"long sword\", \"tab\\there\"], \"counts\": [1, 2, 3, 4, 5], \"equipped\": [true, false], \"title\": \"hunter\"}";
+
+    // everything the pmr containers decode lands in 'frame', it can't fall back to the heap
+    alignas(16) char frame[1024];
+    std::pmr::monotonic_buffer_resource resource(frame, sizeof(frame), std::pmr::null_memory_resource());
+
+    bool passed = true;
+    inventory_t inventory(&resource);
+    imj_t r = {};
+    imjr_cstrn(src, strlen(src), &r);
+    imj::io(&r, inventory);
+
+    passed = passed && r.done && !r.had_error
+        && inventory.names.size() == 3 && inventory.names.capacity() == 3 && inventory.names[1] == "long sword" && inventory.names[2] == "tab\there"
+        && inventory.names[2].get_allocator().resource() == &resource
+        && inventory.counts.size() == 5 && inventory.counts.capacity() == 5 && inventory.counts[4] == 5
+        && inventory.equipped.size() == 2 && inventory.equipped[0] && !inventory.equipped[1]
+        && inventory.title == "hunter" && inventory.title.data() > src && inventory.title.data() < src + strlen(src);
+    imj_free(&r);
+
+    // and back out, through cbor
+    imj_t w = {};
+    imjw_init_ex(&w, IMJ_ENCODING_CBOR);
+    imj::io(&w, inventory);
+
+    inventory_t back(std::pmr::new_delete_resource());
+    imjr_cstrn(w.sb.items, w.sb.count, &r);
+    imj::io(&r, back);
+
+    passed = passed && !r.had_error && back.names == inventory.names && back.counts == inventory.counts
+        && back.equipped == inventory.equipped && back.title == "hunter";
+    imj_free(&w);
+    imj_free(&r);
+
+    return passed;
+}
+
+#ifdef __IMJ_HAS_SPAN
+// only built as c++20, see nob.c
+bool span_test(void) {
+    int scores[4] = {3, -1, 40, 7};
+    item_t items[2] = { { item_type_t::SWORD, 2, 0.5f }, { item_type_t::FISHING_LINE, 9, 3.0f } };
+    std::span<int> score_span(scores);
+    std::span<item_t, 2> item_span(items);
+
+    bool passed = true;
+    for (int encoding = IMJ_ENCODING_JSON; encoding <= IMJ_ENCODING_CBOR; ++encoding) {
+        imj_t w = {};
+        imjw_init_ex(&w, (imj_encoding_t)encoding);
+        imj_begin_obj(&w);
+        imj::field(&w, "scores", 6, score_span);
+        imj::field(&w, "items", 5, item_span);
+        imj_end_obj(&w);
+
+        int read_scores[4] = {};
+        item_t read_items[2];
+        std::span<int> read_score_span(read_scores);
+        std::span<item_t, 2> read_item_span(read_items);
+
+        imj_t r = {};
+        imjr_cstrn(w.sb.items, w.sb.count, &r);
+        imj_begin_obj(&r);
+        passed = passed && imj::field(&r, "scores", 6, read_score_span) && imj::field(&r, "items", 5, read_item_span);
+        imj_end_obj(&r);
+
+        passed = passed && r.done && !r.had_error && memcmp(read_scores, scores, sizeof(scores)) == 0;
+        for (size_t i = 0; i < 2; ++i) {
+            passed = passed && read_items[i].type == items[i].type && read_items[i].count == items[i].count && read_items[i].weight == items[i].weight;
+        }
+
+        imj_free(&w);
+        imj_free(&r);
+    }
+
+    return passed;
+}
+#endif
+
+int main(void) {
+    if (!fields_test()) {
+        printf("failed fields test\n");
+    }
+
+    if (!containers_test()) {
+        printf("failed containers test\n");
+    }
+
+#ifdef __IMJ_HAS_SPAN
+    if (!span_test()) {
+        printf("failed span test\n");
+    }
+#endif
+}
@@ -0,0 +1,99 @@
+// the profiler hooks are compiled into every io function, so they get their own program instead of the main tester
+#define NOB_IMPLEMENTATION
+#include "nob.h"
+#undef NOB_IMPLEMENTATION
+
+#define IMJ_PROFILER
+#define IMJ_IMPLEMENTATION
+#include "imj.h"
+
+typedef struct player_t player_t;
+struct player_t {
+    int level;
+    int items[3];
+};
+
+static void player_io(player_t *player, imj_t *imj) {
+    imj_begin_obj(imj);
+    imj_key_vali(imj, "level", &player->level, 0);
+
+    imj_key(imj, "player");
+    imj_begin_obj(imj);
+    imj_key(imj, "items");
+    imj_begin_arr(imj);
+    for (size_t i = 0; i < 3; ++i) {
+        imj_begin_obj(imj);
+        imj_key_vali(imj, "type", &player->items[i], 0);
+        imj_end_obj(imj);
+    }
+    imj_end_arr(imj);
+    imj_end_obj(imj);
+
+    imj_end_obj(imj);
+}
+
+bool profile_test(void) {
+    imj_profile_t *profile = imj_profile_new();
+
+    player_t player = { .level = 7, .items = {1, 2, 3} };
+    imj_t w = {0};
+    imjw_init(&w);
+    w.profile = profile;
+    player_io(&player, &w);
+
+    player_t read = {0};
+    imj_t r;
+    imjr_cstrn(w.sb.items, w.sb.count, &r);
+    r.profile = profile;
+    player_io(&read, &r);
+
+    bool passed = r.done && !r.had_error && read.level == player.level && read.items[2] == player.items[2];
+    imj_free(&w);
+    imj_free(&r);
+
+    const char *report = "tester_profile.txt";
+    const char *trace = "tester_profile.json";
+    passed = passed && imj_profile_report(profile, report) && imj_profile_trace(profile, trace);
+
+    // every scope shows up by its path, and the trace is json itself
+    Nob_String_Builder sb = {0};
+    passed = passed && nob_read_entire_file(report, &sb);
+    nob_sb_append_null(&sb);
+    passed = passed && strstr(sb.items, "/player/items[]/type ") && strstr(sb.items, "/level ");
+    sb.count = 0;
+    passed = passed && nob_read_entire_file(trace, &sb) && imj_validate(sb.items, sb.count, NULL);
+    nob_sb_free(sb);
+
+    remove(report);
+    remove(trace);
+    imj_profile_free(profile);
+    return passed;
+}
+
+// hooks compiled in but no profile attached must not change what is read or written
+bool unattached_test(void) {
+    player_t player = { .level = 7, .items = {4, 5, 6} };
+    imj_t w = {0};
+    imjw_init(&w);
+    player_io(&player, &w);
+
+    player_t read = {0};
+    imj_t r;
+    imjr_cstrn(w.sb.items, w.sb.count, &r);
+    player_io(&read, &r);
+
+    bool passed = r.done && !r.had_error && memcmp(&read, &player, sizeof(player)) == 0;
+    imj_free(&w);
+    imj_free(&r);
+    return passed;
+}
+
+int main(void) {
+    if (!profile_test()) {
+        printf("failed profile test\n");
+    }
+
+    if (!unattached_test()) {
+        printf("failed unattached test\n");
+    }
+}